@@ -0,0 +1,171 @@
+/*
+** Sample handler module, built by make into handlers/hello.so:
+**
+**	location /hello/ {
+**		allowed_methods GET POST;
+**		handler handlers/hello.so;
+**	}
+**
+** Answers with what it was asked. ?slices=N writes the body in N calls,
+** returning WS_AGAIN in between; ?delay=MS waits on a timerfd before it
+** answers (Linux only).
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <webserv_handler.h>
+
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
+
+typedef struct hello_state
+{
+	unsigned long slices;
+	unsigned long sliced;
+	int timer;
+} hello_state;
+
+static const ws_api *g_api;
+
+static ws_str str(const char *data, size_t length)
+{
+	ws_str result = {data, length};
+
+	return (result);
+}
+
+static void print(ws_response *response, const char *text)
+{
+	g_api->write(response, str(text, strlen(text)));
+}
+
+static void header(ws_response *response, const char *name, const char *value)
+{
+	g_api->header(response, str(name, strlen(name)),
+				  str(value, strlen(value)));
+}
+
+/* The value of name=... in the query, 0 without one. */
+static unsigned long queryNumber(ws_str query, const char *name)
+{
+	const size_t length = strlen(name);
+	size_t i = 0;
+
+	while (i + length < query.length)
+	{
+		if ((i == 0 || query.data[i - 1] == '&') &&
+			memcmp(query.data + i, name, length) == 0 &&
+			query.data[i + length] == '=')
+			return (strtoul(query.data + i + length + 1, NULL, 10));
+		i++;
+	}
+	return (0);
+}
+
+static hello_state *start(const ws_request *request, ws_response *response)
+{
+	hello_state *state = calloc(1, sizeof(*state));
+	char line[64];
+
+	if (state == NULL)
+		return (NULL);
+	state->slices = queryNumber(request->query, "slices");
+	state->timer = -1;
+#ifdef __linux__
+	{
+		const unsigned long delay = queryNumber(request->query, "delay");
+		struct itimerspec expiry = {{0, 0},
+									{delay / 1000, (delay % 1000) * 1000000}};
+
+		if (delay != 0)
+			state->timer = timerfd_create(CLOCK_MONOTONIC,
+										  TFD_CLOEXEC | TFD_NONBLOCK);
+		if (state->timer != -1 &&
+			timerfd_settime(state->timer, 0, &expiry, NULL) == -1)
+		{
+			close(state->timer);
+			free(state);
+			return (NULL);
+		}
+	}
+#endif
+	header(response, "Content-Type", "text/plain");
+	header(response, "Cache-Control", "no-store");
+	print(response, "Hello from a handler module\n");
+	g_api->write(response, request->method);
+	print(response, " ");
+	g_api->write(response, request->target);
+	if (request->query.length != 0)
+		print(response, "?");
+	g_api->write(response, request->query);
+	snprintf(line, sizeof(line), "\n%lu header(s), %lu byte(s) of body\n",
+			 (unsigned long)request->header_count,
+			 (unsigned long)request->body.length);
+	print(response, line);
+	return (state);
+}
+
+int ws_handler_init(const ws_api *api, void **module)
+{
+	(void)module;
+	if (api->abi != WS_HANDLER_ABI)
+		return (-1);
+	g_api = api;
+	return (0);
+}
+
+ws_result ws_handler_handle(void *module, const ws_request *request,
+							ws_response *response, void **state)
+{
+	hello_state *hello = *state;
+	char line[64];
+
+	(void)module;
+	if (hello == NULL)
+	{
+		hello = start(request, response);
+		if (hello == NULL)
+			return (WS_ERROR);
+		*state = hello;
+	}
+	if (hello->timer != -1)
+	{
+		uint64_t expirations;
+
+		if (read(hello->timer, &expirations, sizeof(expirations)) == -1)
+		{
+			g_api->wait(response, hello->timer, POLLIN);
+			return (WS_AGAIN);
+		}
+		close(hello->timer);
+		hello->timer = -1;
+		print(response, "waited\n");
+	}
+	if (hello->sliced < hello->slices)
+	{
+		snprintf(line, sizeof(line), "slice %lu\n", ++hello->sliced);
+		print(response, line);
+		return (WS_AGAIN);
+	}
+	free(hello);
+	return (WS_DONE);
+}
+
+void ws_handler_abort(void *module, void *state)
+{
+	hello_state *hello = state;
+
+	(void)module;
+	if (hello == NULL)
+		return;
+	if (hello->timer != -1)
+		close(hello->timer);
+	free(hello);
+}
@@ -3,14 +3,48 @@
 
 #include "Logger.hpp"
 
-#include <dirent.h>
-#include <fstream>
+#include <sys/stat.h>
+
+#include <cstddef>
 #include <string>
 
+#ifndef AUTOINDEX_PAGE_SIZE
+#define AUTOINDEX_PAGE_SIZE 1000
+#endif
+
 namespace AutoIndexGenerator
 {
-std::fstream OpenAutoIndex(std::string directory, const std::string uri);
-std::string AutoIndexGenerator(const std::string dir, const std::string uri);
+enum class Format
+{
+	HTML,
+	JSON,
+};
+
+enum class Sort
+{
+	NONE,
+	NAME,
+	MTIME,
+	SIZE,
+};
+
+// Taken from the query string: ?page=<n>&sort=<name|mtime|size>&format=json.
+// page 0 lists the whole directory; sorting always pages.
+struct Options
+{
+	Format format;
+	Sort sort;
+	size_t page;
+};
+
+Options parseQuery(const std::string &query);
+bool isDefault(const Options &options);
+void appendHead(std::string &out, const std::string &uri,
+				const Options &options);
+void appendEntry(std::string &out, const char *name,
+				 const struct stat *filestat, const Options &options,
+				 bool first);
+void appendTail(std::string &out, const Options &options, bool more);
 
 } // namespace AutoIndexGenerator
 
@@ -0,0 +1,72 @@
+#ifndef AUTOINDEXSTREAM_HPP
+#define AUTOINDEXSTREAM_HPP
+
+#include "AutoIndexGenerator.hpp"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#ifndef AUTOINDEX_BATCH_SIZE
+#define AUTOINDEX_BATCH_SIZE 256
+#endif
+
+#ifndef AUTOINDEX_COLLECT_LIMIT
+#define AUTOINDEX_COLLECT_LIMIT (256 * 1024)
+#endif
+
+// Renders a directory listing a batch of entries at a time while readdir()
+// proceeds, so memory and time to first byte don't grow with the directory.
+// Only a sorted page needs the whole directory read up front; it keeps the
+// best page * AUTOINDEX_PAGE_SIZE entries. A plain listing that stays under
+// AUTOINDEX_COLLECT_LIMIT is kept for the ListingCache. open() and next() do
+// the blocking directory reads and may run on the WorkerPool; storeCollected()
+// belongs to the event loop.
+class AutoIndexStream
+{
+  public:
+	AutoIndexStream(const std::string &dir, const std::string &uri,
+					const struct stat &dir_stat,
+					const AutoIndexGenerator::Options &options);
+	AutoIndexStream() = delete;
+	AutoIndexStream(const AutoIndexStream &other) = delete;
+	AutoIndexStream &operator=(const AutoIndexStream &rhs) = delete;
+	~AutoIndexStream();
+
+	void open(void);
+	bool isOpen(void) const;
+	bool next(std::string &out);
+	void storeCollected(void);
+
+  private:
+	struct Entry
+	{
+		std::string name;
+		struct stat filestat;
+		bool found;
+	};
+
+	DIR *_dir;
+	const std::string _dir_path;
+	const std::string _uri;
+	const struct stat _dir_stat;
+	const AutoIndexGenerator::Options _options;
+	bool _started;
+	size_t _skipped;
+	size_t _emitted;
+	std::vector<Entry> _sorted;
+	size_t _sorted_pos;
+	bool _more;
+	bool _collect;
+	std::string _collected;
+
+	const char *readName(void);
+	void readSorted(void);
+	bool nextUnsorted(std::string &out);
+	bool nextSorted(std::string &out);
+	void collect(const std::string &out, size_t start);
+};
+
+#endif
@@ -1,27 +1,71 @@
 #ifndef CGI_HPP
 #define CGI_HPP
 
+#include <CGIHead.hpp>
 #include <ClientState.hpp>
 #include <HTTPRequest.hpp>
+#include <LocationSettings.hpp>
+#include <Outcome.hpp>
+#include <chrono>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <unordered_map>
 
 #define READ_END 0
 #define WRITE_END 1
 
+#ifndef CGI_READ_SIZE
+#define CGI_READ_SIZE 65536
+#endif
+
 class Client;
 class Poll;
+struct CGIFlight;
+struct ChildExit;
+struct FastCGIRequest;
 
 class CGI
 {
+public:
+	// How the script's output reaches the client: nothing goes out before
+	// its head is complete, then the body follows as it arrives unless the
+	// response is only sent Whole, once the script is done.
+	enum class Output
+	{
+		Head,
+		Whole,
+		Streamed,
+	};
+
 private:
 	pid_t		_pid;
 	size_t		_bodyBytesWritten;
+	bool		_bodyFromSocket;
 	std::string	_executable;
 	std::string	_pathInfo;
 	std::string	_subPathInfo;
 	std::string	_queryString;
+	std::string	_fastcgi_pass;
+	bool		_pooled;
+	std::string	_fastcgi_params;
+	std::shared_ptr<FastCGIRequest>	_fastcgi;
+	std::shared_ptr<ChildExit>	_child;
+	CGIHead		_head;
+	Output		_output;
+	CGILimits	_limits;
+	size_t		_outputSize;
+	std::chrono::steady_clock::time_point	_deadline;
+	std::shared_ptr<CGIFlight>	_flight;
+	bool		_leadsFlight;
+	int			_flightFd;
+
+	Outcome<ClientState>	spawn(Client &client);
+	void		feedFlight(std::string_view output);
+	void		endFlight(StatusCode status);
+	std::string	limitCommand(void) const;
+	void		killScript(void);
+	void		closePipes(Client &client);
 
   public:
 	CGI();
@@ -29,20 +73,36 @@ private:
 	CGI &operator=(const CGI &rhs) = delete;
 	~CGI();
 
-	ClientState	start(Poll &poll, Client &client, size_t body_length, 
+	Outcome<ClientState>	start(Poll &poll, Client &client,
+		size_t body_length,
 		std::unordered_map<int, std::shared_ptr<int>> &active_pipes);
-	ClientState	parseURIForCGI(std::string requestTarget);
-	void		execute(std::string executable);
+	Outcome<ClientState>	parseURIForCGI(std::string requestTarget,
+		const std::string &query);
+	Outcome<ClientState>	prepareFastCGI(const HTTPRequest &request,
+		const LocationSettings &loc, const ServerSettings &server);
+	Outcome<ClientState>	usePool(const std::string &pool,
+		const std::string &query);
+	bool		isFastCGI(void) const;
 	bool		fileExists(const std::string& filePath);
 	bool		isExecutable(const std::string& filePath);
 
 	const std::string&	getExecutable(void) const;
 	void				setExecutable(std::string executable);
 	const pid_t&		getPid(void) const;
+	CGIHead&			getHead(void);
+	Output				getOutput(void) const;
+	void				setOutput(Output output);
+	void				setLimits(const CGILimits &limits);
+	std::chrono::steady_clock::time_point	getDeadline(void) const;
+	void				stop(Poll &poll);
+	bool				joinFlight(const std::string &key, int client_fd);
+	bool				followsFlight(void) const;
 
-	ClientState	send(Client &client ,std::string body, size_t bodyLength);
-	size_t		getBufferSize(size_t bodyLength);
-	ClientState	receive(Client &client);
+	Outcome<ClientState>	send(Poll &poll, Client &client);
+	Outcome<ClientState>	receive(Client &client);
+	Outcome<ClientState>	receiveFastCGI(void);
+	Outcome<ClientState>	receiveFlight(void);
+	Outcome<ClientState>	complete(Client &client);
 
 	std::string	body;
 	int			pipe_fd[2];
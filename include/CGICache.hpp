@@ -0,0 +1,116 @@
+#ifndef CGICACHE_HPP
+#define CGICACHE_HPP
+
+#include <CGIHead.hpp>
+
+#include <ctime>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#ifndef CGI_CACHE_SIZE
+#define CGI_CACHE_SIZE (32 * 1024 * 1024)
+#endif
+
+// Largest body of a response cgi_cache keeps.
+#ifndef CGI_CACHE_MAX_ENTRY
+#define CGI_CACHE_MAX_ENTRY (1024 * 1024)
+#endif
+
+// Seconds between the counters showing up in the log.
+#ifndef CGI_CACHE_REPORT_INTERVAL
+#define CGI_CACHE_REPORT_INTERVAL 60
+#endif
+
+// A complete CGI response as the script produced it. serial tells apart
+// responses stored under the same key, for the compressed bodies kept in the
+// CompressionCache.
+struct CachedCgi
+{
+	CGIHead head;
+	std::string body;
+	size_t serial;
+	time_t stored;
+	time_t fresh_until;
+	time_t stale_until;
+	time_t updating_until;
+};
+
+// A script running for a cgi_cache key, that identical requests wait on
+// instead of running it again. output holds what it wrote from byte base on,
+// waiters maps their client fds to how much of it they took. It stays open
+// to new waiters until its head turned out not to be shared, its output
+// outgrew CGI_CACHE_MAX_ENTRY or it ended, with status OK if the script
+// completed.
+struct CGIFlight
+{
+	std::string key;
+	std::string output;
+	size_t base;
+	std::map<int, size_t> waiters;
+	bool open;
+	bool checked;
+	bool shared;
+	bool ended;
+	StatusCode status;
+};
+
+// Complete responses of cgi_cache locations, keyed by method, virtual host,
+// target and query. An entry is fresh for the location's cgi_cache seconds
+// or the script's Cache-Control max-age, and may then be served stale for
+// cgi_cache_stale seconds or its stale-while-revalidate: the first request
+// after it went stale runs the script again while the others get the stale
+// copy. Evicted least recently used first once the stored bytes exceed
+// CGI_CACHE_SIZE. A key that isn't stored runs one script at a time, see
+// CGIFlight. Only touched from the event loop.
+class CGICache
+{
+  public:
+	CGICache();
+	CGICache(const CGICache &other) = delete;
+	CGICache &operator=(const CGICache &rhs) = delete;
+	~CGICache();
+
+	static CGICache &getInstance();
+
+	std::shared_ptr<const CachedCgi> find(const std::string &key,
+										  size_t revalidate);
+	std::shared_ptr<const CachedCgi> store(const std::string &key,
+										   const CGIHead &head,
+										   std::string_view body, size_t ttl,
+										   size_t stale);
+
+	std::shared_ptr<CGIFlight> join(const std::string &key, int client_fd);
+	std::shared_ptr<CGIFlight> lead(const std::string &key);
+	bool feed(CGIFlight &flight, std::string_view output);
+	void follow(CGIFlight &flight, int client_fd, std::string &into);
+	void leave(CGIFlight &flight, int client_fd);
+	void finish(CGIFlight &flight, StatusCode status);
+	std::vector<int> collectWoken(void);
+
+  private:
+	typedef std::pair<std::string, std::shared_ptr<CachedCgi>> Entry;
+
+	std::list<Entry> _entries;
+	std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+	std::unordered_map<std::string, std::shared_ptr<CGIFlight>> _flights;
+	std::vector<int> _woken;
+	size_t _size;
+	size_t _serial;
+	size_t _hits;
+	size_t _stale;
+	size_t _misses;
+	size_t _coalesced;
+	time_t _next_report;
+
+	void erase(std::list<Entry>::iterator it);
+	void close(CGIFlight &flight);
+	void wake(const CGIFlight &flight);
+	void report(time_t now);
+};
+
+#endif
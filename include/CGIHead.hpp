@@ -0,0 +1,50 @@
+#ifndef CGIHEAD_HPP
+#define CGIHEAD_HPP
+
+#include <Outcome.hpp>
+#include <StatusCode.hpp>
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// The header lines a CGI script's output starts with (RFC 3875, 6.2). Status
+// and Location decide the status code, Content-Type and Content-Length are
+// kept apart and every other field is passed on to the client as it is.
+class CGIHead
+{
+  public:
+	enum class Parse
+	{
+		Incomplete,
+		Complete,
+		Missing,
+	};
+
+	CGIHead();
+	~CGIHead();
+
+	Outcome<Parse> parse(std::string_view output, bool eof);
+	StatusCode getStatusCode(void) const;
+	const std::string &getContentType(void) const;
+	bool hasContentLength(void) const;
+	size_t getContentLength(void) const;
+	size_t getLength(void) const;
+	const std::vector<std::pair<std::string, std::string>> &
+	getFields(void) const;
+	void setStatusCode(StatusCode status_code);
+	void setContentType(std::string_view content_type);
+	void addField(std::string_view name, std::string_view value);
+
+  private:
+	StatusCode _status_code;
+	std::string _content_type;
+	bool _has_content_length;
+	size_t _content_length;
+	size_t _length;
+	std::vector<std::pair<std::string, std::string>> _fields;
+};
+
+#endif // !CGIHEAD_HPP
@@ -0,0 +1,32 @@
+#ifndef CGIPOOL_HPP
+#define CGIPOOL_HPP
+
+#include <Poll.hpp>
+#include <ServerSettings.hpp>
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <string>
+
+// The worker script, relative to the directory the server runs in.
+#ifndef CGI_POOL_WORKER
+#define CGI_POOL_WORKER "scripts/cgi_pool_worker.py"
+#endif
+
+// Long-lived Python interpreters for cgi_pool locations. A worker speaks a
+// FastCGI subset over a socketpair, one request at a time, so FastCGI owns
+// the connections and their framing; this only names pools and starts and
+// stops the processes. A worker runs each script with the environment, argv,
+// stdin and stdout a forked CGI would see, keeps its compiled code until the
+// file changes and keeps whatever the script imported.
+namespace CGIPool
+{
+std::string name(const ServerSettings &server, const LocationSettings &loc);
+void checkWorker(void);
+int spawn(Poll &poll, pid_t &pid);
+void stop(Poll &poll, pid_t pid);
+
+} // namespace CGIPool
+
+#endif // !CGIPOOL_HPP
@@ -0,0 +1,56 @@
+#ifndef CHILDREAPER_HPP
+#define CHILDREAPER_HPP
+
+#include <Poll.hpp>
+
+#include <sys/types.h>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// A child process and, once it has been reaped, how it ended: status as
+// waitpid() gave it, or lost if waitpid() failed and that is unknown. Shared
+// between whoever waits for it and the reaper.
+struct ChildExit
+{
+	pid_t pid;
+	int client_fd;
+	bool exited;
+	bool lost;
+	int status;
+};
+
+// Collects the exit status of child processes without blocking the event
+// loop. On Linux every child gets a pidfd in the poll set that turns
+// readable when it exits; elsewhere, or when pidfd_open is missing, a
+// SIGCHLD handler writes to a self-pipe and all watched children are polled
+// with WNOHANG. Either way a child is reaped even if nobody waits for it
+// any more, and the client waiting on it is returned by collectExited().
+// Only touched from the event loop.
+class ChildReaper
+{
+  public:
+	ChildReaper();
+	ChildReaper(const ChildReaper &other) = delete;
+	ChildReaper &operator=(const ChildReaper &rhs) = delete;
+	~ChildReaper();
+
+	static ChildReaper &getInstance();
+
+	std::shared_ptr<ChildExit> watch(Poll &poll, pid_t pid, int client_fd);
+	bool owns(int fd) const;
+	void handleEvents(Poll &poll, int fd);
+	std::vector<int> collectExited(void);
+
+  private:
+	std::unordered_map<int, std::shared_ptr<ChildExit>> _pidfds;
+	std::vector<std::shared_ptr<ChildExit>> _signalled;
+	int _pipe[2];
+	std::vector<int> _exited;
+
+	bool installHandler(Poll &poll);
+	bool reap(const std::shared_ptr<ChildExit> &child);
+};
+
+#endif // !CHILDREAPER_HPP
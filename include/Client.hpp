@@ -8,10 +8,13 @@
 #include "ServerSettings.hpp"
 #include "Socket.hpp"
 
+#include <chrono>
 #include <memory>
 #include <unistd.h>
 #include <unordered_map>
 
+class HandlerCall;
+
 class Client
 {
   public:
@@ -30,25 +33,42 @@ class Client
 	int *getServerToCgiFd(void);
 	HTTPRequest &getRequest(void);
 	void setState(ClientState state);
+	ClientState getState(void) const;
+	ClientState setErrorResponse(StatusCode status_code);
+	bool waitsOnCgi(void) const;
+	std::chrono::steady_clock::time_point getCgiDeadline(void) const;
+	ClientState expireCgi(Poll &poll);
+	ClientState bufferCgi(void);
 
 	FileManager &getFileManager();
 	HTTPResponse &getResponse();
 
 	bool cgiBodyIsSent;
 	bool cgiHasBeenRead;
-	bool KO;
 
   private:
 	HTTPRequest _request;
 	HTTPResponse _response;
 	FileManager _file_manager;
 	CGI _cgi;
+	std::unique_ptr<HandlerCall> _handler;
 	Socket _socket;
 	const std::vector<ServerSettings> &_server_list;
 	ServerSettings _serversetting;
 	ClientState _state;
 	int _serverToCgiFd[2];
 	int _cgiToServerFd[2];
+
+	ClientState settle(const Outcome<ClientState> &outcome);
+	Outcome<ClientState> receiveRequest(void);
+	Outcome<ClientState> loadRequest(Poll &poll);
+	Outcome<ClientState> startHandler(Poll &poll, const LocationSettings &loc);
+	Outcome<ClientState> runHandler(Poll &poll);
+	Outcome<ClientState> forwardCgi(bool complete);
+	Outcome<ClientState> readCgi(Poll &poll);
+	Outcome<ClientState> drainCgi(Poll &poll);
+	Outcome<ClientState> followFlight(void);
+	Outcome<ClientState> finishCgi(void);
 };
 
 const std::string MethodToString(HTTPMethod num);
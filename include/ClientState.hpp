@@ -4,10 +4,15 @@
 enum class ClientState
 {
 	Receiving,
+	Uploading,
 	CGI_Start,
 	CGI_Write,
 	CGI_Read,
+	CGI_Stream,
 	Loading,
+	Handling,
+	Waiting,
+	Streaming,
 	Sending,
 	Done,
 	Error,
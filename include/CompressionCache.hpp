@@ -0,0 +1,38 @@
+#ifndef COMPRESSIONCACHE_HPP
+#define COMPRESSIONCACHE_HPP
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#ifndef COMPRESSION_CACHE_SIZE
+#define COMPRESSION_CACHE_SIZE (8 * 1024 * 1024)
+#endif
+
+// Compressed bodies of reproducible responses (e.g. an autoindex of an
+// unchanged directory), evicted least recently used first once the stored
+// bytes exceed COMPRESSION_CACHE_SIZE. Only touched from the event loop.
+class CompressionCache
+{
+  public:
+	CompressionCache();
+	CompressionCache(const CompressionCache &other) = delete;
+	CompressionCache &operator=(const CompressionCache &rhs) = delete;
+	~CompressionCache();
+
+	static CompressionCache &getInstance();
+
+	std::shared_ptr<const std::string> find(const std::string &key);
+	void store(const std::string &key, const std::string &body);
+
+  private:
+	typedef std::pair<std::string, std::shared_ptr<const std::string>> Entry;
+
+	std::list<Entry> _entries;
+	std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+	size_t _size;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef COMPRESSOR_HPP
+#define COMPRESSOR_HPP
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+struct z_stream_s;
+
+#ifndef COMPRESS_CHUNK_SIZE
+#define COMPRESS_CHUNK_SIZE 16384
+#endif
+
+namespace Compressor
+{
+enum class Coding
+{
+	IDENTITY,
+	GZIP,
+	DEFLATE,
+};
+
+const std::string codingToString(Coding coding);
+bool compress(const std::string &input, std::string &output, Coding coding,
+			  int level);
+
+// Deflates a body that arrives piece by piece. Every write() flushes what it
+// was given, so each piece can be sent on before the next one exists.
+class Stream
+{
+  public:
+	Stream(Coding coding, int level);
+	Stream() = delete;
+	Stream(const Stream &other) = delete;
+	Stream &operator=(const Stream &rhs) = delete;
+	~Stream();
+
+	bool write(std::string_view input, std::string &output, bool finish);
+
+  private:
+	std::unique_ptr<z_stream_s> _stream;
+	bool _ready;
+};
+
+} // namespace Compressor
+
+// A response body waiting to be compressed on the WorkerPool. The worker only
+// touches input/output/succeeded, everything else belongs to the event loop.
+struct CompressionJob
+{
+	std::string head;
+	std::string input;
+	std::string output;
+	std::string cache_key;
+	Compressor::Coding coding;
+	int level;
+	bool succeeded;
+};
+
+#endif // !COMPRESSOR_HPP
@@ -0,0 +1,52 @@
+#ifndef ERRORPAGES_HPP
+#define ERRORPAGES_HPP
+
+#include <HTTPResponse.hpp>
+#include <StatusCode.hpp>
+
+#include <ctime>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+
+#ifndef ERROR_PAGE_MAX_SIZE
+#define ERROR_PAGE_MAX_SIZE (64 * 1024)
+#endif
+
+// Complete error responses per error_dir, serialized once and shared by
+// every client that hits that error. Pages found in error_dir are loaded at
+// startup; on use a page is checked against the disk at most once a second
+// and rebuilt when it changed. Codes without a page get the generated one.
+// Only touched from the event loop.
+class ErrorPages
+{
+  public:
+	ErrorPages();
+	ErrorPages(const ErrorPages &other) = delete;
+	ErrorPages &operator=(const ErrorPages &rhs) = delete;
+	~ErrorPages();
+
+	static ErrorPages &getInstance();
+
+	void preload(const std::string &error_dir);
+	std::shared_ptr<const CannedResponse> find(const std::string &error_dir,
+											   StatusCode status_code);
+
+  private:
+	struct Page
+	{
+		std::shared_ptr<const CannedResponse> response;
+		time_t mtime;
+		off_t size;
+		time_t checked;
+	};
+
+	std::unordered_map<std::string, Page> _pages;
+
+	static std::string pagePath(const std::string &error_dir,
+								StatusCode status_code);
+	void refresh(Page &page, const std::string &path, StatusCode status_code);
+};
+
+#endif
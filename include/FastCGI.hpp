@@ -0,0 +1,133 @@
+#ifndef FASTCGI_HPP
+#define FASTCGI_HPP
+
+#include <Poll.hpp>
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Persistent connections opened per fastcgi_pass backend.
+#ifndef FASTCGI_MAX_CONNECTIONS
+#define FASTCGI_MAX_CONNECTIONS 4
+#endif
+
+// Seconds between two liveness probes of an idle cgi_pool worker. One that
+// didn't answer the last probe by the next is replaced.
+#ifndef CGI_POOL_CHECK_INTERVAL
+#define CGI_POOL_CHECK_INTERVAL 10
+#endif
+
+// Requests multiplexed on one connection, for backends that say they can.
+#ifndef FASTCGI_MAX_REQUESTS
+#define FASTCGI_MAX_REQUESTS 16
+#endif
+
+// Largest response a backend may produce for one request, unless the
+// location's cgi_max_output is lower.
+#ifndef FASTCGI_MAX_OUTPUT
+#define FASTCGI_MAX_OUTPUT (16 * 1024 * 1024)
+#endif
+
+// A request for a FastCGI backend. The client's CGI and the connection
+// carrying it share it; a client that goes away just drops its share and
+// the answer is discarded when it comes in.
+struct FastCGIRequest
+{
+	int client_fd;
+	std::string params;
+	std::string body;
+	std::string output;
+	size_t max_output;
+	bool done;
+	bool failed;
+};
+
+// Non-blocking FastCGI client. Each backend gets up to
+// FASTCGI_MAX_CONNECTIONS connections that are kept open between requests
+// (FCGI_KEEP_CONN). A new connection asks the backend for FCGI_MPXS_CONNS
+// and carries one request at a time until it says it multiplexes; requests
+// that find every connection busy wait for a free request ID. Connection fds
+// are polled by HTTPServer, which wakes the clients returned by
+// collectCompleted(). A backend added with addPool() is a cgi_pool instead:
+// its connections are CGIPool workers, kept at the pool size and replaced
+// when they die, stop answering checkWorkers()' probes or served their
+// max_requests or max_age. Only touched from the event loop.
+class FastCGI
+{
+  public:
+	using Params = std::vector<std::pair<std::string, std::string>>;
+
+	FastCGI();
+	FastCGI(const FastCGI &other) = delete;
+	FastCGI &operator=(const FastCGI &rhs) = delete;
+	~FastCGI();
+
+	static FastCGI &getInstance();
+
+	static std::string encodeParams(const Params &params);
+	std::shared_ptr<FastCGIRequest> submit(Poll &poll,
+										   const std::string &backend,
+										   int client_fd, std::string params,
+										   std::string body, size_t max_output);
+	void abort(Poll &poll, const std::shared_ptr<FastCGIRequest> &request);
+	void addPool(Poll &poll, const std::string &name, size_t workers,
+				 size_t max_requests, size_t max_age);
+	void checkWorkers(Poll &poll);
+	bool owns(int fd) const;
+	void handleEvents(Poll &poll, int fd, short revents);
+	std::vector<int> collectCompleted(void);
+
+  private:
+	struct Connection
+	{
+		std::string backend;
+		pid_t pid;
+		bool connected;
+		bool healthy;
+		size_t max_requests;
+		size_t served;
+		time_t started;
+		time_t probed;
+		std::string out;
+		size_t out_sent;
+		std::string in;
+		std::unordered_map<uint16_t, std::shared_ptr<FastCGIRequest>>
+			requests;
+	};
+
+	struct Backend
+	{
+		std::vector<int> connections;
+		std::deque<std::shared_ptr<FastCGIRequest>> waiting;
+		size_t workers;
+		size_t max_requests;
+		size_t max_age;
+	};
+
+	std::unordered_map<int, Connection> _connections;
+	std::unordered_map<std::string, Backend> _backends;
+	std::vector<int> _completed;
+	time_t _next_check;
+
+	int open(Poll &poll, const std::string &backend);
+	void dispatch(Poll &poll, const std::string &backend);
+	void assign(Poll &poll, int fd, std::shared_ptr<FastCGIRequest> request);
+	bool flush(int fd, Connection &conn);
+	bool receive(int fd, Connection &conn);
+	void handleRecord(Connection &conn, uint8_t type, uint16_t id,
+					  const char *content, size_t length);
+	void finish(const std::shared_ptr<FastCGIRequest> &request, bool failed);
+	void drop(Poll &poll, int fd);
+	bool retires(const Connection &conn, time_t now) const;
+};
+
+#endif
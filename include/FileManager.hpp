@@ -1,24 +1,99 @@
 #ifndef FILE_MANAGER_HPP
 #define FILE_MANAGER_HPP
 
+#include "AutoIndexStream.hpp"
+#include "CGIHead.hpp"
+#include "Compressor.hpp"
 #include "HTTPRequest.hpp"
 #include "HTTPStatus.hpp"
+#include "HeaderWriter.hpp"
 #include "LocationSettings.hpp"
+#include "Outcome.hpp"
 #include "ServerSettings.hpp"
 
-#include <fstream>
+#include <atomic>
+#include <ctime>
+#include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
+
+// Largest amount moved from the socket into an upload per POLLIN, the
+// default capacity of a Linux pipe.
+#ifndef UPLOAD_SPLICE_SIZE
+#define UPLOAD_SPLICE_SIZE 65536
+#endif
+
+struct CachedCgi;
+struct FileLookup;
+struct FileUpload;
+
+// Work a client is waiting on in ClientState::Waiting, see
+// FileManager::submit().
+struct PendingJob
+{
+	std::function<Outcome<ClientState>()> then;
+	std::atomic<bool> done;
+};
 
 class FileManager
 {
   private:
 	std::string _response;
-	std::fstream _request_target;
 	ServerSettings _serversetting;
 	bool _autoindex;
-	size_t _bytes_sent;
+	int _client_fd;
+	std::shared_ptr<PendingJob> _job;
+	std::shared_ptr<AutoIndexStream> _listing;
+	std::shared_ptr<FileUpload> _upload;
+	// body bytes the script of a streamed CGI response still owes, npos if
+	// it gave no Content-Length
+	size_t _cgi_remaining;
+	// compresses a streamed CGI response, sent chunked, null if it isn't
+	std::unique_ptr<Compressor::Stream> _cgi_deflate;
+	// where the script's response goes in the CGICache, empty if it doesn't
+	std::string _cgi_cache_key;
+	size_t _cgi_cache_ttl;
+	size_t _cgi_cache_stale;
+	// a streamed response as it was sent, for the CGICache
+	CGIHead _cgi_cache_head;
+	std::string _cgi_cache_body;
 
-	std::string resolveRequestTarget(const std::string &request_target);
+	Outcome<std::string>
+	resolveRequestTarget(const std::string &request_target);
+	bool isNotModified(const HTTPRequest &request, const std::string &etag,
+					   time_t last_modified) const;
+	Compressor::Coding negotiateCompression(const HTTPRequest &request,
+											const LocationSettings &loc,
+											const std::string &mime_type) const;
+	ClientState submit(std::function<void()> work,
+					   std::function<Outcome<ClientState>()> then);
+	ClientState startCompression(const LocationSettings &loc,
+								 Compressor::Coding coding,
+								 const std::string &head,
+								 const std::string &body,
+								 const std::string &cache_key);
+	ClientState finishCompression(const CompressionJob &job);
+	Outcome<ClientState> respondGetFile(const HTTPRequest &request,
+										const FileLookup &lookup,
+										const std::string &uri,
+										const std::string &query);
+	Outcome<ClientState> openListing(const HTTPRequest &request,
+									 const LocationSettings &loc,
+									 const std::string &dir,
+									 const std::string &uri,
+									 const std::string &query,
+									 const struct stat &dir_stat);
+	Outcome<ClientState> finishUpload(void);
+	Outcome<ClientState> finishPartial(std::shared_ptr<FileUpload> upload);
+	ClientState respondStored(const std::string &path, bool created);
+	ClientState sendListing(const LocationSettings &loc,
+							Compressor::Coding coding, HeaderWriter &head,
+							std::shared_ptr<const std::string> listing);
+	Outcome<ClientState> sendCgi(const HTTPRequest &request,
+								 const LocationSettings &loc,
+								 const CGIHead &head, std::string_view body,
+								 const CachedCgi *cached);
 
   public:
 	FileManager();
@@ -26,25 +101,38 @@ class FileManager
 	void operator=(const FileManager &other) = delete;
 	~FileManager();
 
-	void openGetFile(const std::string &request_target_path);
-	void openPostFile(const std::string &request_target_path);
-	ClientState openErrorPage(const std::string &error_pages_path,
-							  const StatusCode &status_code);
-	ClientState loadErrorPage(void);
-	ClientState manage(HTTPMethod method, const std::string &filename,
-					   const std::string &body);
-	ClientState manageCgi(std::string http_version, const std::string &body);
-	ClientState manageGet(void);
-	ClientState managePost(const std::string &body);
-	ClientState manageDelete(const std::string &reqest_target_path);
+	Outcome<ClientState> openGetFile(const HTTPRequest &request);
+	Outcome<ClientState> manage(const HTTPRequest &request);
+	Outcome<ClientState> manageCgi(const HTTPRequest &request,
+								   const CGIHead &head, std::string_view body);
+	Outcome<ClientState> manageFastCgi(const HTTPRequest &request,
+									   const std::string &output);
+	std::shared_ptr<const CachedCgi>
+	findCachedCgi(const HTTPRequest &request, const LocationSettings &loc);
+	Outcome<ClientState> manageCachedCgi(const HTTPRequest &request,
+										 const LocationSettings &loc,
+										 const CachedCgi &cached);
+	const std::string &getCgiCacheKey(void) const;
+	void skipCgiCache(void);
+	Outcome<ClientState> startCgiStream(const HTTPRequest &request,
+										const CGIHead &head);
+	ClientState streamCgi(std::string &output, bool complete);
+	Outcome<ClientState> finishJob(void);
+	Outcome<ClientState> manageListing(void);
+	Outcome<ClientState> managePost(const HTTPRequest &request);
+	Outcome<ClientState> openUpload(const HTTPRequest &request);
+	Outcome<ClientState> receiveUpload(void);
+	Outcome<ClientState> manageDelete(const std::string &reqest_target_path);
 
 	// CGI APPEND FUNCTION
 
 	const std::string &getResponse(void) const;
 	void addToResponse(const std::string str);
 	void setResponse(const std::string str);
+	void setStatusResponse(StatusCode status_code);
 
 	void setServerSetting(const ServerSettings &serversetting);
+	void setClientFD(int fd);
 };
 
 #endif
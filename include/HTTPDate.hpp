@@ -0,0 +1,20 @@
+#ifndef HTTPDATE_HPP
+#define HTTPDATE_HPP
+
+#include <ctime>
+#include <string>
+#include <string_view>
+
+// IMF-fixdate helpers. now() is formatted at most once per second: update()
+// runs once per event loop iteration and only reformats when the second
+// changed, so every response of that iteration shares the same buffer.
+namespace HTTPDate
+{
+void update(void);
+std::string_view now(void);
+std::string format(time_t time);
+bool parse(const std::string &date, time_t &time);
+
+} // namespace HTTPDate
+
+#endif // !HTTPDATE_HPP
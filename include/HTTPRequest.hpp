@@ -2,6 +2,7 @@
 #define HTTP_REQUEST_HPP
 
 #include <ClientState.hpp>
+#include <Outcome.hpp>
 #include <ServerSettings.hpp>
 
 #include <string>
@@ -23,6 +24,8 @@ enum class HTTPMethod
 	GET,
 	POST,
 	DELETE,
+	PUT,
+	PATCH,
 	UNKNOWN,
 };
 #endif
@@ -41,6 +44,7 @@ class HTTPRequest
 
 	void setRequestTarget(const std::string &request_target);
 	const std::string &getRequestTarget(void) const;
+	const std::string &getQuery(void) const;
 
 	void setMaxBodySize(std::string inp);
 	size_t getMaxBodySize(void) const;
@@ -50,10 +54,12 @@ class HTTPRequest
 
 	void setHeader(const std::string &key, const std::string &header);
 	const std::string &getHeader(const std::string &key) const;
+	bool hasHeader(const std::string &key) const;
+	const std::unordered_map<std::string, std::string> &getHeaders(void) const;
 
 	const std::string &getBody(void) const;
-	ClientState setRequestVariables(size_t pos);
-	ClientState receive(int fd);
+	Outcome<ClientState> setRequestVariables(size_t pos);
+	Outcome<ClientState> receive(int fd);
 
 	void setHeaderEnd(bool b);
 	bool getHeaderEnd() const;
@@ -71,6 +77,7 @@ class HTTPRequest
 	HTTPMethod _methodType;
 	std::string _http_request;
 	std::string _request_target;
+	std::string _query;
 	std::string _http_version;
 	std::string _body;
 	std::unordered_map<std::string, std::string> _headers;
@@ -4,13 +4,27 @@
 #include <ClientState.hpp>
 #include <HTTPRequest.hpp>
 #include <fstream>
+#include <memory>
 #include <string>
 
+// An immutable, fully serialized response apart from its Date header, which
+// is spliced in between the two parts when the response is sent.
+struct CannedResponse
+{
+	std::string status_line;
+	std::string tail;
+};
+
 class HTTPResponse
 {
   private:
 	size_t _bytes_sent;
 	std::string _response;
+	std::shared_ptr<const CannedResponse> _canned;
+	char _date[64];
+	size_t _date_length;
+
+	ClientState sendCanned(int client_fd);
 
   public:
 	HTTPResponse();
@@ -19,6 +33,9 @@ class HTTPResponse
 	~HTTPResponse();
 
 	ClientState send(int client_fd, const std::string &response);
+	ClientState stream(int client_fd);
+	bool pending(void) const;
+	void setCanned(std::shared_ptr<const CannedResponse> canned);
 	void append(const std::string &content);
 	void clear(void);
 };
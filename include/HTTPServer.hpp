@@ -6,9 +6,17 @@
 #include <Poll.hpp>
 #include <Server.hpp>
 
+#include <chrono>
+#include <map>
 #include <memory>
 #include <unordered_map>
 
+// Milliseconds without any event after which the clients are answered with
+// a 408, apart from those waiting on a CGI, which have its cgi_timeout.
+#ifndef IDLE_TIMEOUT
+#define IDLE_TIMEOUT 2500
+#endif
+
 class HTTPServer
 {
   public:
@@ -26,15 +34,22 @@ class HTTPServer
 	std::unordered_map<int, std::shared_ptr<Server>> _active_servers;
 	std::unordered_map<int, std::shared_ptr<Client>> _active_clients;
 	std::unordered_map<int, std::shared_ptr<int>> _active_pipes;
+	std::multimap<std::chrono::steady_clock::time_point, int> _cgi_deadlines;
 
 	void setupServers(void);
 	void handleActivePollFDs();
+	void handleCompletedJobs(void);
+	void handleCompletedCGI(void);
+	void handleExpiredCGI(void);
+	void handleResumedHandlers(void);
+	int pollTimeout(void) const;
+	void removeClient(int fd);
 	void handleNewConnection(int fd, std::vector<ServerSettings> &ServerBlock);
 	void handleExistingConnection(
 		const pollfd &poll_fd, Poll &poll, Client &client,
 		std::unordered_map<int, std::shared_ptr<int>> &active_pipes);
 	Client &findClientByFd(int targetFd);
-	Client &getClientByPipeFd(int pipe_fd);
+	Client *getClientByPipeFd(int pipe_fd);
 	void handlePipeConnection(
 		const pollfd &poll_fd, Poll &poll, Client &client,
 		std::unordered_map<int, std::shared_ptr<int>> &active_pipes);
@@ -4,25 +4,112 @@
 #include <StatusCode.hpp>
 
 #include <string>
-#include <unordered_map>
+#include <string_view>
 
 class HTTPStatus
 {
   private:
+	struct Line
+	{
+		StatusCode code;
+		std::string_view reason;
+		std::string_view status_line;
+	};
+
+	// Status lines are fully serialized at compile time, so the hot path
+	// never formats a number or looks up a reason phrase at runtime.
+	static constexpr Line _lines[] = {
+		{StatusCode::OK, "OK", "HTTP/1.1 200 OK\r\n"},
+		{StatusCode::Created, "Created", "HTTP/1.1 201 Created\r\n"},
+		{StatusCode::Accepted, "Accepted", "HTTP/1.1 202 Accepted\r\n"},
+		{StatusCode::NoContent, "No Content", "HTTP/1.1 204 No Content\r\n"},
+		{StatusCode::MovedPermanently, "Moved Permanently",
+		 "HTTP/1.1 301 Moved Permanently\r\n"},
+		{StatusCode::Found, "Found", "HTTP/1.1 302 Found\r\n"},
+		{StatusCode::SeeOther, "See Other", "HTTP/1.1 303 See Other\r\n"},
+		{StatusCode::NotModified, "Not Modified",
+		 "HTTP/1.1 304 Not Modified\r\n"},
+		{StatusCode::TemporaryRedirect, "Temporary Redirect",
+		 "HTTP/1.1 307 Temporary Redirect\r\n"},
+		{StatusCode::PermanentRedirect, "Permanent Redirect",
+		 "HTTP/1.1 308 Permanent Redirect\r\n"},
+		{StatusCode::BadRequest, "Bad Request", "HTTP/1.1 400 Bad Request\r\n"},
+		{StatusCode::UnAuthorized, "Unauthorized",
+		 "HTTP/1.1 401 Unauthorized\r\n"},
+		{StatusCode::Forbidden, "Forbidden", "HTTP/1.1 403 Forbidden\r\n"},
+		{StatusCode::NotFound, "Not Found", "HTTP/1.1 404 Not Found\r\n"},
+		{StatusCode::MethodNotAllowed, "Method Not Allowed",
+		 "HTTP/1.1 405 Method Not Allowed\r\n"},
+		{StatusCode::RequestTimeout, "Request Timeout",
+		 "HTTP/1.1 408 Request Timeout\r\n"},
+		{StatusCode::LenghtRequired, "Length Required",
+		 "HTTP/1.1 411 Length Required\r\n"},
+		{StatusCode::RequestBodyTooLarge, "Request Body Too Large",
+		 "HTTP/1.1 413 Request Body Too Large\r\n"},
+		{StatusCode::URIToLong, "URI Too Long",
+		 "HTTP/1.1 414 URI Too Long\r\n"},
+		{StatusCode::UnsupportedMediaType, "Unsupported Media Type",
+		 "HTTP/1.1 415 Unsupported Media Type\r\n"},
+		{StatusCode::RangeNotSatisfiable, "Range Not Satisfiable",
+		 "HTTP/1.1 416 Range Not Satisfiable\r\n"},
+		{StatusCode::InternalServerError, "Internal Server Error",
+		 "HTTP/1.1 500 Internal Server Error\r\n"},
+		{StatusCode::NotImplemented, "Not Implemented",
+		 "HTTP/1.1 501 Not Implemented\r\n"},
+		{StatusCode::BadGateway, "Bad Gateway", "HTTP/1.1 502 Bad Gateway\r\n"},
+		{StatusCode::ServiceUnavailable, "Service Unavailable",
+		 "HTTP/1.1 503 Service Unavailable\r\n"},
+		{StatusCode::GatewayTimeout, "Gateway Timeout",
+		 "HTTP/1.1 504 Gateway Timeout\r\n"},
+	};
+
+	static constexpr const Line &findLine(StatusCode status_code)
+	{
+		for (const Line &line : _lines)
+		{
+			if (line.code == status_code)
+				return (line);
+		}
+		// the static_assert below keeps the 500 line in _lines
+		return (findLine(StatusCode::InternalServerError));
+	}
+
 	StatusCode _status_code;
-	static std::unordered_map<StatusCode, std::string> _message;
 
   public:
 	HTTPStatus() = delete;
 	HTTPStatus(StatusCode status_code);
-	HTTPStatus(const HTTPStatus &other) = delete;
-	HTTPStatus &operator=(const HTTPStatus &other) = delete;
+	HTTPStatus(const HTTPStatus &other) = default;
+	HTTPStatus &operator=(const HTTPStatus &other) = default;
 	~HTTPStatus();
 
+	static constexpr std::string_view statusLine(StatusCode status_code)
+	{
+		return (findLine(status_code).status_line);
+	}
+	static constexpr std::string_view reasonPhrase(StatusCode status_code)
+	{
+		return (findLine(status_code).reason);
+	}
+	static constexpr bool isKnown(StatusCode status_code)
+	{
+		for (const Line &line : _lines)
+		{
+			if (line.code == status_code)
+				return (true);
+		}
+		return (false);
+	}
+
 	std::string getStatusLine(const std::string &version) const;
 	std::string getStatusLineCRLF(const std::string &version) const;
 	std::string getHTMLStatus(void) const;
 	StatusCode getStatusCode() const;
 };
 
+// Unknown codes fall back to 500 Internal Server Error.
+static_assert(HTTPStatus::isKnown(StatusCode::InternalServerError));
+static_assert(HTTPStatus::statusLine(static_cast<StatusCode>(599)) ==
+			  "HTTP/1.1 500 Internal Server Error\r\n");
+
 #endif
@@ -0,0 +1,93 @@
+#ifndef HANDLERS_HPP
+#define HANDLERS_HPP
+
+#include <CGIHead.hpp>
+#include <ClientState.hpp>
+#include <Outcome.hpp>
+#include <Poll.hpp>
+#include <webserv_handler.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class HTTPRequest;
+
+// A module of a handler location. It stays loaded for as long as the server
+// runs.
+struct HandlerModule
+{
+	std::string path;
+	void *library;
+	void *module;
+	ws_handler_handle_fn handle;
+	ws_handler_abort_fn abort;
+};
+
+// What the module answered so far, behind the opaque ws_response of the C
+// ABI. The head is sent like a CGI script's.
+struct ws_response
+{
+	CGIHead head;
+	std::string body;
+	bool failed;
+	int wait_fd;
+	short wait_events;
+};
+
+// A request handed to a module: the view of it the module gets and the
+// state it keeps between calls, which the module is told to let go of if
+// the request ends before the module did.
+class HandlerCall
+{
+  public:
+	HandlerCall(const HandlerModule &module, const HTTPRequest &request);
+	HandlerCall() = delete;
+	HandlerCall(const HandlerCall &other) = delete;
+	HandlerCall &operator=(const HandlerCall &rhs) = delete;
+	~HandlerCall();
+
+	Outcome<ClientState> run(Poll &poll, int client_fd);
+	const ws_response &getResponse(void) const;
+
+  private:
+	const HandlerModule &_module;
+	std::string _method;
+	std::vector<ws_header> _headers;
+	ws_request _request;
+	ws_response _response;
+	void *_state;
+	bool _pending;
+};
+
+// Loads the modules of handler locations as the server starts, and polls
+// the fds their requests wait on: once one is ready its client is returned
+// by collectResumed(). The fd of a client that went away leaves the poll
+// set right away but is only forgotten after collectResumed(), so the
+// events it already had this round are still recognized. Only touched from
+// the event loop.
+class Handlers
+{
+  public:
+	Handlers();
+	Handlers(const Handlers &other) = delete;
+	Handlers &operator=(const Handlers &rhs) = delete;
+	~Handlers();
+
+	static Handlers &getInstance();
+
+	void load(const std::string &path);
+	const HandlerModule *find(const std::string &path) const;
+	bool watch(Poll &poll, int fd, short events, int client_fd);
+	void forget(Poll &poll, int client_fd);
+	bool owns(int fd) const;
+	void handleEvents(Poll &poll, int fd);
+	std::vector<int> collectResumed(void);
+
+  private:
+	std::unordered_map<std::string, HandlerModule> _modules;
+	std::unordered_map<int, int> _waits;
+	std::vector<int> _resumed;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef HEADERWRITER_HPP
+#define HEADERWRITER_HPP
+
+#include <StatusCode.hpp>
+
+#include <cstddef>
+#include <string_view>
+
+#ifndef HEADER_CAPACITY
+#define HEADER_CAPACITY 2048
+#endif
+
+#ifndef SERVER_SOFTWARE
+#define SERVER_SOFTWARE "BazingaServ"
+#endif
+
+// Serializes a response head into a fixed buffer on the stack. Constructed
+// with a status code it starts with the status line, Date and Server headers;
+// the default constructor continues a head that was started elsewhere.
+// Headers that don't fit are dropped and reported through overflowed().
+class HeaderWriter
+{
+  public:
+	HeaderWriter();
+	HeaderWriter(StatusCode status_code);
+	HeaderWriter(const HeaderWriter &other) = delete;
+	HeaderWriter &operator=(const HeaderWriter &rhs) = delete;
+	~HeaderWriter();
+
+	void add(std::string_view name, std::string_view value);
+	void add(std::string_view name, size_t value);
+	std::string_view view(void) const;
+	std::string_view finish(void);
+	bool overflowed(void) const;
+
+  private:
+	char _buffer[HEADER_CAPACITY];
+	size_t _length;
+	bool _overflow;
+
+	void append(std::string_view str);
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef LISTINGCACHE_HPP
+#define LISTINGCACHE_HPP
+
+#include <sys/stat.h>
+
+#include <ctime>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#ifndef LISTING_CACHE_SIZE
+#define LISTING_CACHE_SIZE (4 * 1024 * 1024)
+#endif
+
+// Rendered autoindex pages, keyed by directory and request uri and evicted
+// least recently used first once the stored bytes exceed LISTING_CACHE_SIZE.
+// A listing is only reused while the directory mtime is unchanged. On Linux
+// every cached directory is watched with inotify, so changes to the entries
+// themselves drop the listing too; elsewhere a listing lives for at most one
+// second. Only touched from the event loop.
+class ListingCache
+{
+  public:
+	ListingCache();
+	ListingCache(const ListingCache &other) = delete;
+	ListingCache &operator=(const ListingCache &rhs) = delete;
+	~ListingCache();
+
+	static ListingCache &getInstance();
+
+	std::shared_ptr<const std::string> find(const std::string &dir,
+											const std::string &uri,
+											const struct stat &dir_stat);
+	void store(const std::string &dir, const std::string &uri,
+			   const struct stat &dir_stat,
+			   std::shared_ptr<const std::string> listing);
+	int getNotifyFD(void) const;
+	void handleEvents(void);
+
+  private:
+	struct Listing
+	{
+		std::string key;
+		std::string dir;
+		time_t mtime;
+		time_t created;
+		std::shared_ptr<const std::string> body;
+	};
+
+	std::list<Listing> _entries;
+	std::unordered_map<std::string, std::list<Listing>::iterator> _index;
+	size_t _size;
+	int _notify_fd;
+	std::unordered_map<int, std::string> _watches;
+	std::unordered_map<std::string, int> _watched_dirs;
+
+	void erase(std::list<Listing>::iterator it);
+	void invalidate(const std::string &dir);
+	void clear(void);
+	bool watch(const std::string &dir);
+	void unwatch(const std::string &dir);
+};
+
+#endif
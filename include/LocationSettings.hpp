@@ -3,8 +3,50 @@
 
 #include <Token.hpp>
 
+#include <memory>
 #include <string>
 
+#ifndef GZIP_DEFAULT_COMP_LEVEL
+#define GZIP_DEFAULT_COMP_LEVEL 6
+#endif
+
+#ifndef GZIP_DEFAULT_MIN_LENGTH
+#define GZIP_DEFAULT_MIN_LENGTH 256
+#endif
+
+// Upper bound for the worker count of a cgi_pool location.
+#ifndef CGI_POOL_MAX_WORKERS
+#define CGI_POOL_MAX_WORKERS 64
+#endif
+
+// Requests a pooled worker serves before it is replaced.
+#ifndef CGI_POOL_DEFAULT_MAX_REQUESTS
+#define CGI_POOL_DEFAULT_MAX_REQUESTS 1000
+#endif
+
+// Seconds a pooled worker runs before it is replaced.
+#ifndef CGI_POOL_DEFAULT_MAX_AGE
+#define CGI_POOL_DEFAULT_MAX_AGE 3600
+#endif
+
+// Seconds a CGI script or FastCGI request may take before it's given up
+// with a 504.
+#ifndef CGI_DEFAULT_TIMEOUT
+#define CGI_DEFAULT_TIMEOUT 60
+#endif
+
+// Limits on a location's CGI scripts, 0 where there is none. The rlimits
+// (cpu seconds, address space and open files) only apply to scripts started
+// per request; a cgi_pool worker outlives the request.
+struct CGILimits
+{
+	size_t timeout;
+	size_t max_output;
+	size_t cpu;
+	size_t address_space;
+	size_t open_files;
+};
+
 // ENUM
 #ifndef HTTP_METHOD_ENUM
 #define HTTP_METHOD_ENUM
@@ -13,10 +55,14 @@ enum class HTTPMethod
 	GET,
 	POST,
 	DELETE,
+	PUT,
+	PATCH,
 	UNKNOWN,
 };
 #endif
 
+struct CannedResponse;
+
 class LocationSettings
 {
   public:
@@ -34,13 +80,28 @@ class LocationSettings
 	const std::string &getIndex() const;
 	const std::string &getAllowedMethods() const;
 	const std::string &getRedirect() const;
+	const std::shared_ptr<const CannedResponse> &getReturn() const;
 	const bool &getCGI() const;
+	const std::string &getFastCGIPass() const;
+	size_t getCGIPool() const;
+	size_t getCGIPoolMaxRequests() const;
+	size_t getCGIPoolMaxAge() const;
+	const CGILimits &getCGILimits() const;
+	size_t getCGICache() const;
+	size_t getCGICacheStale() const;
+	const std::string &getHandler() const;
 	const bool &getAutoIndex() const;
+	const bool &getGzipStatic() const;
+	const bool &getGzip() const;
+	int getGzipCompLevel() const;
+	size_t getGzipMinLength() const;
+	const std::string &getGzipTypes() const;
 
 	//		resolves:
 
 	const std::string resolveAlias(const std::string request_target) const;
 	bool resolveMethod(const HTTPMethod method) const;
+	bool resolveGzipType(const std::string &mime_type) const;
 
 	// Printing:
 	void printLocationSettings() const;
@@ -52,14 +113,41 @@ class LocationSettings
 	std::string _index;
 	std::string _allowed_methods;
 	bool _cgi;
+	std::string _fastcgi_pass;
+	size_t _cgi_pool;
+	size_t _cgi_pool_max_requests;
+	size_t _cgi_pool_max_age;
+	CGILimits _cgi_limits;
+	size_t _cgi_cache;
+	size_t _cgi_cache_stale;
+	std::string _handler;
+	int _return_code;
 	std::string _redirect;
+	std::shared_ptr<const CannedResponse> _return;
 	bool _auto_index;
+	bool _gzip_static;
+	bool _gzip;
+	int _gzip_comp_level;
+	size_t _gzip_min_length;
+	std::string _gzip_types;
 
 	void parseAlias(const Token token);
 	void parseIndex(const Token token);
 	void parseAutoIndex(const Token token);
 	void parseAllowedMethods(const Token token);
 	void parseCgiPath(const Token token);
+	void parseFastCGIPass(const Token token);
+	void parseCGIPool(const Token token);
+	void parseCGIPoolRecycle(const std::string &key, const Token token);
+	void parseCGILimit(const std::string &key, const Token token);
+	void parseCGICache(const std::string &key, const Token token);
+	void parseHandler(const Token token);
 	void parseReturn(const Token token);
+	void compileReturn(void);
+	void parseGzipStatic(const Token token);
+	void parseGzip(const Token token);
+	void parseGzipCompLevel(const Token token);
+	void parseGzipMinLength(const Token token);
+	void parseGzipTypes(const Token token);
 };
 #endif // !LOCATIONSETTING_HPP
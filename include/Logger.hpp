@@ -78,7 +78,9 @@ class Logger
 		i = 0;
 		for (char c : fmt)
 		{
-			if (c == '%')
+			// Messages are often concatenated from request data; a '%'
+			// without a matching argument is copied verbatim.
+			if (c == '%' && i < arr.size())
 			{
 				os << arr[i++];
 			}
@@ -0,0 +1,169 @@
+#ifndef MIMETYPES_HPP
+#define MIMETYPES_HPP
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// Extension to Content-Type lookup. The table is laid out at compile time:
+// findSeed() searches for a hash seed under which every known extension lands
+// in its own slot, so a lookup is one hash, one slot and one compare.
+namespace MimeTypes
+{
+struct Entry
+{
+	std::string_view extension;
+	std::string_view type;
+};
+
+inline constexpr std::string_view DEFAULT_TYPE = "application/octet-stream";
+
+inline constexpr Entry entries[] = {
+	{"html", "text/html"},
+	{"htm", "text/html"},
+	{"css", "text/css"},
+	{"js", "text/javascript"},
+	{"mjs", "text/javascript"},
+	{"json", "application/json"},
+	{"xml", "application/xml"},
+	{"txt", "text/plain"},
+	{"csv", "text/csv"},
+	{"md", "text/markdown"},
+	{"py", "text/x-python"},
+	{"c", "text/x-c"},
+	{"cpp", "text/x-c"},
+	{"hpp", "text/x-c"},
+	{"h", "text/x-c"},
+	{"sh", "application/x-sh"},
+	{"svg", "image/svg+xml"},
+	{"ico", "image/x-icon"},
+	{"png", "image/png"},
+	{"jpg", "image/jpeg"},
+	{"jpeg", "image/jpeg"},
+	{"gif", "image/gif"},
+	{"webp", "image/webp"},
+	{"avif", "image/avif"},
+	{"bmp", "image/bmp"},
+	{"woff", "font/woff"},
+	{"woff2", "font/woff2"},
+	{"ttf", "font/ttf"},
+	{"otf", "font/otf"},
+	{"mp3", "audio/mpeg"},
+	{"ogg", "audio/ogg"},
+	{"wav", "audio/wav"},
+	{"mp4", "video/mp4"},
+	{"webm", "video/webm"},
+	{"pdf", "application/pdf"},
+	{"zip", "application/zip"},
+	{"gz", "application/gzip"},
+	{"tar", "application/x-tar"},
+	{"wasm", "application/wasm"},
+	{"file", "text/plain"},
+};
+
+inline constexpr size_t ENTRY_COUNT = sizeof(entries) / sizeof(entries[0]);
+inline constexpr size_t TABLE_SIZE = 256;
+inline constexpr size_t MAX_EXTENSION = 8;
+
+constexpr char toLower(char c)
+{
+	return ((c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c);
+}
+
+// FNV-1a over the lowercased extension, seeded.
+constexpr uint32_t hash(std::string_view extension, uint32_t seed)
+{
+	uint32_t h = 2166136261u ^ seed;
+
+	for (char c : extension)
+	{
+		h ^= static_cast<unsigned char>(toLower(c));
+		h *= 16777619u;
+	}
+	return (h % TABLE_SIZE);
+}
+
+constexpr bool isPerfect(uint32_t seed)
+{
+	bool used[TABLE_SIZE] = {};
+
+	for (const Entry &entry : entries)
+	{
+		const uint32_t slot = hash(entry.extension, seed);
+
+		if (used[slot])
+			return (false);
+		used[slot] = true;
+	}
+	return (true);
+}
+
+constexpr uint32_t findSeed(void)
+{
+	uint32_t seed = 0;
+
+	while (!isPerfect(seed))
+		seed++;
+	return (seed);
+}
+
+inline constexpr uint32_t SEED = findSeed();
+
+// Slot -> index into entries + 1, 0 marks an empty slot.
+constexpr std::array<unsigned char, TABLE_SIZE> buildTable(void)
+{
+	std::array<unsigned char, TABLE_SIZE> table = {};
+
+	for (size_t i = 0; i < ENTRY_COUNT; i++)
+		table[hash(entries[i].extension, SEED)] =
+			static_cast<unsigned char>(i + 1);
+	return (table);
+}
+
+inline constexpr std::array<unsigned char, TABLE_SIZE> table = buildTable();
+
+static_assert(ENTRY_COUNT < 255, "MimeTypes: too many entries");
+
+constexpr bool equalsIgnoreCase(std::string_view lhs, std::string_view rhs)
+{
+	if (lhs.size() != rhs.size())
+		return (false);
+	for (size_t i = 0; i < lhs.size(); i++)
+	{
+		if (toLower(lhs[i]) != toLower(rhs[i]))
+			return (false);
+	}
+	return (true);
+}
+
+constexpr std::string_view fromExtension(std::string_view extension)
+{
+	if (extension.empty() || extension.size() > MAX_EXTENSION)
+		return (DEFAULT_TYPE);
+
+	const unsigned char index = table[hash(extension, SEED)];
+
+	if (index == 0 ||
+		!equalsIgnoreCase(entries[index - 1].extension, extension))
+		return (DEFAULT_TYPE);
+	return (entries[index - 1].type);
+}
+
+constexpr std::string_view fromPath(std::string_view path)
+{
+	const size_t dot = path.find_last_of('.');
+	const size_t slash = path.find_last_of('/');
+
+	if (dot == std::string_view::npos ||
+		(slash != std::string_view::npos && dot < slash))
+		return (DEFAULT_TYPE);
+	return (fromExtension(path.substr(dot + 1)));
+}
+
+static_assert(fromPath("/images/coffee.JPEG") == "image/jpeg");
+static_assert(fromPath("/www/index.html") == "text/html");
+static_assert(fromPath("/dir.d/README") == DEFAULT_TYPE);
+
+} // namespace MimeTypes
+
+#endif // !MIMETYPES_HPP
@@ -0,0 +1,66 @@
+#ifndef MISSCACHE_HPP
+#define MISSCACHE_HPP
+
+#include <ctime>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#ifndef MISS_CACHE_ENTRIES
+#define MISS_CACHE_ENTRIES 4096
+#endif
+
+#ifndef MISS_CACHE_TTL
+#define MISS_CACHE_TTL 2
+#endif
+
+// Resolved paths a GET found missing, so repeated misses are answered with
+// the canned 404 without another stat() on the WorkerPool. Entries live for
+// MISS_CACHE_TTL seconds and the oldest are evicted past MISS_CACHE_ENTRIES.
+// On Linux the closest existing ancestor of every path is watched with
+// inotify and anything created below it drops its entries at once; a path
+// that can't be watched there isn't cached. Only touched from the event loop.
+class MissCache
+{
+  public:
+	MissCache();
+	MissCache(const MissCache &other) = delete;
+	MissCache &operator=(const MissCache &rhs) = delete;
+	~MissCache();
+
+	static MissCache &getInstance();
+
+	bool contains(const std::string &path);
+	void store(const std::string &path);
+	void forget(const std::string &path);
+	int getNotifyFD(void) const;
+	void handleEvents(void);
+
+  private:
+	struct Miss
+	{
+		std::string path;
+		std::string dir;
+		time_t expires;
+	};
+
+	struct Watch
+	{
+		int wd;
+		size_t entries;
+	};
+
+	std::list<Miss> _entries;
+	std::unordered_map<std::string, std::list<Miss>::iterator> _index;
+	int _notify_fd;
+	std::unordered_map<int, std::string> _watches;
+	std::unordered_map<std::string, Watch> _watched_dirs;
+
+	void erase(std::list<Miss>::iterator it);
+	void invalidate(const std::string &dir);
+	void clear(void);
+	bool watch(const std::string &path, std::string &dir);
+	void unwatch(const std::string &dir);
+};
+
+#endif
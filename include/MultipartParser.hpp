@@ -0,0 +1,65 @@
+#ifndef MULTIPARTPARSER_HPP
+#define MULTIPARTPARSER_HPP
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// Largest header block a single part may carry.
+#ifndef MULTIPART_HEADER_MAX
+#define MULTIPART_HEADER_MAX 8192
+#endif
+
+// Incremental multipart/form-data (RFC 7578) parser. The body is fed in
+// chunks as it arrives; between calls only a possible partial boundary or an
+// unfinished part header is kept, so memory doesn't grow with the body.
+// Boundaries are located with Boyer-Moore-Horspool. feed() returns false
+// once the body turned out malformed.
+class MultipartParser
+{
+  public:
+	struct Part
+	{
+		std::string name;
+		std::string filename;
+		std::string content_type;
+	};
+
+	using PartHandler = std::function<void(const Part &)>;
+	using DataHandler = std::function<void(const char *, size_t)>;
+
+	MultipartParser(const std::string &boundary, PartHandler on_part,
+					DataHandler on_data);
+	MultipartParser() = delete;
+	MultipartParser(const MultipartParser &other) = delete;
+	MultipartParser &operator=(const MultipartParser &rhs) = delete;
+	~MultipartParser();
+
+	bool feed(const char *data, size_t size);
+	bool isDone(void) const;
+
+	static std::string boundaryOf(const std::string &content_type);
+
+  private:
+	enum class State
+	{
+		Preamble,
+		Delimiter,
+		Headers,
+		Body,
+		Epilogue,
+	};
+
+	std::string _delimiter;
+	std::array<size_t, 256> _skip;
+	std::string _buffer;
+	State _state;
+	PartHandler _on_part;
+	DataHandler _on_data;
+
+	size_t search(const char *data, size_t size) const;
+	bool parseHeaders(const std::string &block, Part &part) const;
+};
+
+#endif
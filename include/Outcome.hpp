@@ -0,0 +1,78 @@
+#ifndef OUTCOME_HPP
+#define OUTCOME_HPP
+
+#include <HTTPStatus.hpp>
+
+#include <utility>
+#include <variant>
+
+// The error half of an Outcome, converts to an Outcome of any value type so
+// a failure can be passed up unchanged: return (outcome.failure());
+template <typename E> struct Failure
+{
+	E error;
+};
+
+inline Failure<HTTPStatus> fail(StatusCode status_code)
+{
+	return (Failure<HTTPStatus>{HTTPStatus(status_code)});
+}
+
+// Result of a step of the request pipeline: a value, or the status the
+// request fails with. Failures are returned instead of thrown, so a 404 or
+// 405 costs about as much as a successful step and scales across threads.
+template <typename T, typename E = HTTPStatus> class Outcome
+{
+  private:
+	std::variant<T, E> _result;
+
+  public:
+	Outcome(const T &value) : _result(std::in_place_index<0>, value)
+	{
+	}
+	Outcome(T &&value) : _result(std::in_place_index<0>, std::move(value))
+	{
+	}
+	template <typename F>
+	Outcome(const Failure<F> &failure)
+		: _result(std::in_place_index<1>, failure.error)
+	{
+	}
+
+	bool ok(void) const
+	{
+		return (_result.index() == 0);
+	}
+	explicit operator bool(void) const
+	{
+		return (ok());
+	}
+
+	T &value(void)
+	{
+		return (std::get<0>(_result));
+	}
+	const T &value(void) const
+	{
+		return (std::get<0>(_result));
+	}
+	T &operator*(void)
+	{
+		return (value());
+	}
+	const T &operator*(void) const
+	{
+		return (value());
+	}
+
+	const E &error(void) const
+	{
+		return (std::get<1>(_result));
+	}
+	Failure<E> failure(void) const
+	{
+		return (Failure<E>{error()});
+	}
+};
+
+#endif
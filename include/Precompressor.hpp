@@ -0,0 +1,14 @@
+#ifndef PRECOMPRESSOR_HPP
+#define PRECOMPRESSOR_HPP
+
+#include <string>
+
+namespace Precompressor
+{
+bool isCompressible(const std::string &path);
+bool compressFile(const std::string &path, const std::string &sidecar);
+void precompressTree(const std::string &root);
+
+} // namespace Precompressor
+
+#endif // !PRECOMPRESSOR_HPP
@@ -0,0 +1,17 @@
+#ifndef REQUESTTARGET_HPP
+#define REQUESTTARGET_HPP
+
+#include <string>
+
+// Canonical form of an origin-form request target, computed once per request
+// so resolveLocation, the filesystem and every cache see the same path:
+// the query is split off as it was sent, %XX escapes in the path are decoded
+// and ".", ".." and repeated slashes are collapsed. A target that is already
+// canonical is recognised 16 bytes at a time and left untouched.
+namespace RequestTarget
+{
+bool canonicalize(std::string &target, std::string &query);
+
+} // namespace RequestTarget
+
+#endif // !REQUESTTARGET_HPP
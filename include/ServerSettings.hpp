@@ -2,6 +2,7 @@
 #define SERVERSETTING_HPP
 
 #include <LocationSettings.hpp>
+#include <Outcome.hpp>
 #include <Token.hpp>
 
 #include <string>
@@ -16,7 +17,7 @@ class ServerSettings
 	ServerSettings &operator=(const ServerSettings &rhs);
 
 	// Functionality:
-	const LocationSettings &
+	Outcome<const LocationSettings *>
 	resolveLocation(const std::string &request_target) const;
 
 	const std::string &getListen() const;
@@ -24,6 +25,8 @@ class ServerSettings
 	const std::string &getRoot() const;
 	const std::string &getErrorDir() const;
 	const std::string &getClientMaxBodySize() const;
+	bool getPrecompress() const;
+	const std::vector<LocationSettings> &getLocationSettings() const;
 
 	// Printing:
 	void printServerSettings() const;
@@ -34,6 +37,7 @@ class ServerSettings
 	std::string _root;
 	std::string _error_dir;
 	std::string _client_max_body_size;
+	bool _precompress;
 	std::vector<LocationSettings> _location_settings;
 
 	const LocationSettings &getRootLocationBlock() const;
@@ -46,6 +50,7 @@ class ServerSettings
 	void parseRoot(const Token value);
 	void parseErrorDir(const Token value);
 	void parseClientMaxBodySize(const Token value);
+	void parsePrecompress(const Token value);
 
 	void validateBlock();
 };
@@ -9,7 +9,10 @@ enum class StatusCode
 	NoContent = 204,
 	MovedPermanently = 301,
 	Found = 302,
+	SeeOther = 303,
 	NotModified = 304,
+	TemporaryRedirect = 307,
+	PermanentRedirect = 308,
 	BadRequest = 400,
 	UnAuthorized = 401,
 	Forbidden = 403,
@@ -20,6 +23,7 @@ enum class StatusCode
 	RequestBodyTooLarge = 413,
 	URIToLong = 414,
 	UnsupportedMediaType = 415,
+	RangeNotSatisfiable = 416,
 	InternalServerError = 500,
 	NotImplemented = 501,
 	BadGateway = 502,
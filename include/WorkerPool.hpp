@@ -0,0 +1,46 @@
+#ifndef WORKERPOOL_HPP
+#define WORKERPOOL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef WORKER_THREADS
+#define WORKER_THREADS 4
+#endif
+
+// Runs CPU heavy and blocking filesystem jobs off the event loop. Every job is
+// tagged with the fd of the client it belongs to; once it finished that fd is
+// queued and the loop is woken through getNotifyFD(), which is polled like any
+// other fd.
+class WorkerPool
+{
+  public:
+	WorkerPool();
+	WorkerPool(const WorkerPool &other) = delete;
+	WorkerPool &operator=(const WorkerPool &rhs) = delete;
+	~WorkerPool();
+
+	static WorkerPool &getInstance();
+
+	void submit(int owner_fd, std::function<void()> job);
+	int getNotifyFD(void) const;
+	std::vector<int> collectCompleted(void);
+
+  private:
+	std::vector<std::thread> _threads;
+	std::queue<std::pair<int, std::function<void()>>> _jobs;
+	std::vector<int> _completed;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	bool _stopping;
+	int _notify_pipe[2];
+
+	void work(void);
+};
+
+#endif
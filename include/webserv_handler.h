@@ -0,0 +1,97 @@
+#ifndef WEBSERV_HANDLER_H
+#define WEBSERV_HANDLER_H
+
+/*
+** The C ABI of the modules a location loads with handler <path.so>. The
+** server calls the module from its event loop, in process: a handler must
+** never block. It gets a view of the request and hands back its response
+** through the functions of ws_api, the body in as many segments as it likes.
+** One that isn't done yet returns WS_AGAIN and is called again with the same
+** state, either once the fd it gave to wait() is ready or, without one, on
+** the next round of the loop. Like any client it is answered with a 408
+** once the whole server was idle for IDLE_TIMEOUT meanwhile.
+**
+** A module exports ws_handler_handle and optionally ws_handler_init and
+** ws_handler_abort. The strings are not nul-terminated.
+*/
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define WS_HANDLER_ABI 1
+
+typedef struct ws_str
+{
+	const char *data;
+	size_t length;
+} ws_str;
+
+typedef struct ws_header
+{
+	ws_str name;
+	ws_str value;
+} ws_header;
+
+/* Valid for as long as the request is being handled. */
+typedef struct ws_request
+{
+	ws_str method;
+	ws_str target;
+	ws_str query;
+	ws_str version;
+	const ws_header *headers;
+	size_t header_count;
+	ws_str body;
+} ws_request;
+
+typedef struct ws_response ws_response;
+
+typedef enum ws_result
+{
+	WS_DONE,
+	WS_AGAIN,
+	WS_ERROR,
+} ws_result;
+
+/*
+** status() defaults to 200 and header() to nothing, Content-Type to
+** text/html; Content-Length and Transfer-Encoding are the server's. write()
+** copies a segment of the body. wait() makes the server poll fd for events
+** (POLLIN or POLLOUT) before calling a handler that returned WS_AGAIN again;
+** the fd stays the module's.
+*/
+typedef struct ws_api
+{
+	unsigned abi;
+	void (*status)(ws_response *response, int status);
+	void (*header)(ws_response *response, ws_str name, ws_str value);
+	void (*write)(ws_response *response, ws_str segment);
+	void (*wait)(ws_response *response, int fd, short events);
+} ws_api;
+
+/*
+** Called once as the server starts. module is passed to the other entry
+** points. Anything but 0 stops the server.
+*/
+typedef int (*ws_handler_init_fn)(const ws_api *api, void **module);
+
+/*
+** Called for a request. state starts out NULL and is kept for the calls
+** that follow a WS_AGAIN. WS_ERROR answers with a 500.
+*/
+typedef ws_result (*ws_handler_handle_fn)(void *module,
+										  const ws_request *request,
+										  ws_response *response, void **state);
+
+/* Called instead of the next call when the client went away meanwhile. */
+typedef void (*ws_handler_abort_fn)(void *module, void *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -8,8 +8,9 @@ CC				:=c++
 RM				:=rm -rf
 
 #	Compiler flags
-CFLAGS			=-Wall -Wextra -Werror -Wpedantic -Wfatal-errors -std=c++17
+CFLAGS			=-Wall -Wextra -Werror -Wpedantic -Wfatal-errors -std=c++17 -pthread
 DFLAGS			:=-MMD -MP
+LDFLAGS			:=-lz -ldl
 
 #	Directories
 SRC_DIR		 	:=src
@@ -26,6 +27,12 @@ OBJS 			:=$(patsubst $(SRC_DIR)/%.cpp, $(BUILD_DIR)/%.o, $(SRCS))
 INCLUDE_FLAGS	:=$(addprefix -I, $(sort $(dir $(HEADERS))))
 DEPENDS 		:= $(patsubst %.o,%.d,$(OBJS))
 
+#	Handler modules, see include/webserv_handler.h
+HANDLER_CC		:=cc
+HANDLER_CFLAGS	:=-Wall -Wextra -Werror -Wpedantic -std=c99 -fPIC -shared
+HANDLER_DIR		:=handlers
+HANDLERS		:=$(patsubst %.c, %.so, $(wildcard $(HANDLER_DIR)/*.c))
+
 #	Coverage
 COVERAGE_GCDA		:=build/**/*.gcda
 COVERAGE_GCNO		:=build/**/*.gcno
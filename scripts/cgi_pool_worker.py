@@ -0,0 +1,95 @@
+# The worker of a cgi_pool location, started by CGIPool::spawn() with its
+# socket as fd 0. Reads FastCGI records there and answers them one request
+# at a time: the script's stdout becomes FCGI_STDOUT and END_REQUEST follows
+# once it returns. FCGI_GET_VALUES is answered whenever it comes, the server
+# uses it to tell a live worker from a hung one. Runs until EOF; the server
+# replaces it after cgi_pool_max_requests requests or cgi_pool_max_age
+# seconds.
+
+import io, os, socket, struct, sys, traceback
+
+# A worker outlives requests, it must not keep client sockets or listeners
+# the server didn't mark close-on-exec open.
+os.closerange(3, os.sysconf("SC_OPEN_MAX"))
+sock = socket.socket(fileno=0)
+stream = sock.makefile("rb")
+scripts = {}
+
+
+def record(kind, rid, content=b""):
+    pad = -len(content) % 8
+    head = struct.pack(">BBHHBx", 1, kind, rid, len(content), pad)
+    return head + content + b"\0" * pad
+
+
+def pairs(data):
+    out, i = {}, 0
+    while i < len(data):
+        sizes = []
+        for _ in range(2):
+            if data[i] < 128:
+                sizes.append(data[i])
+                i += 1
+            else:
+                sizes.append(struct.unpack(">I", data[i:i + 4])[0] & ~(1 << 31))
+                i += 4
+        name = data[i:i + sizes[0]].decode()
+        i += sizes[0]
+        out[name] = data[i:i + sizes[1]].decode("latin-1")
+        i += sizes[1]
+    return out
+
+
+def load(path):
+    mtime = os.stat(path).st_mtime_ns
+    cached = scripts.get(path)
+    if cached is None or cached[0] != mtime:
+        with open(path, "rb") as f:
+            cached = (mtime, compile(f.read(), path, "exec"))
+        scripts[path] = cached
+    return cached[1]
+
+
+def run(params, body):
+    path = params.pop("SCRIPT_FILENAME")
+    out = io.BytesIO()
+    os.environ.clear()
+    os.environ.update(params)
+    sys.argv = [path, params.get("PATH_INFO", "")]
+    stdout = io.TextIOWrapper(out, write_through=True)
+    sys.stdin = io.TextIOWrapper(io.BytesIO(body))
+    sys.stdout = stdout
+    try:
+        exec(load(path), {"__name__": "__main__", "__file__": path})
+    except SystemExit:
+        pass
+    except BaseException:
+        traceback.print_exc()
+    finally:
+        sys.stdout = sys.__stdout__
+        stdout.flush()
+        stdout.detach()
+    return out.getvalue()
+
+
+params = body = b""
+while True:
+    head = stream.read(8)
+    if len(head) < 8:
+        break
+    _, kind, rid, size, pad = struct.unpack(">BBHHBx", head)
+    content = stream.read(size + pad)[:size]
+    if kind == 9:
+        answer = b"\x0f\x01FCGI_MPXS_CONNS0\x0d\x01FCGI_MAX_REQS1"
+        sock.sendall(record(10, 0, answer))
+    elif kind == 1:
+        params = body = b""
+    elif kind == 4:
+        params += content
+    elif kind == 5 and content:
+        body += content
+    elif kind == 5:
+        out = run(pairs(params), body)
+        reply = b"".join(record(6, rid, out[i:i + 65535])
+                         for i in range(0, len(out), 65535))
+        sock.sendall(reply + record(6, rid) + record(3, rid, bytes(8)))
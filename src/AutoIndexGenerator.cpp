@@ -2,91 +2,166 @@
 #include "AutoIndexGenerator.hpp"
 #include "Logger.hpp"
 
-#include <dirent.h>
-#include <sys/stat.h>
 #include <time.h>
 
-#include <filesystem>
-#include <fstream>
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
 #include <string>
 
-std::string excludeSpecialCharacters(std::string str)
+static void appendNumber(std::string &out, intmax_t value)
 {
-	std::string result;
+	char buf[24];
 
-	for (std::string::iterator it = str.begin(); it != str.end() - 1; ++it)
-	{
-		if (*it == '/')
-			result += "_";
-		else
-			result += *it;
-	}
-	return (result);
+	out.append(buf, std::to_chars(buf, buf + sizeof(buf), value).ptr - buf);
 }
 
-const std::string getStatSize(struct stat &filestat)
+static void appendLastModified(std::string &out, const struct stat &filestat)
 {
-	std::string str;
 	char buf[100];
-	time_t date = filestat.st_mtime;
-	struct tm *time = localtime(&date);
+	struct tm time;
 
-	strftime(buf, sizeof(buf), "%d %m %y", time);
-	str = std::string(buf);
+	localtime_r(&filestat.st_mtime, &time);
+	out.append(buf, strftime(buf, sizeof(buf), "%d %m %y", &time));
+}
+
+static void appendJSONString(std::string &out, const std::string &str)
+{
+	char buf[8];
 
-	return (str);
+	out += '"';
+	for (const char c : str)
+	{
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if (static_cast<unsigned char>(c) < 0x20)
+		{
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			out += buf;
+		}
+		else
+			out += c;
+	}
+	out += '"';
 }
 
-const std::string getStatDateLastModified(struct stat &filestat)
+// Names come from the clients that uploaded them, none of them may turn
+// into markup.
+static void appendHTMLString(std::string &out, const std::string &str)
 {
-	std::string str = std::to_string((intmax_t)filestat.st_size);
-	return (str);
+	for (const char c : str)
+	{
+		switch (c)
+		{
+		case '&':
+			out += "&amp;";
+			break;
+		case '<':
+			out += "&lt;";
+			break;
+		case '>':
+			out += "&gt;";
+			break;
+		case '"':
+			out += "&quot;";
+			break;
+		case '\'':
+			out += "&#39;";
+			break;
+		default:
+			out += c;
+		}
+	}
 }
 
-void getTableLines(std::string &response, const std::string dir)
+static const char *sortToString(AutoIndexGenerator::Sort sort)
 {
-	// clang-format off
-	DIR *dirptr = opendir(dir.c_str());
-	struct dirent *direnty;
+	switch (sort)
+	{
+	case AutoIndexGenerator::Sort::NAME:
+		return ("name");
+	case AutoIndexGenerator::Sort::MTIME:
+		return ("mtime");
+	case AutoIndexGenerator::Sort::SIZE:
+		return ("size");
+	default:
+		return ("");
+	}
+}
 
-	std::filesystem::path pwd = std::filesystem::current_path();
-	short statreturn;
-	std::string filepath;
-	struct stat filestat;
+AutoIndexGenerator::Options
+AutoIndexGenerator::parseQuery(const std::string &query)
+{
+	Options options = {Format::HTML, Sort::NONE, 0};
+	std::stringstream ss(query);
+	std::string parameter;
 
-	for (size_t i = 0 ; i < 2 ; i++)
-		direnty = readdir(dirptr);
-	while ((direnty = readdir(dirptr)) != NULL)
+	while (std::getline(ss, parameter, '&'))
 	{
-		filepath = pwd.string() + "/" + dir + direnty->d_name;
-		statreturn = stat(filepath.c_str(), &filestat);
-		response += "\t\t<tr>\n\
-			<th style =\"text-align:left\" >" + std::string(direnty->d_name) + "</th>\n\
-			<th style =\"text-align:left\" >" + ((statreturn != -1) ? getStatDateLastModified(filestat) : "UNKOWN") + "</th>\n\
-			<th style =\"text-align:left\" >" + ((statreturn != -1) ? getStatSize(filestat) : "UNKNOWN") + "</th>\n\
-		</tr>\n";
+		const std::string::size_type equals = parameter.find('=');
+		const std::string key = parameter.substr(0, equals);
+		const std::string value =
+			equals == std::string::npos ? "" : parameter.substr(equals + 1);
+
+		if (key == "page")
+			std::from_chars(value.data(), value.data() + value.size(),
+							options.page);
+		else if (key == "sort" && value == "name")
+			options.sort = Sort::NAME;
+		else if (key == "sort" && value == "mtime")
+			options.sort = Sort::MTIME;
+		else if (key == "sort" && value == "size")
+			options.sort = Sort::SIZE;
+		else if (key == "format" && value == "json")
+			options.format = Format::JSON;
 	}
-	// clang-format on 
+	if (options.sort != Sort::NONE && options.page == 0)
+		options.page = 1;
+	// so page * AUTOINDEX_PAGE_SIZE can't wrap around
+	options.page =
+		std::min<size_t>(options.page, SIZE_MAX / AUTOINDEX_PAGE_SIZE);
+	return (options);
 }
 
-std::string AutoIndexGenerator::AutoIndexGenerator(const std::string dir,
-												   const std::string uri)
+bool AutoIndexGenerator::isDefault(const Options &options)
 {
-	std::string response;
+	return (options.format == Format::HTML && options.sort == Sort::NONE &&
+			options.page == 0);
+}
 
+void AutoIndexGenerator::appendHead(std::string &out, const std::string &uri,
+									const Options &options)
+{
+	if (options.format == Format::JSON)
+	{
+		out += "{\"path\":";
+		appendJSONString(out, uri);
+		if (options.page != 0)
+		{
+			out += ",\"page\":";
+			appendNumber(out, options.page);
+		}
+		out += ",\"entries\":[";
+		return;
+	}
 	// clang-format off
-	response = "\
+	out += "\
 <!DOCTYPE html>\n\
 <html>\n\
 	<head>\n\
 	\t<title> Index of ";
-	response += uri;
-	response += "</title>\n\
+	appendHTMLString(out, uri);
+	out += "</title>\n\
 	</head>\n\
 	<body>\n\
 		<h1> Index of ";
-	response += uri;
-	response += "</h1>\n\
+	appendHTMLString(out, uri);
+	out += "</h1>\n\
 		<hr>\n\
 		<table style = \"width:80%;font-size:15px\">\n\
 		<tbody>\n\
@@ -96,36 +171,77 @@ std::string AutoIndexGenerator::AutoIndexGenerator(const std::string dir,
 		\t<th style = \"text-align:left\"> <u>Last Modification</u></th>\n\
 		<hr>\n\
 		</tr>\n";
-
-	getTableLines(response, dir);
-
-	response += "\
-		</tbody>\n\
-		</table>\n\
-	</body>\n";
 	// clang-format on
-	return (response);
 }
 
-std::fstream AutoIndexGenerator::OpenAutoIndex(std::string directory,
-											   const std::string uri)
+// filestat is null when the entry couldn't be stat'ed.
+void AutoIndexGenerator::appendEntry(std::string &out, const char *name,
+									 const struct stat *filestat,
+									 const Options &options, bool first)
 {
-	Logger &logger = Logger::getInstance();
-
-	logger.log(DEBUG, "OpenAutoIndex method is called:");
-	const std::string escapeddir = excludeSpecialCharacters(directory);
-
-	const std::string filename = "/tmp/" + escapeddir + ".autoindex";
-
-	std::fstream autoindex_fstream(filename.c_str(), std::fstream::out);
-	if (!autoindex_fstream.is_open())
-		logger.log(DEBUG, filename + " isn't opened.");
-
-	autoindex_fstream << AutoIndexGenerator(directory, uri);
-	autoindex_fstream.close();
-
-	std::fstream return_fstream(filename, std::ios::in);
-	std::remove(filename.c_str());
+	if (options.format == Format::JSON)
+	{
+		if (!first)
+			out += ',';
+		out += "{\"name\":";
+		appendJSONString(out, name);
+		if (filestat != nullptr)
+		{
+			out += ",\"size\":";
+			appendNumber(out, filestat->st_size);
+			out += ",\"mtime\":";
+			appendNumber(out, filestat->st_mtime);
+			out += S_ISDIR(filestat->st_mode) ? ",\"directory\":true"
+											  : ",\"directory\":false";
+		}
+		out += '}';
+		return;
+	}
+	// clang-format off
+	out += "\t\t<tr>\n\
+			<th style =\"text-align:left\" >";
+	appendHTMLString(out, name);
+	out += "</th>\n\
+			<th style =\"text-align:left\" >";
+	if (filestat != nullptr)
+		appendNumber(out, filestat->st_size);
+	else
+		out += "UNKNOWN";
+	out += "</th>\n\
+			<th style =\"text-align:left\" >";
+	if (filestat != nullptr)
+		appendLastModified(out, *filestat);
+	else
+		out += "UNKNOWN";
+	out += "</th>\n\
+		</tr>\n";
+	// clang-format on
+}
 
-	return (return_fstream);
+// more is set when a paged listing has entries past this page.
+void AutoIndexGenerator::appendTail(std::string &out, const Options &options,
+									bool more)
+{
+	if (options.format == Format::JSON)
+	{
+		out += more ? "],\"more\":true}\n" : "],\"more\":false}\n";
+		return;
+	}
+	// clang-format off
+	out += "\
+		</tbody>\n\
+		</table>\n";
+	// clang-format on
+	if (more)
+	{
+		out += "\t\t<a href=\"?page=";
+		appendNumber(out, options.page + 1);
+		if (options.sort != Sort::NONE)
+		{
+			out += "&amp;sort=";
+			out += sortToString(options.sort);
+		}
+		out += "\">Next page</a>\n";
+	}
+	out += "\t</body>\n";
 }
@@ -0,0 +1,191 @@
+#include "AutoIndexStream.hpp"
+#include "ListingCache.hpp"
+#include "Logger.hpp"
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+static bool sortsBefore(AutoIndexGenerator::Sort sort, const std::string &a,
+						const struct stat &a_stat, const std::string &b,
+						const struct stat &b_stat)
+{
+	if (sort == AutoIndexGenerator::Sort::MTIME &&
+		a_stat.st_mtime != b_stat.st_mtime)
+		return (a_stat.st_mtime > b_stat.st_mtime);
+	if (sort == AutoIndexGenerator::Sort::SIZE &&
+		a_stat.st_size != b_stat.st_size)
+		return (a_stat.st_size > b_stat.st_size);
+	return (a < b);
+}
+
+AutoIndexStream::AutoIndexStream(const std::string &dir,
+								 const std::string &uri,
+								 const struct stat &dir_stat,
+								 const AutoIndexGenerator::Options &options)
+	: _dir(NULL), _dir_path(dir), _uri(uri), _dir_stat(dir_stat),
+	  _options(options), _started(false), _skipped(0), _emitted(0), _sorted(),
+	  _sorted_pos(0), _more(false),
+	  _collect(AutoIndexGenerator::isDefault(options)), _collected()
+{
+}
+
+AutoIndexStream::~AutoIndexStream()
+{
+	if (_dir != NULL)
+		closedir(_dir);
+}
+
+void AutoIndexStream::open(void)
+{
+	_dir = opendir(_dir_path.c_str());
+}
+
+bool AutoIndexStream::isOpen(void) const
+{
+	return (_dir != NULL);
+}
+
+const char *AutoIndexStream::readName(void)
+{
+	struct dirent *direnty;
+
+	while ((direnty = readdir(_dir)) != NULL)
+	{
+		if (std::strcmp(direnty->d_name, ".") != 0 &&
+			std::strcmp(direnty->d_name, "..") != 0)
+			return (direnty->d_name);
+	}
+	return (NULL);
+}
+
+// Appends the next part of the listing to out. Returns false once the tail
+// was written.
+bool AutoIndexStream::next(std::string &out)
+{
+	const size_t start = out.size();
+	bool more;
+
+	if (!_started)
+	{
+		AutoIndexGenerator::appendHead(out, _uri, _options);
+		if (_options.sort != AutoIndexGenerator::Sort::NONE)
+			readSorted();
+		_started = true;
+	}
+	if (_options.sort == AutoIndexGenerator::Sort::NONE)
+		more = nextUnsorted(out);
+	else
+		more = nextSorted(out);
+	if (!more)
+		AutoIndexGenerator::appendTail(out, _options, _more);
+	collect(out, start);
+	return (more);
+}
+
+// Entries are stat'ed relative to the open directory, so no path is built
+// and the kernel doesn't walk the directory's path again for every entry.
+bool AutoIndexStream::nextUnsorted(std::string &out)
+{
+	const size_t first = (_options.page == 0)
+							 ? 0
+							 : (_options.page - 1) * AUTOINDEX_PAGE_SIZE;
+	const int dir_fd = dirfd(_dir);
+	struct stat filestat;
+	const char *name;
+
+	while (_skipped < first && readName() != NULL)
+		_skipped++;
+	for (size_t batch = 0; batch < AUTOINDEX_BATCH_SIZE; batch++)
+	{
+		if (_options.page != 0 && _emitted == AUTOINDEX_PAGE_SIZE)
+		{
+			_more = readName() != NULL;
+			return (false);
+		}
+		if ((name = readName()) == NULL)
+			return (false);
+		const bool found = fstatat(dir_fd, name, &filestat, 0) == 0;
+		AutoIndexGenerator::appendEntry(out, name, found ? &filestat : nullptr,
+										_options, _emitted == 0);
+		_emitted++;
+	}
+	return (true);
+}
+
+// Reads the whole directory keeping only the entries that can still land on
+// the requested page, as a max-heap with the entry that sorts last on top.
+void AutoIndexStream::readSorted(void)
+{
+	const size_t keep = _options.page * AUTOINDEX_PAGE_SIZE;
+	const int dir_fd = dirfd(_dir);
+	const AutoIndexGenerator::Sort sort = _options.sort;
+	auto before = [sort](const Entry &a, const Entry &b)
+	{ return (sortsBefore(sort, a.name, a.filestat, b.name, b.filestat)); };
+	const char *name;
+	Entry entry;
+
+	if (keep == 0)
+		return;
+	while ((name = readName()) != NULL)
+	{
+		entry.name = name;
+		entry.found = fstatat(dir_fd, name, &entry.filestat, 0) == 0;
+		if (!entry.found)
+			std::memset(&entry.filestat, 0, sizeof(entry.filestat));
+		if (_sorted.size() == keep)
+		{
+			_more = true;
+			if (!before(entry, _sorted.front()))
+				continue;
+			std::pop_heap(_sorted.begin(), _sorted.end(), before);
+			_sorted.back() = std::move(entry);
+		}
+		else
+			_sorted.push_back(std::move(entry));
+		std::push_heap(_sorted.begin(), _sorted.end(), before);
+	}
+	std::sort_heap(_sorted.begin(), _sorted.end(), before);
+	_sorted_pos = std::min(_sorted.size(), keep - AUTOINDEX_PAGE_SIZE);
+}
+
+bool AutoIndexStream::nextSorted(std::string &out)
+{
+	for (size_t batch = 0; batch < AUTOINDEX_BATCH_SIZE; batch++)
+	{
+		if (_sorted_pos == _sorted.size())
+			return (false);
+		const Entry &entry = _sorted[_sorted_pos++];
+		AutoIndexGenerator::appendEntry(out, entry.name.c_str(),
+										entry.found ? &entry.filestat : nullptr,
+										_options, _emitted == 0);
+		_emitted++;
+	}
+	return (true);
+}
+
+void AutoIndexStream::collect(const std::string &out, size_t start)
+{
+	if (!_collect)
+		return;
+	if (_collected.size() + out.size() - start > AUTOINDEX_COLLECT_LIMIT)
+	{
+		_collect = false;
+		std::string().swap(_collected);
+		return;
+	}
+	_collected.append(out, start, std::string::npos);
+}
+
+// Hands a complete plain listing to the ListingCache.
+void AutoIndexStream::storeCollected(void)
+{
+	if (!_collect)
+		return;
+	_collect = false;
+	ListingCache::getInstance().store(
+		_dir_path, _uri, _dir_stat,
+		std::make_shared<const std::string>(std::move(_collected)));
+}
@@ -1,27 +1,45 @@
 #include "CGI.hpp"
+#include "CGICache.hpp"
+#include "ChildReaper.hpp"
 #include "Client.hpp"
-#include "ClientException.hpp"
+#include "FastCGI.hpp"
+#include "HeaderWriter.hpp"
+#include "LocationSettings.hpp"
 #include "Logger.hpp"
 #include "Poll.hpp"
 #include "SystemException.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
 #include <fcntl.h>
 #include <filesystem>
+#include <signal.h>
+#include <spawn.h>
 #include <string>
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
-CGI::CGI() : _bodyBytesWritten(0)
+CGI::CGI()
+	: _bodyBytesWritten(0), _bodyFromSocket(false), _pooled(false),
+	  _output(Output::Head), _limits{CGI_DEFAULT_TIMEOUT, 0, 0, 0, 0},
+	  _outputSize(0), _deadline(), _flight(), _leadsFlight(false), _flightFd(-1)
 {
 	_pathInfo = "";
 	_subPathInfo = "";
 	_queryString = "";
 }
 
+// A flight this request leads ends with it, whatever the script still does.
 CGI::~CGI()
 {
+	if (followsFlight())
+		CGICache::getInstance().leave(*_flight, _flightFd);
+	endFlight(StatusCode::BadGateway);
 }
 
 const std::string &CGI::getExecutable(void) const
@@ -39,75 +57,291 @@ const pid_t &CGI::getPid(void) const
 	return (_pid);
 }
 
-size_t CGI::getBufferSize(size_t bodyLength)
+CGIHead &CGI::getHead(void)
 {
-	size_t bufferSize = 0;
+	return (_head);
+}
+
+CGI::Output CGI::getOutput(void) const
+{
+	return (_output);
+}
 
-	if (BUFFER_SIZE > bodyLength)
-		bufferSize = bodyLength;
-	else if (BUFFER_SIZE > (bodyLength - _bodyBytesWritten))
-		bufferSize = bodyLength - _bodyBytesWritten;
-	else
-		bufferSize = BUFFER_SIZE;
-	return (bufferSize);
+void CGI::setOutput(Output output)
+{
+	_output = output;
+}
+
+void CGI::setLimits(const CGILimits &limits)
+{
+	_limits = limits;
 }
 
-ClientState CGI::send(Client &client, std::string body, size_t bodyLength)
+// When start() was called plus the location's cgi_timeout.
+std::chrono::steady_clock::time_point CGI::getDeadline(void) const
+{
+	return (_deadline);
+}
+
+// Ends a script that ran out of time, along with whatever it started: it
+// leads its own process group. A FastCGI request is withdrawn instead.
+void CGI::stop(Poll &poll)
+{
+	endFlight(StatusCode::GatewayTimeout);
+	if (_fastcgi)
+	{
+		FastCGI::getInstance().abort(poll, _fastcgi);
+		_fastcgi.reset();
+		return;
+	}
+	killScript();
+}
+
+void CGI::killScript(void)
 {
 	Logger &logger = Logger::getInstance();
-	ssize_t bytesWritten = 0;
-
-	logger.log(INFO, "GCI::send is called");
-	logger.log(DEBUG, "body: " + body);
-
-	if (!client.cgiBodyIsSent)
-		bytesWritten = write(client.getServerToCgiFd()[WRITE_END], body.c_str(),
-							 getBufferSize(bodyLength));
-	if (bytesWritten == SYSTEM_ERROR)
-		throw ClientException(StatusCode::InternalServerError);
-	logger.log(DEBUG, "bytesWritten: %", bytesWritten);
-	_bodyBytesWritten += bytesWritten;
-	if (_bodyBytesWritten >= bodyLength)
+
+	if (!_child || _child->exited)
+		return;
+	logger.log(WARNING, "CGI: killing % (pid %)", _executable, _pid);
+	kill(-_pid, SIGKILL);
+}
+
+// Moves up to length bytes of the request body from the client's socket into
+// the script's stdin. On Linux splice() does it without the bytes passing
+// through the server; elsewhere they are peeked at and only taken off the
+// socket once the pipe took them, so nothing is left over to keep.
+static ssize_t forwardBody(int socket_fd, int pipe_fd, size_t length)
+{
+#ifdef __linux__
+	return (splice(socket_fd, NULL, pipe_fd, NULL, length,
+				   SPLICE_F_MOVE | SPLICE_F_NONBLOCK));
+#else
+	char buffer[CGI_READ_SIZE];
+	const ssize_t peeked = recv(socket_fd, buffer,
+								std::min(length, sizeof(buffer)), MSG_PEEK);
+
+	if (peeked <= 0)
+		return (peeked);
+
+	const ssize_t written = write(pipe_fd, buffer, peeked);
+
+	if (written == SYSTEM_ERROR)
+		return (written);
+	return (recv(socket_fd, buffer, written, 0));
+#endif
+}
+
+// Passes the request body on to the script's stdin: what came in with the
+// headers first, then the rest straight off the socket as it arrives. Only
+// one end is polled at a time. A move that would block means the other end
+// isn't ready, either no more of the body has come in or the script isn't
+// reading, so that end is waited on next and neither side is read ahead of
+// the other. The body is finished on the pipe's wakeup, for HTTPServer to
+// take it out of the poll set.
+Outcome<ClientState> CGI::send(Poll &poll, Client &client)
+{
+	const std::string &received = client.getRequest().getBody();
+	const size_t bodyLength = client.getRequest().getBodyLength();
+	const size_t buffered = std::min(received.size(), bodyLength);
+	const int pipe_fd = client.getServerToCgiFd()[WRITE_END];
+
+	if (_bodyBytesWritten < bodyLength)
+	{
+		const ssize_t written =
+			_bodyBytesWritten < buffered
+				? write(pipe_fd, received.data() + _bodyBytesWritten,
+						buffered - _bodyBytesWritten)
+				: forwardBody(client.getFD(), pipe_fd,
+							  bodyLength - _bodyBytesWritten);
+
+		if (written == 0)
+			return (fail(StatusCode::BadRequest));
+		if (written != SYSTEM_ERROR)
+			_bodyBytesWritten += written;
+		else if (errno == EPIPE)
+			// the script closed its stdin, the pipe's POLLERR ends the body
+			_bodyFromSocket = false;
+		else if (errno != EAGAIN)
+			return (fail(StatusCode::InternalServerError));
+		else if (_bodyBytesWritten >= buffered)
+			_bodyFromSocket = !_bodyFromSocket;
+	}
+	if (_bodyBytesWritten >= bodyLength && !_bodyFromSocket)
 	{
 		client.cgiBodyIsSent = true;
-		logger.log(DEBUG, "ServerToCgiFd()[WRITE_END] is now being closed");
-		close(client.getServerToCgiFd()[WRITE_END]);
+		close(pipe_fd);
 		return (ClientState::CGI_Read);
 	}
-	logger.log(INFO, "CGI body: " + std::to_string(bytesWritten));
+	if (_bodyBytesWritten >= bodyLength)
+		_bodyFromSocket = false;
+	poll.setEvents(pipe_fd, _bodyFromSocket ? 0 : POLLOUT);
+	poll.setEvents(client.getFD(), _bodyFromSocket ? POLLIN : 0);
 	return (ClientState::CGI_Write);
 }
 
-ClientState CGI::receive(Client &client)
+Outcome<ClientState> CGI::receive(Client &client)
 {
 	Logger &logger = Logger::getInstance();
-	ssize_t bytesRead = 0;
-	char buffer[1024];
-
-	bzero(buffer, sizeof(buffer));
-	logger.log(INFO, "CGI::receive is called");
-	int status;
-	waitpid(_pid, &status, 0);
-	if (status == SYSTEM_ERROR)
-		throw ClientException(StatusCode::InternalServerError);
-	bytesRead =
+	char buffer[CGI_READ_SIZE];
+	const ssize_t bytesRead =
 		read(client.getCgiToServerFd()[READ_END], buffer, sizeof(buffer));
+
 	if (bytesRead == SYSTEM_ERROR)
-		throw ClientException(StatusCode::InternalServerError);
-	logger.log(DEBUG, "Bytes read: " + std::to_string(bytesRead));
-	logger.log(DEBUG, "buffer:\n" + std::string(buffer));
-	body += buffer;
-	logger.log(DEBUG, "sizeof(buffer): %", sizeof(buffer));
-	if (bytesRead < (ssize_t)sizeof(buffer))
+		return (fail(StatusCode::InternalServerError));
+	logger.log(DEBUG, "Bytes read: %", bytesRead);
+	_outputSize += bytesRead;
+	if (_limits.max_output != 0 && _outputSize > _limits.max_output)
+	{
+		logger.log(ERROR, "CGI: % wrote more than cgi_max_output",
+				   _executable);
+		killScript();
+		endFlight(StatusCode::BadGateway);
+		if (_output == Output::Streamed)
+			return (ClientState::Done);
+		return (fail(StatusCode::BadGateway));
+	}
+	if (bytesRead == 0)
 	{
 		client.cgiHasBeenRead = true;
-		logger.log(DEBUG, "body in GCI::receive:\n" + body);
 		close(client.getCgiToServerFd()[READ_END]);
-		return (ClientState::Sending);
+		return (ClientState::CGI_Read);
 	}
+	body.append(buffer, bytesRead);
+	feedFlight(std::string_view(buffer, bytesRead));
 	return (ClientState::CGI_Read);
 }
 
+// Whether the script's response is complete: all its output read and the
+// process reaped, or the FastCGI backend done.
+Outcome<ClientState> CGI::complete(Client &client)
+{
+	Logger &logger = Logger::getInstance();
+
+	if (!_fastcgi_pass.empty())
+		return (receiveFastCGI());
+	if (!client.cgiHasBeenRead || !_child->exited)
+		return (ClientState::CGI_Read);
+	logger.log(DEBUG, "CGI: pid % exited with status %", _pid,
+			   _child->status);
+
+	const bool failed = _child->lost || WIFSIGNALED(_child->status);
+
+	endFlight(failed ? StatusCode::BadGateway : StatusCode::OK);
+	if (failed && !_child->lost)
+		logger.log(ERROR, "CGI: pid % killed by signal %", _pid,
+				   WTERMSIG(_child->status));
+	// too late for an error response once streaming, cut it short instead
+	if (failed && _output == Output::Streamed)
+		return (ClientState::Done);
+	if (failed)
+		return (fail(StatusCode::BadGateway));
+	return (ClientState::Sending);
+}
+
+// Takes the backend's answer once its request is done. Until then the client
+// waits in CGI_Read without polling its own socket.
+Outcome<ClientState> CGI::receiveFastCGI(void)
+{
+	if (!_fastcgi->done)
+		return (ClientState::CGI_Read);
+	if (_fastcgi->failed)
+	{
+		endFlight(StatusCode::BadGateway);
+		return (fail(StatusCode::BadGateway));
+	}
+	feedFlight(_fastcgi->output);
+	endFlight(StatusCode::OK);
+	body = std::move(_fastcgi->output);
+	_fastcgi.reset();
+	return (ClientState::Sending);
+}
+
+// Waits on the script another request runs for the same cgi_cache key, if
+// there is one, rather than running it again. Otherwise this request leads
+// the flight others wait on. true when it waits.
+bool CGI::joinFlight(const std::string &key, int client_fd)
+{
+	CGICache &cache = CGICache::getInstance();
+
+	_flight = cache.join(key, client_fd);
+	_flightFd = client_fd;
+	_leadsFlight = !_flight;
+	if (_leadsFlight)
+		_flight = cache.lead(key);
+	return (!_leadsFlight);
+}
+
+bool CGI::followsFlight(void) const
+{
+	return (_flight && !_leadsFlight);
+}
+
+// Takes what the script this request waits on wrote since it last looked.
+// Sending once the script completed. A response that turned out not to be
+// shared goes back to CGI_Start, to run the script for this request too.
+Outcome<ClientState> CGI::receiveFlight(void)
+{
+	CGICache &cache = CGICache::getInstance();
+
+	if (_flight->checked && !_flight->shared)
+	{
+		cache.leave(*_flight, _flightFd);
+		_flight.reset();
+		body.clear();
+		return (ClientState::CGI_Start);
+	}
+	cache.follow(*_flight, _flightFd, body);
+	if (!_flight->ended)
+		return (ClientState::CGI_Read);
+
+	const StatusCode status = _flight->status;
+
+	cache.leave(*_flight, _flightFd);
+	_flight.reset();
+	if (status != StatusCode::OK)
+		return (fail(status));
+	return (ClientState::Sending);
+}
+
+void CGI::feedFlight(std::string_view output)
+{
+	if (_flight && _leadsFlight &&
+		!CGICache::getInstance().feed(*_flight, output))
+		_flight.reset();
+}
+
+void CGI::endFlight(StatusCode status)
+{
+	if (!_flight || !_leadsFlight)
+		return;
+	CGICache::getInstance().finish(*_flight, status);
+	_flight.reset();
+}
+
+// Sends the script parseURIForCGI() found to a worker of pool rather than
+// forking it. The worker is given what spawn() would pass.
+Outcome<ClientState> CGI::usePool(const std::string &pool,
+								  const std::string &query)
+{
+	FastCGI::Params params;
+
+	params.emplace_back("SCRIPT_FILENAME",
+						std::filesystem::absolute(_executable).string());
+	params.emplace_back("QUERY_STRING", query);
+	if (!_subPathInfo.empty())
+		params.emplace_back("PATH_INFO", _subPathInfo);
+	_fastcgi_pass = pool;
+	_fastcgi_params = FastCGI::encodeParams(params);
+	_pooled = true;
+	return (ClientState::CGI_Start);
+}
+
+bool CGI::isFastCGI(void) const
+{
+	return (!_fastcgi_pass.empty() && !_pooled);
+}
+
 bool CGI::fileExists(const std::string &filePath)
 {
 	return (std::filesystem::exists(filePath) &&
@@ -123,58 +357,149 @@ bool CGI::isExecutable(const std::string &filePath)
 			   std::filesystem::perms::none;
 }
 
-void CGI::execute(std::string executable)
+// Closes what start() opened of the script's pipes after a failure. The fds
+// are forgotten too, their numbers may be reused by another client's pipes.
+void CGI::closePipes(Client &client)
 {
-	const char *env[] = {_pathInfo.c_str(), _queryString.c_str(), NULL};
-	std::string bin = "python3";
+	for (int *fds : {client.getServerToCgiFd(), client.getCgiToServerFd()})
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			if (fds[i] != -1)
+				close(fds[i]);
+			fds[i] = -1;
+		}
+	}
+}
 
-	std::string executableWithPath = executable;
-	const char *const argv[] = {bin.c_str(), executableWithPath.c_str(),
+// Starts the script on the pipes start() opened. posix_spawn is implemented
+// with clone(CLONE_VM | CLONE_VFORK) by glibc and vfork() elsewhere, so
+// unlike fork() it doesn't copy the server's page tables: its cost stays the
+// same however much memory the caches hold, and the server's pages aren't
+// made copy-on-write. The file actions do what the forked child used to.
+// The script leads a process group of its own for stop() to kill, and gets
+// back the SIGPIPE the server ignores. With rlimits it's started through sh,
+// see limitCommand().
+Outcome<ClientState> CGI::spawn(Client &client)
+{
+	Logger &logger = Logger::getInstance();
+	const char *const env[] = {_pathInfo.c_str(), _queryString.c_str(), NULL};
+	const std::string limited = limitCommand();
+	const char *const argv[] = {"python3", _executable.c_str(),
 								_subPathInfo.c_str(), NULL};
-	const char *path = "/usr/bin/python3";
-	if (execve(path, (char *const *)argv, (char *const *)env) == SYSTEM_ERROR)
-		throw ClientException(StatusCode::InternalServerError);
+	const char *const limited_argv[] = {
+		"sh", "-c", limited.c_str(), "/usr/bin/python3", _executable.c_str(),
+		_subPathInfo.c_str(), NULL};
+	const int *in = client.getServerToCgiFd();
+	const int *out = client.getCgiToServerFd();
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attributes;
+	sigset_t sigdefault;
+	int error = posix_spawn_file_actions_init(&actions);
+
+	if (error != 0)
+		return (fail(StatusCode::InternalServerError));
+	error = posix_spawnattr_init(&attributes);
+	if (error != 0)
+	{
+		posix_spawn_file_actions_destroy(&actions);
+		return (fail(StatusCode::InternalServerError));
+	}
+	sigemptyset(&sigdefault);
+	sigaddset(&sigdefault, SIGPIPE);
+	error = posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP |
+													  POSIX_SPAWN_SETSIGDEF);
+	if (error == 0)
+		error = posix_spawnattr_setpgroup(&attributes, 0);
+	if (error == 0)
+		error = posix_spawnattr_setsigdefault(&attributes, &sigdefault);
+	if (error == 0)
+		error = posix_spawn_file_actions_adddup2(&actions, in[READ_END],
+												 STDIN_FILENO);
+	if (error == 0)
+		error = posix_spawn_file_actions_adddup2(&actions, out[WRITE_END],
+												 STDOUT_FILENO);
+	for (const int fd : {in[READ_END], in[WRITE_END], out[READ_END],
+						 out[WRITE_END]})
+		if (error == 0)
+			error = posix_spawn_file_actions_addclose(&actions, fd);
+	if (error == 0)
+		error = posix_spawn(
+			&_pid, limited.empty() ? "/usr/bin/python3" : "/bin/sh", &actions,
+			&attributes,
+			(char *const *)(limited.empty() ? argv : limited_argv),
+			(char *const *)env);
+	posix_spawnattr_destroy(&attributes);
+	posix_spawn_file_actions_destroy(&actions);
+	if (error != 0)
+	{
+		logger.log(ERROR, "CGI: can't start %: %", _executable,
+				   std::strerror(error));
+		return (fail(StatusCode::InternalServerError));
+	}
+	return (ClientState::CGI_Start);
 }
 
-ClientState
+// The sh command that sets the location's rlimits and then execs the
+// interpreter, empty without any. posix_spawn can't call setrlimit() in the
+// child, so the limits are in place before the script's first instruction
+// only this way. If one can't be set the script never runs and the request
+// is answered with a 500 through the head the command prints instead.
+std::string CGI::limitCommand(void) const
+{
+	std::string command;
+
+	if (_limits.cpu != 0)
+		command += "ulimit -t " + std::to_string(_limits.cpu) + " && ";
+	if (_limits.address_space != 0)
+		command += "ulimit -v " +
+				   std::to_string((_limits.address_space + 1023) / 1024) +
+				   " && ";
+	if (_limits.open_files != 0)
+		command += "ulimit -n " + std::to_string(_limits.open_files) + " && ";
+	if (command.empty())
+		return (command);
+	return (command + "exec \"$0\" \"$@\"; "
+					  "printf 'Status: 500 Internal Server Error\\r\\n\\r\\n'");
+}
+
+Outcome<ClientState>
 CGI::start(Poll &poll, Client &client, size_t bodyLength,
 		   std::unordered_map<int, std::shared_ptr<int>> &active_pipes)
 {
-	(void)client;
 	Logger &logger = Logger::getInstance();
 
 	logger.log(DEBUG, "CGI::start called");
+	_deadline = std::chrono::steady_clock::now() +
+				std::chrono::seconds(_limits.timeout);
+	if (!_fastcgi_pass.empty())
+	{
+		_fastcgi = FastCGI::getInstance().submit(
+			poll, _fastcgi_pass, client.getFD(), std::move(_fastcgi_params),
+			client.getRequest().getBody(), _limits.max_output);
+		return (receiveFastCGI());
+	}
 	logger.log(DEBUG, "Executable: %", _executable);
 	if (pipe(client.getServerToCgiFd()) == SYSTEM_ERROR)
-		throw ClientException(StatusCode::InternalServerError);
+		return (fail(StatusCode::InternalServerError));
 	if (pipe(client.getCgiToServerFd()) == SYSTEM_ERROR)
-		throw ClientException(StatusCode::InternalServerError);
-	_pid = fork();
-	if (_pid == SYSTEM_ERROR)
-		throw ClientException(StatusCode::InternalServerError);
-	if (_pid == 0)
-	{
-		if (close(client.getServerToCgiFd()[WRITE_END]) == SYSTEM_ERROR)
-			throw ClientException(StatusCode::InternalServerError);
-		if (close(client.getCgiToServerFd()[READ_END]) == SYSTEM_ERROR)
-			throw ClientException(StatusCode::InternalServerError);
-		if (dup2(client.getServerToCgiFd()[READ_END], STDIN_FILENO) ==
-			SYSTEM_ERROR)
-			throw ClientException(StatusCode::InternalServerError);
-		if (close(client.getServerToCgiFd()[READ_END]) == SYSTEM_ERROR)
-			throw ClientException(StatusCode::InternalServerError);
-		if (dup2(client.getCgiToServerFd()[WRITE_END], STDOUT_FILENO) ==
-			SYSTEM_ERROR)
-			throw ClientException(StatusCode::InternalServerError);
-		if (close(client.getCgiToServerFd()[WRITE_END]) == SYSTEM_ERROR)
-			throw ClientException(StatusCode::InternalServerError);
-		execute(_executable);
-	}
-	logger.log(DEBUG, "CGI::start after else if (_pid == 0)");
+	{
+		closePipes(client);
+		return (fail(StatusCode::InternalServerError));
+	}
+
+	const Outcome<ClientState> spawned = spawn(client);
+
+	if (!spawned)
+	{
+		closePipes(client);
+		return (spawned);
+	}
+	_child = ChildReaper::getInstance().watch(poll, _pid, client.getFD());
 	if (close(client.getServerToCgiFd()[READ_END]) == SYSTEM_ERROR)
-		throw ClientException(StatusCode::InternalServerError);
+		return (fail(StatusCode::InternalServerError));
 	if (close(client.getCgiToServerFd()[WRITE_END]) == SYSTEM_ERROR)
-		throw ClientException(StatusCode::InternalServerError);
+		return (fail(StatusCode::InternalServerError));
 	logger.log(DEBUG, "CGI::start after closing");
 	logger.log(DEBUG, "bodyLength: %", bodyLength);
 	logger.log(DEBUG, "cgiBodyIsSent: %", client.cgiBodyIsSent);
@@ -185,19 +510,24 @@ CGI::start(Poll &poll, Client &client, size_t bodyLength,
 	logger.log(DEBUG, "CGI::start after closing WRITE_END and start reading");
 	if (bodyLength != 0 && !client.cgiBodyIsSent)
 	{
+		const int pipe_fd = client.getServerToCgiFd()[WRITE_END];
+
 		logger.log(DEBUG, "ClientState::CGI_Write is now being called");
-		std::shared_ptr<int> pipe =
-			std::make_shared<int>(client.getServerToCgiFd()[WRITE_END]);
-		active_pipes.emplace(client.getServerToCgiFd()[WRITE_END], pipe);
-		poll.addPollFD(client.getServerToCgiFd()[WRITE_END], POLLOUT);
+		if (fcntl(pipe_fd, F_SETFL, O_NONBLOCK) == SYSTEM_ERROR)
+			return (fail(StatusCode::InternalServerError));
+		active_pipes.emplace(pipe_fd, std::make_shared<int>(pipe_fd));
+		_bodyFromSocket = client.getRequest().getBody().empty();
+		poll.addPollFD(pipe_fd, _bodyFromSocket ? 0 : POLLOUT);
+		poll.setEvents(client.getFD(), _bodyFromSocket ? POLLIN : 0);
 		return (ClientState::CGI_Write);
 	}
 	if (close(client.getServerToCgiFd()[WRITE_END]) == SYSTEM_ERROR)
-		throw ClientException(StatusCode::InternalServerError);
+		return (fail(StatusCode::InternalServerError));
 	return (ClientState::CGI_Read);
 }
 
-ClientState CGI::parseURIForCGI(std::string requestTarget)
+Outcome<ClientState> CGI::parseURIForCGI(std::string requestTarget,
+										 const std::string &query)
 {
 	Logger &logger = Logger::getInstance();
 	logger.log(DEBUG, "parseURIForCGI is called");
@@ -219,24 +549,70 @@ ClientState CGI::parseURIForCGI(std::string requestTarget)
 	logger.log(DEBUG,
 			   "isExecutable:" + std::to_string(isExecutable(_executable)));
 	if (!fileExists(_executable) || !isExecutable(_executable))
-		throw ClientException(StatusCode::NotFound);
-	if (filenameExtensionPos + lengthFilenameExtension >=
-		std::strlen(requestTarget.c_str()) - 1)
-	{
-		return (ClientState::CGI_Start);
-	}
+		return (fail(StatusCode::NotFound));
+	_queryString = "QUERY_STRING=" + query;
 	std::string remaining = requestTarget.substr(
 		filenameExtensionPos + lengthFilenameExtension, std::string::npos);
-	size_t questionMarkPos = remaining.find('?');
-	if (remaining.at(0) == '/' && !skip)
+	if (!remaining.empty() && remaining.at(0) == '/' && !skip)
 	{
-		_subPathInfo = remaining.substr(0, questionMarkPos);
+		_subPathInfo = remaining;
 		_pathInfo = "PATH_INFO=" + _subPathInfo;
 	}
-	if (!skip)
-		_queryString = "QUERY_STRING=" +
-					   remaining.substr(questionMarkPos, std::string::npos);
 	logger.log(DEBUG, _pathInfo);
 	logger.log(DEBUG, _queryString);
 	return (ClientState::CGI_Start);
 }
+
+// Builds the CGI/1.1 variables for a request handed to the fastcgi_pass
+// backend of loc. The location path is the SCRIPT_NAME and whatever follows
+// it the PATH_INFO; whether a script exists is up to the backend.
+Outcome<ClientState> CGI::prepareFastCGI(const HTTPRequest &request,
+										 const LocationSettings &loc,
+										 const ServerSettings &server)
+{
+	const std::string &target = request.getRequestTarget();
+	const std::string &listen = server.getListen();
+	std::string script = loc.getPath();
+	FastCGI::Params params;
+
+	if (script.size() > 1 && script.back() == '/')
+		script.pop_back();
+	params.emplace_back("GATEWAY_INTERFACE", "CGI/1.1");
+	params.emplace_back("SERVER_SOFTWARE", SERVER_SOFTWARE);
+	params.emplace_back("SERVER_PROTOCOL", request.getHTTPVersion());
+	params.emplace_back("SERVER_NAME", listen.substr(0, listen.find(':')));
+	params.emplace_back("SERVER_PORT", listen.substr(listen.find(':') + 1));
+	params.emplace_back("REQUEST_METHOD",
+						MethodToString(request.getMethodType()));
+	params.emplace_back(
+		"REQUEST_URI",
+		request.getQuery().empty() ? target
+								   : target + "?" + request.getQuery());
+	params.emplace_back("SCRIPT_NAME", script);
+	params.emplace_back("SCRIPT_FILENAME",
+						std::filesystem::absolute(server.getRoot().substr(1) +
+												  loc.resolveAlias(target))
+							.string());
+	params.emplace_back("PATH_INFO", target.size() > script.size()
+										 ? target.substr(script.size())
+										 : "");
+	params.emplace_back("QUERY_STRING", request.getQuery());
+	if (request.getBodyLength() != 0)
+		params.emplace_back("CONTENT_LENGTH",
+							std::to_string(request.getBody().size()));
+	for (const auto &header : request.getHeaders())
+	{
+		std::string name = "HTTP_" + header.first;
+
+		for (char &c : name)
+			c = c == '-' ? '_' : std::toupper(static_cast<unsigned char>(c));
+		if (name == "HTTP_CONTENT_LENGTH")
+			continue;
+		if (name == "HTTP_CONTENT_TYPE")
+			name = "CONTENT_TYPE";
+		params.emplace_back(name, header.second);
+	}
+	_fastcgi_pass = loc.getFastCGIPass();
+	_fastcgi_params = FastCGI::encodeParams(params);
+	return (ClientState::CGI_Start);
+}
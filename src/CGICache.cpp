@@ -0,0 +1,308 @@
+#include <CGICache.hpp>
+#include <Logger.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <iterator>
+#include <strings.h>
+
+CGICache::CGICache()
+	: _entries(), _index(), _flights(), _woken(), _size(0), _serial(0),
+	  _hits(0), _stale(0), _misses(0), _coalesced(0), _next_report(0)
+{
+}
+
+CGICache::~CGICache()
+{
+}
+
+CGICache &CGICache::getInstance()
+{
+	static CGICache instance;
+	return (instance);
+}
+
+static bool isDirective(std::string_view directive, std::string_view name)
+{
+	return (directive.size() == name.size() &&
+			strncasecmp(directive.data(), name.data(), name.size()) == 0);
+}
+
+// Reads the seconds of a Cache-Control directive like max-age=60.
+static bool directiveSeconds(std::string_view directive, std::string_view name,
+							 size_t &seconds)
+{
+	if (directive.size() <= name.size() ||
+		strncasecmp(directive.data(), name.data(), name.size()) != 0 ||
+		directive[name.size()] != '=')
+		return (false);
+	directive.remove_prefix(name.size() + 1);
+	std::from_chars(directive.data(), directive.data() + directive.size(),
+					seconds);
+	return (true);
+}
+
+// Whether the script lets its response be shared: nothing private, that
+// sets a cookie or that varies on request headers, which aren't part of the
+// key (RFC 9111, 4.1). Its Cache-Control s-maxage or max-age replaces ttl and
+// stale-while-revalidate replaces stale.
+static bool isShared(const CGIHead &head, size_t &ttl, size_t &stale)
+{
+	bool shared_age = false;
+
+	for (const auto &field : head.getFields())
+	{
+		if (strcasecmp(field.first.c_str(), "Set-Cookie") == 0 ||
+			strcasecmp(field.first.c_str(), "Vary") == 0)
+			return (false);
+		if (strcasecmp(field.first.c_str(), "Cache-Control") != 0)
+			continue;
+
+		std::string_view value = field.second;
+
+		while (!value.empty())
+		{
+			const size_t comma = value.find(',');
+			std::string_view directive = value.substr(0, comma);
+
+			value.remove_prefix(comma == std::string_view::npos ? value.size()
+																: comma + 1);
+			while (!directive.empty() && (directive.front() == ' ' ||
+										  directive.front() == '\t'))
+				directive.remove_prefix(1);
+			while (!directive.empty() &&
+				   (directive.back() == ' ' || directive.back() == '\t'))
+				directive.remove_suffix(1);
+			if (isDirective(directive, "no-store") ||
+				isDirective(directive, "no-cache") ||
+				isDirective(directive, "private"))
+				return (false);
+			if (directiveSeconds(directive, "s-maxage", ttl))
+				shared_age = true;
+			else if (!shared_age)
+				directiveSeconds(directive, "max-age", ttl);
+			directiveSeconds(directive, "stale-while-revalidate", stale);
+		}
+	}
+	return (true);
+}
+
+// Whether a shared response may be stored, and for how long. Only statuses
+// that are cacheable by default (RFC 9110, 15.1) are kept.
+static bool isCacheable(const CGIHead &head, size_t &ttl, size_t &stale)
+{
+	switch (head.getStatusCode())
+	{
+	case StatusCode::OK:
+	case StatusCode::NoContent:
+	case StatusCode::MovedPermanently:
+	case StatusCode::PermanentRedirect:
+	case StatusCode::NotFound:
+		break;
+	default:
+		return (false);
+	}
+	return (isShared(head, ttl, stale) && ttl != 0);
+}
+
+// The response stored under key, if it may still be served. One that went
+// stale is handed to the caller to run the script again, for up to
+// revalidate seconds; until then the others are served the stale copy.
+std::shared_ptr<const CachedCgi> CGICache::find(const std::string &key,
+												size_t revalidate)
+{
+	Logger &logger = Logger::getInstance();
+	const time_t now = time(nullptr);
+	auto it = _index.find(key);
+
+	report(now);
+	if (it == _index.end())
+	{
+		_misses++;
+		return (nullptr);
+	}
+
+	const std::shared_ptr<CachedCgi> cached = it->second->second;
+
+	if (now < cached->fresh_until ||
+		(now < cached->stale_until && now < cached->updating_until))
+	{
+		now < cached->fresh_until ? _hits++ : _stale++;
+		_entries.splice(_entries.begin(), _entries, it->second);
+		return (cached);
+	}
+	_misses++;
+	if (now < cached->stale_until)
+	{
+		logger.log(DEBUG, "CGICache: revalidating " + key);
+		cached->updating_until = now + revalidate;
+	}
+	else
+		erase(it->second);
+	return (nullptr);
+}
+
+// Keeps the complete response of a script if its head allows it, replacing
+// what was stored under key. ttl and stale are the location's.
+std::shared_ptr<const CachedCgi> CGICache::store(const std::string &key,
+												 const CGIHead &head,
+												 std::string_view body,
+												 size_t ttl, size_t stale)
+{
+	Logger &logger = Logger::getInstance();
+	const time_t now = time(nullptr);
+	auto it = _index.find(key);
+
+	if (it != _index.end())
+		erase(it->second);
+	if (body.size() > CGI_CACHE_MAX_ENTRY || !isCacheable(head, ttl, stale))
+		return (nullptr);
+
+	std::shared_ptr<CachedCgi> cached = std::make_shared<CachedCgi>(
+		CachedCgi{head, std::string(body), ++_serial, now,
+				  now + static_cast<time_t>(ttl),
+				  now + static_cast<time_t>(ttl + stale), 0});
+
+	logger.log(DEBUG, "CGICache: storing % for %s", key, ttl);
+	_entries.emplace_front(key, cached);
+	_index.emplace(key, _entries.begin());
+	_size += key.size() + body.size();
+	while (_size > CGI_CACHE_SIZE)
+		erase(std::prev(_entries.end()));
+	return (cached);
+}
+
+void CGICache::erase(std::list<Entry>::iterator it)
+{
+	_size -= it->first.size() + it->second->body.size();
+	_index.erase(it->first);
+	_entries.erase(it);
+}
+
+// The open flight of key, with client_fd added to its waiters. It is woken
+// right away for what the script already wrote.
+std::shared_ptr<CGIFlight> CGICache::join(const std::string &key,
+										  int client_fd)
+{
+	Logger &logger = Logger::getInstance();
+	auto it = _flights.find(key);
+
+	if (it == _flights.end())
+		return (nullptr);
+	logger.log(DEBUG, "CGICache: fd % waits on %", client_fd, key);
+	_coalesced++;
+	it->second->waiters[client_fd] = it->second->base;
+	_woken.push_back(client_fd);
+	return (it->second);
+}
+
+// Opens a flight for the script about to run for key.
+std::shared_ptr<CGIFlight> CGICache::lead(const std::string &key)
+{
+	std::shared_ptr<CGIFlight> flight = std::make_shared<CGIFlight>(
+		CGIFlight{key, "", 0, {}, true, false, false, false, StatusCode::OK});
+
+	_flights[key] = flight;
+	return (flight);
+}
+
+// Adds what the script wrote and wakes the waiters. false once nobody needs
+// it anymore: the flight is closed and has no waiters.
+bool CGICache::feed(CGIFlight &flight, std::string_view output)
+{
+	flight.output.append(output);
+	if (flight.open && !flight.checked)
+	{
+		CGIHead head;
+		const Outcome<CGIHead::Parse> parsed = head.parse(flight.output, false);
+		size_t ttl = 0;
+		size_t stale = 0;
+
+		if (!parsed || *parsed != CGIHead::Parse::Incomplete)
+		{
+			flight.checked = true;
+			flight.shared = !parsed || isShared(head, ttl, stale);
+		}
+		if (flight.checked && !flight.shared)
+			close(flight);
+	}
+	if (flight.open && flight.base + flight.output.size() > CGI_CACHE_MAX_ENTRY)
+		close(flight);
+	if (!flight.open && flight.waiters.empty())
+		return (false);
+	wake(flight);
+	return (true);
+}
+
+// Appends what the waiter on client_fd hasn't taken yet of the output to
+// into. Once the flight is closed what every waiter took is let go.
+void CGICache::follow(CGIFlight &flight, int client_fd, std::string &into)
+{
+	size_t &taken = flight.waiters.at(client_fd);
+	size_t least = flight.base + flight.output.size();
+
+	into.append(flight.output, taken - flight.base);
+	taken = least;
+	if (flight.open)
+		return;
+	for (const auto &waiter : flight.waiters)
+		least = std::min(least, waiter.second);
+	flight.output.erase(0, least - flight.base);
+	flight.base = least;
+}
+
+void CGICache::leave(CGIFlight &flight, int client_fd)
+{
+	flight.waiters.erase(client_fd);
+}
+
+// Ends the flight and wakes the waiters for the rest. A status other than
+// OK is what they fail with.
+void CGICache::finish(CGIFlight &flight, StatusCode status)
+{
+	if (flight.ended)
+		return;
+	if (!flight.checked)
+		flight.checked = flight.shared = true;
+	flight.ended = true;
+	flight.status = status;
+	close(flight);
+	wake(flight);
+}
+
+// The clients of waiters that have something new, for HTTPServer to poll.
+std::vector<int> CGICache::collectWoken(void)
+{
+	std::vector<int> woken;
+
+	woken.swap(_woken);
+	return (woken);
+}
+
+void CGICache::close(CGIFlight &flight)
+{
+	auto it = _flights.find(flight.key);
+
+	if (it != _flights.end() && it->second.get() == &flight)
+		_flights.erase(it);
+	flight.open = false;
+}
+
+void CGICache::wake(const CGIFlight &flight)
+{
+	for (const auto &waiter : flight.waiters)
+		_woken.push_back(waiter.first);
+}
+
+void CGICache::report(time_t now)
+{
+	if (now < _next_report)
+		return;
+	if (_next_report != 0)
+		Logger::getInstance().log(
+			INFO,
+			"CGICache: % hits, % stale, % misses, % coalesced, % entries "
+			"(% bytes)",
+			_hits, _stale, _misses, _coalesced, _entries.size(), _size);
+	_next_report = now + CGI_CACHE_REPORT_INTERVAL;
+}
@@ -0,0 +1,162 @@
+#include <CGIHead.hpp>
+#include <HTTPStatus.hpp>
+#include <HeaderWriter.hpp>
+
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <strings.h>
+
+CGIHead::CGIHead()
+	: _status_code(StatusCode::OK), _content_type("text/html"),
+	  _has_content_length(false), _content_length(0), _length(0), _fields()
+{
+}
+
+CGIHead::~CGIHead()
+{
+}
+
+static bool isToken(std::string_view name)
+{
+	if (name.empty())
+		return (false);
+	for (const char c : name)
+		if (!std::isalnum(static_cast<unsigned char>(c)) &&
+			std::strchr("!#$%&'*+-.^_`|~", c) == NULL)
+			return (false);
+	return (true);
+}
+
+static bool isField(std::string_view name, std::string_view field)
+{
+	return (name.size() == field.size() &&
+			strncasecmp(name.data(), field.data(), name.size()) == 0);
+}
+
+// Reads the head off the start of output, again from the beginning on every
+// call until it's Complete. Output that doesn't start with header lines has
+// no head and is all body, as is output whose head doesn't end before eof or
+// before it outgrew what a response head can hold. A Missing head leaves the
+// defaults: 200 and text/html.
+Outcome<CGIHead::Parse> CGIHead::parse(std::string_view output, bool eof)
+{
+	bool has_status = false;
+	bool has_location = false;
+	size_t pos = 0;
+
+	*this = CGIHead();
+	for (size_t eol = output.find('\n'); eol != std::string_view::npos;
+		 eol = output.find('\n', pos))
+	{
+		std::string_view line = output.substr(pos, eol - pos);
+		const size_t colon = line.find(':');
+
+		pos = eol + 1;
+		if (!line.empty() && line.back() == '\r')
+			line.remove_suffix(1);
+		if (line.empty())
+		{
+			if (has_location && !has_status)
+				_status_code = StatusCode::Found;
+			_length = pos;
+			return (Parse::Complete);
+		}
+		if (colon == std::string_view::npos ||
+			!isToken(line.substr(0, colon)))
+		{
+			*this = CGIHead();
+			return (Parse::Missing);
+		}
+
+		const std::string_view name = line.substr(0, colon);
+		std::string_view value = line.substr(colon + 1);
+
+		while (!value.empty() &&
+			   (value.front() == ' ' || value.front() == '\t'))
+			value.remove_prefix(1);
+		while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+			value.remove_suffix(1);
+		if (isField(name, "Status"))
+		{
+			unsigned code = 0;
+
+			std::from_chars(value.data(), value.data() + value.size(), code);
+			_status_code = static_cast<StatusCode>(code);
+			if (!HTTPStatus::isKnown(_status_code))
+				return (fail(StatusCode::BadGateway));
+			has_status = true;
+		}
+		else if (isField(name, "Content-Length"))
+		{
+			const std::from_chars_result result = std::from_chars(
+				value.data(), value.data() + value.size(), _content_length);
+
+			if (result.ec != std::errc() ||
+				result.ptr != value.data() + value.size())
+				return (fail(StatusCode::BadGateway));
+			_has_content_length = true;
+		}
+		else if (isField(name, "Content-Type"))
+			_content_type = value;
+		else
+		{
+			if (isField(name, "Location"))
+				has_location = true;
+			_fields.emplace_back(name, value);
+		}
+	}
+	if (!eof && output.size() < HEADER_CAPACITY)
+		return (Parse::Incomplete);
+	*this = CGIHead();
+	return (Parse::Missing);
+}
+
+StatusCode CGIHead::getStatusCode(void) const
+{
+	return (_status_code);
+}
+
+const std::string &CGIHead::getContentType(void) const
+{
+	return (_content_type);
+}
+
+bool CGIHead::hasContentLength(void) const
+{
+	return (_has_content_length);
+}
+
+size_t CGIHead::getContentLength(void) const
+{
+	return (_content_length);
+}
+
+// Bytes of the output the head took up, the body starts after them.
+size_t CGIHead::getLength(void) const
+{
+	return (_length);
+}
+
+const std::vector<std::pair<std::string, std::string>> &
+CGIHead::getFields(void) const
+{
+	return (_fields);
+}
+
+// The setters build a head that isn't parsed from a script's output, for the
+// handler modules.
+void CGIHead::setStatusCode(StatusCode status_code)
+{
+	_status_code = status_code;
+}
+
+void CGIHead::setContentType(std::string_view content_type)
+{
+	_content_type = content_type;
+}
+
+void CGIHead::addField(std::string_view name, std::string_view value)
+{
+	_fields.emplace_back(name, value);
+}
@@ -0,0 +1,79 @@
+#include <CGIPool.hpp>
+#include <ChildReaper.hpp>
+#include <SystemException.hpp>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// Pools are per location of a listen address, the same name wherever the
+// location's settings were copied to.
+std::string CGIPool::name(const ServerSettings &server,
+						  const LocationSettings &loc)
+{
+	return ("pool:" + server.getListen() + loc.getPath());
+}
+
+// Throws if the worker can't be read, a pool without one would never serve
+// a request.
+void CGIPool::checkWorker(void)
+{
+	if (access(CGI_POOL_WORKER, R_OK) == SYSTEM_ERROR)
+		throw std::runtime_error(std::string("CGIPool: ") + CGI_POOL_WORKER +
+								 ": " + std::strerror(errno));
+}
+
+// Starts a worker on one end of a socketpair and returns the other,
+// non-blocking. posix_spawn for the same reason as CGI::spawn(): a fork of a
+// server whose caches filled up copies all of its page tables. The worker
+// closes the descriptors it inherited past its socket itself.
+int CGIPool::spawn(Poll &poll, pid_t &pid)
+{
+	const char *const argv[] = {"python3", CGI_POOL_WORKER, NULL};
+	const char *const env[] = {NULL};
+	posix_spawn_file_actions_t actions;
+	int pair[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == SYSTEM_ERROR)
+		return (-1);
+	int error = posix_spawn_file_actions_init(&actions);
+	if (error == 0)
+	{
+		error = posix_spawn_file_actions_adddup2(&actions, pair[1],
+												 STDIN_FILENO);
+		if (error == 0)
+			error = posix_spawn_file_actions_addclose(&actions, pair[0]);
+		if (error == 0)
+			error = posix_spawn_file_actions_addclose(&actions, pair[1]);
+		if (error == 0)
+			error = posix_spawn(&pid, "/usr/bin/python3", &actions, NULL,
+								(char *const *)argv, (char *const *)env);
+		posix_spawn_file_actions_destroy(&actions);
+	}
+	close(pair[1]);
+	if (error != 0 || fcntl(pair[0], F_SETFL, O_NONBLOCK) == -1 ||
+		fcntl(pair[0], F_SETFD, FD_CLOEXEC) == -1)
+	{
+		close(pair[0]);
+		if (error == 0)
+			stop(poll, pid);
+		pid = -1;
+		return (-1);
+	}
+	return (pair[0]);
+}
+
+// Kills a worker whose connection is gone, it has nothing left to finish.
+// The ChildReaper collects it.
+void CGIPool::stop(Poll &poll, pid_t pid)
+{
+	kill(pid, SIGKILL);
+	ChildReaper::getInstance().watch(poll, pid, -1);
+}
@@ -0,0 +1,164 @@
+#include <ChildReaper.hpp>
+#include <Logger.hpp>
+#include <SystemException.hpp>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+// Write end of the self-pipe, for the signal handler.
+static volatile sig_atomic_t g_sigchld_fd = -1;
+
+static void onSigchld(int)
+{
+	const int saved_errno = errno;
+
+	if (g_sigchld_fd != -1)
+		(void)!write(g_sigchld_fd, "", 1);
+	errno = saved_errno;
+}
+
+ChildReaper::ChildReaper() : _pidfds(), _signalled(), _pipe{-1, -1}, _exited()
+{
+}
+
+ChildReaper::~ChildReaper()
+{
+	for (const auto &entry : _pidfds)
+		close(entry.first);
+	if (_pipe[0] != -1)
+	{
+		signal(SIGCHLD, SIG_DFL);
+		g_sigchld_fd = -1;
+		close(_pipe[0]);
+		close(_pipe[1]);
+	}
+}
+
+ChildReaper &ChildReaper::getInstance()
+{
+	static ChildReaper instance;
+	return (instance);
+}
+
+// Starts watching pid. client_fd is woken through collectExited() once it
+// exited, -1 for a child nobody waits for.
+std::shared_ptr<ChildExit> ChildReaper::watch(Poll &poll, pid_t pid,
+											  int client_fd)
+{
+	Logger &logger = Logger::getInstance();
+	std::shared_ptr<ChildExit> child =
+		std::make_shared<ChildExit>(ChildExit{pid, client_fd, false, false, 0});
+
+#if defined(__linux__) && defined(SYS_pidfd_open)
+	const int fd = syscall(SYS_pidfd_open, pid, 0);
+
+	if (fd != -1 && fcntl(fd, F_SETFD, FD_CLOEXEC) != -1)
+	{
+		_pidfds.emplace(fd, child);
+		poll.addPollFD(fd, POLLIN);
+		return (child);
+	}
+	if (fd != -1)
+		close(fd);
+#endif
+	if (!installHandler(poll))
+	{
+		logger.log(ERROR, "ChildReaper: can't watch pid %", pid);
+		return (child);
+	}
+	// it may have exited before anyone listened for SIGCHLD
+	if (!reap(child))
+		_signalled.push_back(child);
+	return (child);
+}
+
+bool ChildReaper::owns(int fd) const
+{
+	return (fd == _pipe[0] || _pidfds.find(fd) != _pidfds.end());
+}
+
+void ChildReaper::handleEvents(Poll &poll, int fd)
+{
+	auto it = _pidfds.find(fd);
+	char buffer[64];
+
+	if (it != _pidfds.end())
+	{
+		if (!reap(it->second))
+			return;
+		poll.removeFD(fd);
+		close(fd);
+		_pidfds.erase(it);
+		return;
+	}
+	while (read(_pipe[0], buffer, sizeof(buffer)) > 0)
+		;
+	_signalled.erase(std::remove_if(_signalled.begin(), _signalled.end(),
+									[this](const std::shared_ptr<ChildExit> &c)
+									{ return (reap(c)); }),
+					 _signalled.end());
+}
+
+std::vector<int> ChildReaper::collectExited(void)
+{
+	std::vector<int> exited;
+
+	exited.swap(_exited);
+	return (exited);
+}
+
+bool ChildReaper::installHandler(Poll &poll)
+{
+	struct sigaction action;
+
+	if (_pipe[0] != -1)
+		return (true);
+	if (pipe(_pipe) == SYSTEM_ERROR)
+		return (false);
+	for (int fd : _pipe)
+	{
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+	}
+	g_sigchld_fd = _pipe[1];
+	action.sa_handler = onSigchld;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &action, NULL);
+	poll.addPollFD(_pipe[0], POLLIN);
+	return (true);
+}
+
+// Collects child's status if it has exited. Only its own pid is waited for,
+// children the reaper doesn't know about are left to their owners.
+bool ChildReaper::reap(const std::shared_ptr<ChildExit> &child)
+{
+	Logger &logger = Logger::getInstance();
+	pid_t result = waitpid(child->pid, &child->status, WNOHANG);
+
+	while (result == SYSTEM_ERROR && errno == EINTR)
+		result = waitpid(child->pid, &child->status, WNOHANG);
+	if (result == 0)
+		return (false);
+	if (result == SYSTEM_ERROR)
+	{
+		logger.log(ERROR, "ChildReaper: waitpid %: %", child->pid,
+				   std::strerror(errno));
+		child->lost = true;
+	}
+	child->exited = true;
+	logger.log(DEBUG, "ChildReaper: pid % exited with status %", child->pid,
+			   child->status);
+	if (child->client_fd != -1 && child.use_count() > 1)
+		_exited.push_back(child->client_fd);
+	return (true);
+}
@@ -1,11 +1,13 @@
 #include "CGI.hpp"
+#include "CGICache.hpp"
+#include "CGIPool.hpp"
 #include "ClientState.hpp"
 #include "LocationSettings.hpp"
 #include "Poll.hpp"
-#include "ReturnException.hpp"
 #include "StatusCode.hpp"
 #include <Client.hpp>
-#include <ClientException.hpp>
+#include <ErrorPages.hpp>
+#include <Handlers.hpp>
 #include <Logger.hpp>
 #include <Server.hpp>
 #include <ServerSettings.hpp>
@@ -16,14 +18,15 @@
 #include <sys/wait.h>
 
 Client::Client(const int &server_fd, std::vector<ServerSettings> &serversetting)
-	: _request(), _file_manager(), _socket(server_fd),
-	  _server_list(serversetting), _serversetting(serversetting.at(0))
+	: _request(), _file_manager(), _cgi(), _handler(), _socket(server_fd),
+	  _server_list(serversetting), _serversetting(serversetting.at(0)),
+	  _serverToCgiFd{-1, -1}, _cgiToServerFd{-1, -1}
 {
 	_socket.setupClient();
+	_file_manager.setClientFD(_socket.getFD());
 	_state = ClientState::Receiving;
 	cgiBodyIsSent = false;
 	cgiHasBeenRead = false;
-	KO = false;
 }
 
 Client::~Client()
@@ -96,6 +99,49 @@ void Client::setState(ClientState state)
 	_state = state;
 }
 
+ClientState Client::getState(void) const
+{
+	return (_state);
+}
+
+// Whether the client waits on a CGI script or FastCGI request that is
+// running.
+bool Client::waitsOnCgi(void) const
+{
+	return (_state == ClientState::CGI_Write ||
+			_state == ClientState::CGI_Read ||
+			_state == ClientState::CGI_Stream);
+}
+
+std::chrono::steady_clock::time_point Client::getCgiDeadline(void) const
+{
+	return (_cgi.getDeadline());
+}
+
+// Gives up on a CGI that ran past its cgi_timeout. The client gets a 504,
+// or is cut off if its response had already started.
+ClientState Client::expireCgi(Poll &poll)
+{
+	_cgi.stop(poll);
+	if (_cgi.getOutput() == CGI::Output::Streamed)
+	{
+		_state = ClientState::Done;
+		return (_state);
+	}
+	return (setErrorResponse(StatusCode::GatewayTimeout));
+}
+
+// Replaces whatever was prepared with the shared error response of this
+// client's server block.
+ClientState Client::setErrorResponse(StatusCode status_code)
+{
+	_file_manager.setResponse("");
+	_response.setCanned(ErrorPages::getInstance().find(
+		_serversetting.getErrorDir(), status_code));
+	_state = ClientState::Sending;
+	return (_state);
+}
+
 FileManager &Client::getFileManager()
 {
 	return (_file_manager);
@@ -106,131 +152,340 @@ HTTPResponse &Client::getResponse()
 	return (_response);
 }
 
-ClientState Client::handleConnection(
-	short events, Poll &poll, Client &client,
-	std::unordered_map<int, std::shared_ptr<int>> &active_pipes)
+// Carries a failed step of the request over into its error response.
+ClientState Client::settle(const Outcome<ClientState> &outcome)
 {
 	Logger &logger = Logger::getInstance();
-	logger.log(INFO, "Handling client connection on fd: " +
-						 std::to_string(_socket.getFD()));
-	try
+
+	if (outcome)
 	{
-		if (events & POLLIN && _state == ClientState::Receiving)
-		{
-			logger.log(DEBUG, "ClientState::Receiving");
-			_state = _request.receive(_socket.getFD());
-			if (_request.getHeaderEnd())
-			{
-				resolveServerSetting();
-				const LocationSettings &loc =
-					_serversetting.resolveLocation(_request.getRequestTarget());
-
-				if (loc.resolveMethod(_request.getMethodType()) == false)
-					throw ClientException(StatusCode::MethodNotAllowed);
-				if (loc.getCGI() == true)
-					_request.setCGI(true);
-				if (_request.getBody().size() > _request.getMaxBodySize())
-					throw ClientException(StatusCode::RequestBodyTooLarge);
-				if (_request.getBody().size() >= _request.getBodyLength())
-					return (ClientState::Loading);
-			}
-			return (_state);
-		}
-		else if (events & POLLOUT && _state == ClientState::CGI_Start)
-		{
-			logger.log(DEBUG, "ClientState::CGI_Start");
-			_state = _cgi.start(poll, client, _request.getBodyLength(),
-								active_pipes);
-			return (_state);
-		}
-		else if (events & POLLOUT && _state == ClientState::CGI_Write)
-		{
-			logger.log(DEBUG, "ClientState::CGI_Write");
-			_state =
-				_cgi.send(client, _request.getBody(), _request.getBodyLength());
-			return (_state);
-		}
-		else if (events & POLLIN && _state == ClientState::CGI_Read)
-		{
-			logger.log(DEBUG, "ClientState::CGI_Read");
-			_state = _cgi.receive(client);
-			if (client.cgiHasBeenRead == true)
-			{
-				_state = _file_manager.manageCgi(_request.getHTTPVersion(),
-												 _cgi.body);
-				logger.log(DEBUG,
-						   "response:\n\n" + _file_manager.getResponse());
-			}
-			return (_state);
-		}
-		else if (events & POLLOUT && _state == ClientState::Loading)
+		_state = *outcome;
+		return (_state);
+	}
+	logger.log(ERROR,
+			   "Client failure: " + outcome.error().getStatusLine("HTTP/1.1"));
+	return (setErrorResponse(outcome.error().getStatusCode()));
+}
+
+// Reads what there is of the request and, once its headers are complete,
+// decides how the body is taken in.
+Outcome<ClientState> Client::receiveRequest(void)
+{
+	const Outcome<ClientState> received = _request.receive(_socket.getFD());
+
+	if (!received || !_request.getHeaderEnd())
+		return (received);
+	resolveServerSetting();
+
+	const Outcome<const LocationSettings *> loc =
+		_serversetting.resolveLocation(_request.getRequestTarget());
+
+	if (!loc)
+		return (loc.failure());
+	if ((*loc)->resolveMethod(_request.getMethodType()) == false)
+		return (fail(StatusCode::MethodNotAllowed));
+	if ((*loc)->getReturn())
+	{
+		_file_manager.setResponse("");
+		_response.setCanned((*loc)->getReturn());
+		return (ClientState::Sending);
+	}
+	if ((*loc)->getCGI() == true)
+		_request.setCGI(true);
+	if (_request.getBody().size() > _request.getMaxBodySize())
+		return (fail(StatusCode::RequestBodyTooLarge));
+	if (_request.getBody().size() >= _request.getBodyLength())
+		return (ClientState::Loading);
+	if (_request.getBodyLength() > _request.getMaxBodySize())
+		return (fail(StatusCode::RequestBodyTooLarge));
+	// a script that is forked reads the rest of the body straight off the
+	// socket, see CGI::send()
+	if (_request.getCGI() == true &&
+		_request.getMethodType() != HTTPMethod::DELETE &&
+		(*loc)->getFastCGIPass().empty() && (*loc)->getCGIPool() == 0)
+		return (ClientState::Loading);
+	// a handler module gets the whole body
+	if (!(*loc)->getHandler().empty())
+		return (received);
+	if (_request.getCGI() == false &&
+		_request.getMethodType() != HTTPMethod::GET &&
+		_request.getMethodType() != HTTPMethod::DELETE)
+		return (_file_manager.openUpload(_request));
+	return (received);
+}
+
+// Hands a complete request to a handler module, the CGI or the
+// FileManager. A request that missed the cgi_cache waits on an identical one
+// whose script is running, if there is one.
+Outcome<ClientState> Client::loadRequest(Poll &poll)
+{
+	Logger &logger = Logger::getInstance();
+	const Outcome<const LocationSettings *> loc =
+		_serversetting.resolveLocation(_request.getRequestTarget());
+
+	if (loc && !(*loc)->getHandler().empty())
+		return (startHandler(poll, **loc));
+	if (_request.getCGI() == true &&
+		_request.getMethodType() != HTTPMethod::DELETE)
+	{
+		if (!loc)
+			return (loc.failure());
+		_cgi.setLimits((*loc)->getCGILimits());
+
+		const std::shared_ptr<const CachedCgi> cached =
+			_file_manager.findCachedCgi(_request, **loc);
+
+		if (cached)
+			return (_file_manager.manageCachedCgi(_request, **loc, *cached));
+
+		Outcome<ClientState> parsed = ClientState::CGI_Start;
+
+		if (!(*loc)->getFastCGIPass().empty())
+			parsed = _cgi.prepareFastCGI(_request, **loc, _serversetting);
+		else
 		{
-			logger.log(DEBUG, "ClientState::Loading");
-			if (_request.getCGI() == true &&
-				_request.getMethodType() != HTTPMethod::DELETE)
-			{
-				_state = _cgi.parseURIForCGI(
-					_serversetting.resolveLocation(_request.getRequestTarget())
-						.resolveAlias(_request.getRequestTarget()));
-				logger.log(DEBUG, "executable: " + _cgi.getExecutable());
-				return (_state);
-			}
-			_state = _file_manager.manage(_request.getMethodType(),
-										  _request.getRequestTarget(),
-										  _request.getBody());
-			return (_state);
+			parsed = _cgi.parseURIForCGI(
+				(*loc)->resolveAlias(_request.getRequestTarget()),
+				_request.getQuery());
+			logger.log(DEBUG, "executable: " + _cgi.getExecutable());
+			if (parsed && *parsed == ClientState::CGI_Start &&
+				(*loc)->getCGIPool() != 0)
+				parsed = _cgi.usePool(CGIPool::name(_serversetting, **loc),
+									  _request.getQuery());
 		}
-		else if (events & POLLOUT && _state == ClientState::Error)
+		if (parsed && *parsed == ClientState::CGI_Start &&
+			!_file_manager.getCgiCacheKey().empty() &&
+			_cgi.joinFlight(_file_manager.getCgiCacheKey(), getFD()))
 		{
-			logger.log(DEBUG, "ClientState::Error");
-			_state = _file_manager.loadErrorPage();
-			return (_state);
+			_file_manager.skipCgiCache();
+			return (ClientState::CGI_Read);
 		}
-		else if (events & POLLOUT && _state == ClientState::Sending)
+		return (parsed);
+	}
+	return (_file_manager.manage(_request));
+}
+
+// Calls the module of a handler location in process, no script involved.
+Outcome<ClientState> Client::startHandler(Poll &poll,
+										  const LocationSettings &loc)
+{
+	const HandlerModule *module =
+		Handlers::getInstance().find(loc.getHandler());
+
+	if (module == nullptr)
+		return (fail(StatusCode::InternalServerError));
+	_handler = std::make_unique<HandlerCall>(*module, _request);
+	return (runHandler(poll));
+}
+
+// Calls the module again after a WS_AGAIN, and answers with its response
+// once it's complete.
+Outcome<ClientState> Client::runHandler(Poll &poll)
+{
+	const Outcome<ClientState> ran = _handler->run(poll, getFD());
+
+	if (!ran || *ran != ClientState::Sending)
+		return (ran);
+	return (_file_manager.manageCgi(_request, _handler->getResponse().head,
+									_handler->getResponse().body));
+}
+
+// Passes on what the script has written so far. complete once it is done
+// and all of its output read.
+Outcome<ClientState> Client::forwardCgi(bool complete)
+{
+	CGIHead &head = _cgi.getHead();
+
+	if (_cgi.getOutput() == CGI::Output::Head)
+	{
+		const Outcome<CGIHead::Parse> parsed =
+			head.parse(_cgi.body, complete || cgiHasBeenRead);
+
+		if (!parsed)
+			return (parsed.failure());
+		if (*parsed == CGIHead::Parse::Incomplete)
+			return (ClientState::CGI_Read);
+		_cgi.setOutput(CGI::Output::Whole);
+		if (!complete && !cgiHasBeenRead)
 		{
-			logger.log(DEBUG, "ClientState::Sending");
-			if (KO == true)
+			const Outcome<ClientState> started =
+				_file_manager.startCgiStream(_request, head);
+
+			if (!started)
+				return (started);
+			if (*started == ClientState::CGI_Stream)
 			{
-				_state =
-					_response.send(_socket.getFD(), "HTTP/1.1 500 KO\t\n\t\n");
-				return (_state);
+				_cgi.body.erase(0, head.getLength());
+				_cgi.setOutput(CGI::Output::Streamed);
 			}
-			_state =
-				_response.send(_socket.getFD(), _file_manager.getResponse());
-			return (_state);
-		}
-		else
-		{
-			throw ClientException(StatusCode::BadRequest);
 		}
 	}
-	catch (ClientException &e)
+	if (_cgi.getOutput() == CGI::Output::Streamed)
+		return (_file_manager.streamCgi(_cgi.body, complete));
+	if (!complete)
+		return (ClientState::CGI_Read);
+	return (_file_manager.manageCgi(
+		_request, head, std::string_view(_cgi.body).substr(head.getLength())));
+}
+
+// Reads from the script's stdout. While what it wrote is being sent the pipe
+// leaves the poll set, so a slow client holds the script up instead of its
+// output piling up here.
+Outcome<ClientState> Client::readCgi(Poll &poll)
+{
+	const Outcome<ClientState> received = _cgi.receive(*this);
+
+	if (!received || *received == ClientState::Done)
+		return (received);
+
+	const Outcome<ClientState> forwarded = forwardCgi(false);
+
+	if (forwarded && *forwarded == ClientState::CGI_Stream)
+		poll.removeFD(_cgiToServerFd[READ_END]);
+	return (forwarded);
+}
+
+// Takes in what the script writes while its body is still being sent, so it
+// never stalls on a full stdout before it read all of stdin. The output is
+// only looked at once the body is in.
+ClientState Client::bufferCgi(void)
+{
+	const Outcome<ClientState> received = _cgi.receive(*this);
+
+	if (!received || *received == ClientState::Done)
+		return (settle(received));
+	return (_state);
+}
+
+// Sends what was forwarded of the script's output and, once that's gone,
+// goes back to reading it.
+Outcome<ClientState> Client::drainCgi(Poll &poll)
+{
+	if (!_response.pending())
 	{
-		logger.log(ERROR, "Client exception: " + std::string(e.what()));
-		if (_request.getCGI() == true &&
-			_request.getMethodType() != HTTPMethod::DELETE)
-			_exit(1);
-		_response.clear();
-		_file_manager.setResponse(e.what());
+		_response.append(_file_manager.getResponse());
+		_file_manager.setResponse("");
+	}
+	_response.stream(_socket.getFD());
+	if (_response.pending())
+		return (ClientState::CGI_Stream);
+	if (_cgi.followsFlight())
+		return (followFlight());
+	poll.addPollFD(_cgiToServerFd[READ_END], POLLIN);
+	return (ClientState::CGI_Read);
+}
 
-		const std::string path = _serversetting.getErrorDir();
-		if (path.empty())
-			_state = _file_manager.openErrorPage("", e.getStatusCode());
-		else
-			_state =
-				_file_manager.openErrorPage(path.substr(1), e.getStatusCode());
+// Passes on what the script another request runs wrote since the last
+// wakeup, as if it ran for this one.
+Outcome<ClientState> Client::followFlight(void)
+{
+	const Outcome<ClientState> received = _cgi.receiveFlight();
+
+	if (!received && _cgi.getOutput() == CGI::Output::Streamed)
+		return (ClientState::Done);
+	if (!received || *received == ClientState::CGI_Start)
+		return (received);
+	if (*received == ClientState::Sending && _cgi.isFastCGI())
+		return (_file_manager.manageFastCgi(_request, _cgi.body));
+	return (forwardCgi(*received == ClientState::Sending));
+}
+
+// Ends the response once the script is done, or the FastCGI backend.
+Outcome<ClientState> Client::finishCgi(void)
+{
+	if (_cgi.followsFlight())
+		return (followFlight());
+
+	const Outcome<ClientState> done = _cgi.complete(*this);
+
+	if (!done || *done != ClientState::Sending)
+		return (done);
+	if (_cgi.isFastCGI())
+		return (_file_manager.manageFastCgi(_request, _cgi.body));
+	return (forwardCgi(true));
+}
+
+ClientState Client::handleConnection(
+	short events, Poll &poll, Client &client,
+	std::unordered_map<int, std::shared_ptr<int>> &active_pipes)
+{
+	Logger &logger = Logger::getInstance();
+	logger.log(INFO, "Handling client connection on fd: " +
+						 std::to_string(_socket.getFD()));
+	if (events & POLLIN && _state == ClientState::Receiving)
+	{
+		logger.log(DEBUG, "ClientState::Receiving");
+		return (settle(receiveRequest()));
+	}
+	else if (events & POLLIN && _state == ClientState::Uploading)
+	{
+		logger.log(DEBUG, "ClientState::Uploading");
+		return (settle(_file_manager.receiveUpload()));
+	}
+	else if (events & POLLOUT && _state == ClientState::CGI_Start)
+	{
+		logger.log(DEBUG, "ClientState::CGI_Start");
+		return (settle(_cgi.start(poll, client, _request.getBodyLength(),
+								  active_pipes)));
+	}
+	else if (events & (POLLIN | POLLOUT) && _state == ClientState::CGI_Write)
+	{
+		logger.log(DEBUG, "ClientState::CGI_Write");
+		return (settle(_cgi.send(poll, client)));
+	}
+	else if (events & POLLIN && _state == ClientState::CGI_Read)
+	{
+		logger.log(DEBUG, "ClientState::CGI_Read");
+		return (settle(readCgi(poll)));
+	}
+	else if (events & POLLOUT && _state == ClientState::CGI_Read)
+	{
+		logger.log(DEBUG, "ClientState::CGI_Read (complete)");
+		return (settle(finishCgi()));
+	}
+	else if (events & POLLOUT && _state == ClientState::CGI_Stream)
+	{
+		logger.log(DEBUG, "ClientState::CGI_Stream");
+		return (settle(drainCgi(poll)));
+	}
+	else if (events & POLLOUT && _state == ClientState::Loading)
+	{
+		logger.log(DEBUG, "ClientState::Loading");
+		return (settle(loadRequest(poll)));
+	}
+	else if (events & POLLOUT && _state == ClientState::Handling)
+	{
+		logger.log(DEBUG, "ClientState::Handling");
+		return (settle(runHandler(poll)));
+	}
+	else if (events & POLLOUT && _state == ClientState::Waiting)
+	{
+		logger.log(DEBUG, "ClientState::Waiting");
+		return (settle(_file_manager.finishJob()));
+	}
+	else if (events & POLLOUT && _state == ClientState::Streaming)
+	{
+		logger.log(DEBUG, "ClientState::Streaming");
+		if (!_response.pending())
+		{
+			if (_file_manager.getResponse().empty())
+				return (settle(_file_manager.manageListing()));
+			_response.append(_file_manager.getResponse());
+			_file_manager.setResponse("");
+		}
+		_state = _response.stream(_socket.getFD());
 		return (_state);
 	}
-	catch (ReturnException &e)
+	else if (events & POLLOUT && _state == ClientState::Error)
+	{
+		logger.log(DEBUG, "ClientState::Error");
+		return (setErrorResponse(StatusCode::InternalServerError));
+	}
+	else if (events & POLLOUT && _state == ClientState::Sending)
 	{
-		logger.log(ERROR, "Return exception: " + std::string(e.what()));
-		_response.clear();
-		_file_manager.setResponse(e.what());
-		_file_manager.addToResponse("Location: " + e.getRedirection() +
-									"\r\n\r\n");
-		_state = ClientState::Sending;
+		logger.log(DEBUG, "ClientState::Sending");
+		_state = _response.send(_socket.getFD(), _file_manager.getResponse());
 		return (_state);
 	}
-	logger.log(DEBUG, "ClientState::UNKNOWN");
-	return (ClientState::Unknown);
+	return (settle(fail(StatusCode::BadRequest)));
 }
@@ -0,0 +1,47 @@
+#include <CompressionCache.hpp>
+#include <Logger.hpp>
+
+CompressionCache::CompressionCache() : _entries(), _index(), _size(0)
+{
+}
+
+CompressionCache::~CompressionCache()
+{
+}
+
+CompressionCache &CompressionCache::getInstance()
+{
+	static CompressionCache instance;
+	return (instance);
+}
+
+std::shared_ptr<const std::string>
+CompressionCache::find(const std::string &key)
+{
+	auto it = _index.find(key);
+
+	if (it == _index.end())
+		return (nullptr);
+	_entries.splice(_entries.begin(), _entries, it->second);
+	return (it->second->second);
+}
+
+void CompressionCache::store(const std::string &key, const std::string &body)
+{
+	Logger &logger = Logger::getInstance();
+
+	if (body.size() > COMPRESSION_CACHE_SIZE || _index.count(key) != 0)
+		return;
+	_entries.emplace_front(key, std::make_shared<const std::string>(body));
+	_index.emplace(key, _entries.begin());
+	_size += body.size();
+	while (_size > COMPRESSION_CACHE_SIZE)
+	{
+		const Entry &oldest = _entries.back();
+
+		logger.log(DEBUG, "CompressionCache: evicting " + oldest.first);
+		_size -= oldest.second->size();
+		_index.erase(oldest.first);
+		_entries.pop_back();
+	}
+}
@@ -0,0 +1,87 @@
+#include "Compressor.hpp"
+
+#include <zlib.h>
+
+#include <string>
+
+const std::string Compressor::codingToString(Coding coding)
+{
+	switch (coding)
+	{
+	case Coding::GZIP:
+		return ("gzip");
+	case Coding::DEFLATE:
+		return ("deflate");
+	default:
+		return ("identity");
+	}
+}
+
+// Deflates input into output in COMPRESS_CHUNK_SIZE steps, so the output
+// buffer grows with what was actually produced instead of the worst case.
+bool Compressor::compress(const std::string &input, std::string &output,
+						  Coding coding, int level)
+{
+	const int window_bits = (coding == Coding::GZIP) ? 15 + 16 : 15;
+	unsigned char chunk[COMPRESS_CHUNK_SIZE];
+	z_stream stream = {};
+	int ret;
+
+	if (deflateInit2(&stream, level, Z_DEFLATED, window_bits, 8,
+					 Z_DEFAULT_STRATEGY) != Z_OK)
+		return (false);
+	stream.next_in = (Bytef *)input.data();
+	stream.avail_in = input.size();
+	output.clear();
+	do
+	{
+		stream.next_out = chunk;
+		stream.avail_out = sizeof(chunk);
+		ret = deflate(&stream, Z_FINISH);
+		output.append((char *)chunk, sizeof(chunk) - stream.avail_out);
+	} while (ret == Z_OK);
+	deflateEnd(&stream);
+	return (ret == Z_STREAM_END);
+}
+
+Compressor::Stream::Stream(Coding coding, int level)
+	: _stream(std::make_unique<z_stream>()), _ready(false)
+{
+	const int window_bits = (coding == Coding::GZIP) ? 15 + 16 : 15;
+
+	_ready = deflateInit2(_stream.get(), level, Z_DEFLATED, window_bits, 8,
+						  Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+Compressor::Stream::~Stream()
+{
+	if (_ready)
+		deflateEnd(_stream.get());
+}
+
+// Appends input, deflated, to output and flushes it with Z_SYNC_FLUSH, or
+// ends the stream with finish. False once the stream is broken.
+bool Compressor::Stream::write(std::string_view input, std::string &output,
+							   bool finish)
+{
+	const int flush = finish ? Z_FINISH : Z_SYNC_FLUSH;
+	unsigned char chunk[COMPRESS_CHUNK_SIZE];
+	int ret;
+
+	if (!_ready)
+		return (false);
+	_stream->next_in = (Bytef *)input.data();
+	_stream->avail_in = input.size();
+	do
+	{
+		_stream->next_out = chunk;
+		_stream->avail_out = sizeof(chunk);
+		ret = deflate(_stream.get(), flush);
+		output.append((char *)chunk, sizeof(chunk) - _stream->avail_out);
+	} while (ret == Z_OK && _stream->avail_out == 0);
+	if (!finish)
+		return (ret == Z_OK || ret == Z_BUF_ERROR);
+	deflateEnd(_stream.get());
+	_ready = false;
+	return (ret == Z_STREAM_END);
+}
@@ -0,0 +1,154 @@
+#include <ErrorPages.hpp>
+#include <HTTPStatus.hpp>
+#include <HeaderWriter.hpp>
+#include <Logger.hpp>
+#include <MimeTypes.hpp>
+
+#include <sys/stat.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+static std::shared_ptr<const CannedResponse> makeCanned(StatusCode status_code,
+														const std::string &body)
+{
+	std::shared_ptr<CannedResponse> canned = std::make_shared<CannedResponse>();
+	HeaderWriter head;
+
+	head.add("Server", SERVER_SOFTWARE);
+	head.add("Content-Type", MimeTypes::fromExtension("html"));
+	head.add("Content-Length", body.size());
+	canned->status_line = HTTPStatus::statusLine(status_code);
+	canned->tail = head.finish();
+	canned->tail += body;
+	return (canned);
+}
+
+static bool readPage(const std::string &path, std::string &body)
+{
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	std::stringstream buffer;
+
+	if (!file.is_open())
+		return (false);
+	buffer << file.rdbuf();
+	if (file.bad())
+		return (false);
+	body = buffer.str();
+	return (true);
+}
+
+ErrorPages::ErrorPages() : _pages()
+{
+}
+
+ErrorPages::~ErrorPages()
+{
+}
+
+ErrorPages &ErrorPages::getInstance()
+{
+	static ErrorPages instance;
+	return (instance);
+}
+
+std::string ErrorPages::pagePath(const std::string &error_dir,
+								 StatusCode status_code)
+{
+	if (error_dir.empty())
+		return ("");
+	return (error_dir.substr(1) +
+			std::to_string(static_cast<int>(status_code)) + ".html");
+}
+
+// Loads every "<code>.html" in error_dir so the first error of each kind
+// doesn't touch the disk. Files that don't name a known 4xx/5xx status are
+// reported and left alone.
+void ErrorPages::preload(const std::string &error_dir)
+{
+	Logger &logger = Logger::getInstance();
+	std::error_code error;
+
+	if (error_dir.empty())
+		return;
+	for (const std::filesystem::directory_entry &entry :
+		 std::filesystem::directory_iterator(error_dir.substr(1), error))
+	{
+		const std::filesystem::path &path = entry.path();
+		const std::string stem = path.stem();
+		int code;
+
+		if (path.extension() != ".html")
+			continue;
+		if (stem.size() != 3 ||
+			stem.find_first_not_of("0123456789") != std::string::npos ||
+			(code = std::stoi(stem)) < 400 ||
+			!HTTPStatus::isKnown(static_cast<StatusCode>(code)))
+		{
+			logger.log(WARNING, "ErrorPages: ignoring %", path.string());
+			continue;
+		}
+		find(error_dir, static_cast<StatusCode>(code));
+	}
+	if (error)
+		logger.log(WARNING, "ErrorPages: % %", error_dir, error.message());
+}
+
+std::shared_ptr<const CannedResponse>
+ErrorPages::find(const std::string &error_dir, StatusCode status_code)
+{
+	const std::string path = pagePath(error_dir, status_code);
+	const std::string key =
+		error_dir + " " + std::to_string(static_cast<int>(status_code));
+	auto it = _pages.find(key);
+	const time_t now = time(nullptr);
+
+	if (it == _pages.end())
+	{
+		it = _pages.emplace(key, Page{nullptr, 0, 0, now}).first;
+		refresh(it->second, path, status_code);
+	}
+	else if (it->second.checked != now)
+	{
+		it->second.checked = now;
+		refresh(it->second, path, status_code);
+	}
+	return (it->second.response);
+}
+
+// Rebuilds the response when the page appeared, changed or disappeared.
+// A page that can't be used falls back to the generated status page.
+void ErrorPages::refresh(Page &page, const std::string &path,
+						 StatusCode status_code)
+{
+	Logger &logger = Logger::getInstance();
+	struct stat page_stat;
+	std::string body;
+
+	if (path.empty() || stat(path.c_str(), &page_stat) != 0 ||
+		!S_ISREG(page_stat.st_mode))
+	{
+		if (!page.response || page.mtime != 0)
+		{
+			HTTPStatus status(status_code);
+			page.response = makeCanned(status_code, status.getHTMLStatus());
+			page.mtime = 0;
+			page.size = 0;
+		}
+		return;
+	}
+	if (page.response && page.mtime == page_stat.st_mtime &&
+		page.size == page_stat.st_size)
+		return;
+	page.mtime = page_stat.st_mtime;
+	page.size = page_stat.st_size;
+	if (page_stat.st_size > ERROR_PAGE_MAX_SIZE || !readPage(path, body))
+	{
+		logger.log(WARNING, "ErrorPages: unusable page %", path);
+		body = HTTPStatus(status_code).getHTMLStatus();
+	}
+	else
+		logger.log(INFO, "ErrorPages: loaded %", path);
+	page.response = makeCanned(status_code, body);
+}
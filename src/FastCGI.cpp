@@ -0,0 +1,616 @@
+#include <CGIPool.hpp>
+#include <FastCGI.hpp>
+#include <Logger.hpp>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#define FASTCGI_HEADER_SIZE 8
+#define FASTCGI_RECORD_MAX 65535
+#define FASTCGI_READ_SIZE 65536
+
+#ifdef MSG_NOSIGNAL
+#define FASTCGI_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define FASTCGI_SEND_FLAGS 0
+#endif
+
+// Record types and flags of FastCGI 1.0.
+enum class RecordType : uint8_t
+{
+	BeginRequest = 1,
+	AbortRequest = 2,
+	EndRequest = 3,
+	Params = 4,
+	Stdin = 5,
+	Stdout = 6,
+	Stderr = 7,
+	Data = 8,
+	GetValues = 9,
+	GetValuesResult = 10,
+	UnknownType = 11,
+};
+
+#define FASTCGI_VERSION 1
+#define FASTCGI_RESPONDER 1
+#define FASTCGI_KEEP_CONN 1
+#define FASTCGI_REQUEST_COMPLETE 0
+
+static void appendRecord(std::string &out, RecordType type, uint16_t id,
+						 const char *content, size_t length)
+{
+	const size_t padding = (8 - length % 8) % 8;
+	const char header[FASTCGI_HEADER_SIZE] = {
+		FASTCGI_VERSION,
+		static_cast<char>(type),
+		static_cast<char>(id >> 8),
+		static_cast<char>(id & 0xff),
+		static_cast<char>(length >> 8),
+		static_cast<char>(length & 0xff),
+		static_cast<char>(padding),
+		0};
+
+	out.append(header, FASTCGI_HEADER_SIZE);
+	out.append(content, length);
+	out.append(padding, '\0');
+}
+
+// A stream is split into records and closed by an empty one.
+static void appendStream(std::string &out, RecordType type, uint16_t id,
+						 const std::string &data)
+{
+	for (size_t i = 0; i < data.size(); i += FASTCGI_RECORD_MAX)
+		appendRecord(out, type, id, data.data() + i,
+					 std::min<size_t>(data.size() - i, FASTCGI_RECORD_MAX));
+	appendRecord(out, type, id, nullptr, 0);
+}
+
+// Name-value pair lengths take one byte below 128 and four bytes with the
+// high bit set otherwise.
+static void appendLength(std::string &out, size_t length)
+{
+	if (length < 128)
+	{
+		out += static_cast<char>(length);
+		return;
+	}
+	out += static_cast<char>(0x80 | ((length >> 24) & 0x7f));
+	out += static_cast<char>((length >> 16) & 0xff);
+	out += static_cast<char>((length >> 8) & 0xff);
+	out += static_cast<char>(length & 0xff);
+}
+
+static bool readLength(const unsigned char *&ptr, const unsigned char *end,
+					   size_t &length)
+{
+	if (ptr >= end)
+		return (false);
+	if (*ptr < 128)
+	{
+		length = *ptr++;
+		return (true);
+	}
+	if (end - ptr < 4)
+		return (false);
+	length = (static_cast<size_t>(ptr[0] & 0x7f) << 24) |
+			 (static_cast<size_t>(ptr[1]) << 16) |
+			 (static_cast<size_t>(ptr[2]) << 8) | ptr[3];
+	ptr += 4;
+	return (true);
+}
+
+// Starts a non-blocking connect to "unix:<path>" or "<host>:<port>". The
+// result is known once the socket turns writable.
+static int connectBackend(const std::string &backend)
+{
+	struct sockaddr_un unix_addr;
+	struct addrinfo hints;
+	struct addrinfo *info = nullptr;
+	const struct sockaddr *addr;
+	socklen_t addr_length;
+	int fd;
+
+	if (backend.compare(0, 5, "unix:") == 0)
+	{
+		const std::string path = backend.substr(5);
+
+		if (path.size() >= sizeof(unix_addr.sun_path))
+			return (-1);
+		std::memset(&unix_addr, 0, sizeof(unix_addr));
+		unix_addr.sun_family = AF_UNIX;
+		std::memcpy(unix_addr.sun_path, path.c_str(), path.size() + 1);
+		addr = reinterpret_cast<const struct sockaddr *>(&unix_addr);
+		addr_length = sizeof(unix_addr);
+	}
+	else
+	{
+		const size_t colon = backend.find_last_of(':');
+
+		std::memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = AI_NUMERICSERV;
+		if (getaddrinfo(backend.substr(0, colon).c_str(),
+						backend.substr(colon + 1).c_str(), &hints,
+						&info) != 0)
+			return (-1);
+		addr = info->ai_addr;
+		addr_length = info->ai_addrlen;
+	}
+	fd = socket(addr->sa_family, SOCK_STREAM, 0);
+	if (fd != -1 && (fcntl(fd, F_SETFL, O_NONBLOCK) == -1 ||
+					 fcntl(fd, F_SETFD, FD_CLOEXEC) == -1 ||
+					 (connect(fd, addr, addr_length) == -1 &&
+					  errno != EINPROGRESS)))
+	{
+		close(fd);
+		fd = -1;
+	}
+#ifdef SO_NOSIGPIPE
+	const int on = 1;
+
+	if (fd != -1)
+		setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+	if (info != nullptr)
+		freeaddrinfo(info);
+	return (fd);
+}
+
+FastCGI::FastCGI() : _connections(), _backends(), _completed(), _next_check(0)
+{
+}
+
+FastCGI::~FastCGI()
+{
+	for (const auto &entry : _connections)
+		close(entry.first);
+}
+
+FastCGI &FastCGI::getInstance()
+{
+	static FastCGI instance;
+	return (instance);
+}
+
+std::string FastCGI::encodeParams(const Params &params)
+{
+	std::string out;
+
+	for (const auto &param : params)
+	{
+		appendLength(out, param.first.size());
+		appendLength(out, param.second.size());
+		out += param.first;
+		out += param.second;
+	}
+	return (out);
+}
+
+// Asks for FCGI_MPXS_CONNS and FCGI_MAX_REQS, on a new connection and as
+// the liveness probe of a pool worker.
+static void appendValuesQuery(std::string &out)
+{
+	const std::string query = FastCGI::encodeParams(
+		{{"FCGI_MPXS_CONNS", ""}, {"FCGI_MAX_REQS", ""}});
+
+	appendRecord(out, RecordType::GetValues, 0, query.data(), query.size());
+}
+
+// Queues a request for backend. If it can't be reached the request comes
+// back done and failed, as it does once it answered more than max_output
+// (FASTCGI_MAX_OUTPUT at most, or if it's 0).
+std::shared_ptr<FastCGIRequest>
+FastCGI::submit(Poll &poll, const std::string &backend, int client_fd,
+				std::string params, std::string body, size_t max_output)
+{
+	std::shared_ptr<FastCGIRequest> request =
+		std::make_shared<FastCGIRequest>(FastCGIRequest{
+			client_fd, std::move(params), std::move(body), "",
+			max_output != 0 ? std::min<size_t>(max_output, FASTCGI_MAX_OUTPUT)
+							: FASTCGI_MAX_OUTPUT,
+			false, false});
+
+	_backends[backend].waiting.push_back(request);
+	dispatch(poll, backend);
+	return (request);
+}
+
+// Withdraws a request its client gave up on. A pool worker still running it
+// is killed and replaced, a backend is asked to abort it and what it still
+// sends is discarded; a request that is still waiting is left to dispatch().
+void FastCGI::abort(Poll &poll, const std::shared_ptr<FastCGIRequest> &request)
+{
+	for (auto &entry : _connections)
+	{
+		for (const auto &carried : entry.second.requests)
+		{
+			if (carried.second != request)
+				continue;
+			if (entry.second.pid != -1)
+				return (drop(poll, entry.first));
+			appendRecord(entry.second.out, RecordType::AbortRequest,
+						 carried.first, nullptr, 0);
+			poll.setEvents(entry.first, POLLIN | POLLOUT);
+			return;
+		}
+	}
+}
+
+// Registers a cgi_pool and starts its workers, so the first requests
+// already find warm interpreters.
+void FastCGI::addPool(Poll &poll, const std::string &name, size_t workers,
+					  size_t max_requests, size_t max_age)
+{
+	Backend &pool = _backends[name];
+
+	if (pool.workers != 0)
+		return;
+	CGIPool::checkWorker();
+	pool.workers = workers;
+	pool.max_requests = max_requests;
+	pool.max_age = max_age;
+	while (pool.connections.size() < pool.workers && open(poll, name) != -1)
+		;
+}
+
+bool FastCGI::owns(int fd) const
+{
+	return (_connections.find(fd) != _connections.end());
+}
+
+void FastCGI::handleEvents(Poll &poll, int fd, short revents)
+{
+	Logger &logger = Logger::getInstance();
+	auto it = _connections.find(fd);
+
+	if (it == _connections.end())
+		return;
+
+	Connection &conn = it->second;
+	const std::string backend = conn.backend;
+
+	if (revents & (POLLERR | POLLNVAL))
+		return (drop(poll, fd));
+	if (!conn.connected && (revents & (POLLOUT | POLLHUP)))
+	{
+		int error = 0;
+		socklen_t length = sizeof(error);
+
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == -1 ||
+			error != 0)
+		{
+			logger.log(WARNING, "FastCGI: connect to %: %", backend,
+					   std::strerror(error));
+			return (drop(poll, fd));
+		}
+		conn.connected = true;
+	}
+	if ((revents & POLLOUT) && !flush(fd, conn))
+		return (drop(poll, fd));
+	if ((revents & (POLLIN | POLLHUP)) && !receive(fd, conn))
+		return (drop(poll, fd));
+	if (retires(conn, time(nullptr)))
+		return (drop(poll, fd));
+	poll.setEvents(fd, conn.out.empty() ? POLLIN : POLLIN | POLLOUT);
+	dispatch(poll, backend);
+}
+
+// Called every round of the event loop. Every CGI_POOL_CHECK_INTERVAL
+// seconds an idle pool worker is asked for its FCGI_GET_VALUES, and one
+// that still owes the answer to the last probe is taken for hung and
+// replaced, as is an idle one that is due to retire.
+void FastCGI::checkWorkers(Poll &poll)
+{
+	Logger &logger = Logger::getInstance();
+	const time_t now = time(nullptr);
+	std::vector<int> hung;
+
+	if (now < _next_check)
+		return;
+	_next_check = now + CGI_POOL_CHECK_INTERVAL;
+	for (auto &entry : _connections)
+	{
+		Connection &conn = entry.second;
+
+		if (conn.pid == -1)
+			continue;
+		if (conn.probed != 0 || retires(conn, now))
+		{
+			if (conn.probed != 0)
+				logger.log(WARNING, "FastCGI: worker % of % hung", conn.pid,
+						   conn.backend);
+			hung.push_back(entry.first);
+			continue;
+		}
+		if (!conn.requests.empty())
+			continue;
+		appendValuesQuery(conn.out);
+		conn.probed = now;
+		poll.setEvents(entry.first, POLLIN | POLLOUT);
+	}
+	for (int fd : hung)
+		drop(poll, fd);
+}
+
+std::vector<int> FastCGI::collectCompleted(void)
+{
+	std::vector<int> completed;
+
+	completed.swap(_completed);
+	return (completed);
+}
+
+// A new connection asks whether the backend multiplexes before it takes a
+// second request.
+int FastCGI::open(Poll &poll, const std::string &backend)
+{
+	Logger &logger = Logger::getInstance();
+	const Backend &pool = _backends[backend];
+	pid_t pid = -1;
+	const int fd =
+		pool.workers != 0 ? CGIPool::spawn(poll, pid) : connectBackend(backend);
+
+	if (fd == -1)
+	{
+		logger.log(WARNING, "FastCGI: can't connect to %: %", backend,
+				   std::strerror(errno));
+		return (-1);
+	}
+	_connections.emplace(fd, Connection{backend, pid, pid != -1, false, 1, 0,
+										time(nullptr), 0, "", 0, "", {}});
+	appendValuesQuery(_connections.at(fd).out);
+	_backends[backend].connections.push_back(fd);
+	poll.addPollFD(fd, POLLOUT);
+	logger.log(DEBUG, "FastCGI: connection % to % (pid %)", fd, backend, pid);
+	return (fd);
+}
+
+// Hands waiting requests to the least busy connection with a free request
+// ID, opening connections up to FASTCGI_MAX_CONNECTIONS or the pool size.
+// Requests whose client is gone are dropped on the way.
+void FastCGI::dispatch(Poll &poll, const std::string &backend)
+{
+	Backend &pool = _backends[backend];
+	const size_t max_connections =
+		pool.workers != 0 ? pool.workers : FASTCGI_MAX_CONNECTIONS;
+
+	while (!pool.waiting.empty())
+	{
+		int fd = -1;
+		size_t load = FASTCGI_MAX_REQUESTS;
+
+		if (pool.waiting.front().use_count() == 1)
+		{
+			pool.waiting.pop_front();
+			continue;
+		}
+		for (int candidate : pool.connections)
+		{
+			const Connection &conn = _connections.at(candidate);
+
+			if (conn.requests.size() < conn.max_requests &&
+				conn.requests.size() < load)
+			{
+				fd = candidate;
+				load = conn.requests.size();
+			}
+		}
+		if (fd == -1 && pool.connections.size() < max_connections)
+			fd = open(poll, backend);
+		if (fd == -1 && pool.connections.empty())
+		{
+			for (const std::shared_ptr<FastCGIRequest> &request : pool.waiting)
+				finish(request, true);
+			pool.waiting.clear();
+		}
+		if (fd == -1)
+			return;
+		assign(poll, fd, pool.waiting.front());
+		pool.waiting.pop_front();
+	}
+}
+
+void FastCGI::assign(Poll &poll, int fd,
+					 std::shared_ptr<FastCGIRequest> request)
+{
+	Connection &conn = _connections.at(fd);
+	const char begin[8] = {0, FASTCGI_RESPONDER, FASTCGI_KEEP_CONN, 0, 0, 0,
+						   0, 0};
+	uint16_t id = 1;
+
+	while (conn.requests.count(id) != 0)
+		id++;
+	appendRecord(conn.out, RecordType::BeginRequest, id, begin, sizeof(begin));
+	appendStream(conn.out, RecordType::Params, id, request->params);
+	appendStream(conn.out, RecordType::Stdin, id, request->body);
+	std::string().swap(request->params);
+	std::string().swap(request->body);
+	conn.requests.emplace(id, std::move(request));
+	poll.setEvents(fd, POLLIN | POLLOUT);
+}
+
+bool FastCGI::flush(int fd, Connection &conn)
+{
+	const ssize_t sent =
+		send(fd, conn.out.data() + conn.out_sent,
+			 conn.out.size() - conn.out_sent, FASTCGI_SEND_FLAGS);
+
+	if (sent == -1)
+		return (errno == EAGAIN || errno == EWOULDBLOCK);
+	conn.out_sent += sent;
+	if (conn.out_sent == conn.out.size())
+	{
+		conn.out.clear();
+		conn.out_sent = 0;
+	}
+	return (true);
+}
+
+// Reads what the backend sent and handles every complete record. False once
+// the connection is closed or broken.
+bool FastCGI::receive(int fd, Connection &conn)
+{
+	char buffer[FASTCGI_READ_SIZE];
+	const ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+	size_t pos = 0;
+
+	if (received == 0)
+		return (false);
+	if (received == -1)
+		return (errno == EAGAIN || errno == EWOULDBLOCK);
+	conn.in.append(buffer, received);
+	while (conn.in.size() - pos >= FASTCGI_HEADER_SIZE)
+	{
+		const unsigned char *header =
+			reinterpret_cast<const unsigned char *>(conn.in.data() + pos);
+		const size_t length = header[4] << 8 | header[5];
+		const size_t record = FASTCGI_HEADER_SIZE + length + header[6];
+
+		if (header[0] != FASTCGI_VERSION)
+			return (false);
+		if (conn.in.size() - pos < record)
+			break;
+		handleRecord(conn, header[1], header[2] << 8 | header[3],
+					 conn.in.data() + pos + FASTCGI_HEADER_SIZE, length);
+		pos += record;
+	}
+	conn.in.erase(0, pos);
+	return (true);
+}
+
+void FastCGI::handleRecord(Connection &conn, uint8_t type, uint16_t id,
+						   const char *content, size_t length)
+{
+	Logger &logger = Logger::getInstance();
+	auto it = conn.requests.find(id);
+
+	switch (static_cast<RecordType>(type))
+	{
+	case RecordType::Stdout:
+		if (it == conn.requests.end())
+			break;
+		if (it->second->output.size() + length > it->second->max_output)
+			it->second->failed = true;
+		else
+			it->second->output.append(content, length);
+		break;
+	case RecordType::Stderr:
+		if (length != 0)
+			logger.log(WARNING, "FastCGI %: %", conn.backend,
+					   std::string(content, length));
+		break;
+	case RecordType::EndRequest:
+		if (it == conn.requests.end())
+			break;
+		finish(it->second, it->second->failed || length < 5 ||
+							   content[4] != FASTCGI_REQUEST_COMPLETE);
+		conn.requests.erase(it);
+		conn.served++;
+		break;
+	case RecordType::GetValuesResult:
+	{
+		const unsigned char *ptr =
+			reinterpret_cast<const unsigned char *>(content);
+		const unsigned char *end = ptr + length;
+		size_t name_length;
+		size_t value_length;
+		bool multiplexes = false;
+		size_t max_requests = FASTCGI_MAX_REQUESTS;
+
+		while (readLength(ptr, end, name_length) &&
+			   readLength(ptr, end, value_length) &&
+			   static_cast<size_t>(end - ptr) >= name_length + value_length)
+		{
+			const std::string name(reinterpret_cast<const char *>(ptr),
+								   name_length);
+			const std::string value(
+				reinterpret_cast<const char *>(ptr) + name_length,
+				value_length);
+
+			if (name == "FCGI_MPXS_CONNS")
+				multiplexes = value == "1";
+			else if (name == "FCGI_MAX_REQS" && !value.empty() &&
+					 value.find_first_not_of("0123456789") ==
+						 std::string::npos &&
+					 value.size() < 6)
+				max_requests = std::stoul(value);
+			ptr += name_length + value_length;
+		}
+		conn.healthy = true;
+		conn.probed = 0;
+		if (multiplexes)
+			conn.max_requests =
+				std::clamp<size_t>(max_requests, 1, FASTCGI_MAX_REQUESTS);
+		logger.log(DEBUG, "FastCGI %: % requests per connection",
+				   conn.backend, conn.max_requests);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+// Wakes the client of request unless it went away in the meantime, in which
+// case only the connection or the queue still holds it.
+void FastCGI::finish(const std::shared_ptr<FastCGIRequest> &request,
+					 bool failed)
+{
+	request->done = true;
+	request->failed = failed;
+	if (request.use_count() > 1)
+		_completed.push_back(request->client_fd);
+}
+
+// Whether conn is an idle pool worker that served its max_requests or ran
+// for its max_age.
+bool FastCGI::retires(const Connection &conn, time_t now) const
+{
+	const Backend &pool = _backends.at(conn.backend);
+
+	if (conn.pid == -1 || !conn.requests.empty() || !conn.healthy)
+		return (false);
+	if (conn.served < pool.max_requests &&
+		now - conn.started < static_cast<time_t>(pool.max_age))
+		return (false);
+	Logger::getInstance().log(DEBUG, "FastCGI: retiring worker % of %",
+							  conn.pid, conn.backend);
+	return (true);
+}
+
+// Fails the requests a connection was carrying and gives its slots to the
+// requests still waiting. A pool worker that had answered its handshake is
+// replaced right away; one that never did is only retried on demand, so a
+// broken interpreter doesn't respawn in a loop.
+void FastCGI::drop(Poll &poll, int fd)
+{
+	Logger &logger = Logger::getInstance();
+	Connection conn = std::move(_connections.at(fd));
+	Backend &pool = _backends[conn.backend];
+	std::vector<int> &connections = pool.connections;
+
+	_connections.erase(fd);
+	connections.erase(std::remove(connections.begin(), connections.end(), fd),
+					  connections.end());
+	logger.log(conn.requests.empty() ? DEBUG : WARNING,
+			   "FastCGI: connection % to % closed with % requests", fd,
+			   conn.backend, conn.requests.size());
+	for (const auto &entry : conn.requests)
+		finish(entry.second, true);
+	poll.removeFD(fd);
+	close(fd);
+	if (conn.pid != -1)
+		CGIPool::stop(poll, conn.pid);
+	dispatch(poll, conn.backend);
+	while (conn.healthy && connections.size() < pool.workers &&
+		   open(poll, conn.backend) != -1)
+		;
+}
@@ -1,16 +1,492 @@
 #include "FileManager.hpp"
 #include "AutoIndexGenerator.hpp"
-#include "ClientException.hpp"
+#include "CGI.hpp"
+#include "AutoIndexStream.hpp"
+#include "CGICache.hpp"
+#include "Client.hpp"
+#include "CompressionCache.hpp"
+#include "HTTPDate.hpp"
+#include "HeaderWriter.hpp"
+#include "ListingCache.hpp"
 #include "Logger.hpp"
-#include "ReturnException.hpp"
+#include "MimeTypes.hpp"
+#include "MissCache.hpp"
+#include "MultipartParser.hpp"
 #include "StatusCode.hpp"
+#include "SystemException.hpp"
+#include "WorkerPool.hpp"
 
-#include <filesystem>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
 #include <string>
 
+// Strong validator built from the identity and version of the file:
+// "<inode>-<size>-<mtime>" in hex.
+static std::string makeETag(const struct stat &target_stat)
+{
+	std::stringstream ss;
+
+	ss << std::hex << '"' << target_stat.st_ino << '-' << target_stat.st_size
+	   << '-' << target_stat.st_mtime << '"';
+	return (ss.str());
+}
+
+static std::string trim(const std::string &str)
+{
+	const size_t begin = str.find_first_not_of(" \t");
+
+	if (begin == std::string::npos)
+		return ("");
+	return (str.substr(begin, str.find_last_not_of(" \t") - begin + 1));
+}
+
+// Returns the weight the client gave to coding in Accept-Encoding, an exact
+// match overrides a wildcard. 0 means not acceptable.
+static float acceptedQuality(const std::string &accept_encoding,
+							 const std::string &coding)
+{
+	std::stringstream ss(accept_encoding);
+	std::string element;
+	float wildcard = 0;
+
+	while (std::getline(ss, element, ','))
+	{
+		const size_t semicolon = element.find(';');
+		const std::string name = trim(element.substr(0, semicolon));
+		float quality = 1;
+
+		if (semicolon != std::string::npos)
+		{
+			const size_t q = element.find("q=", semicolon);
+			if (q != std::string::npos)
+				quality = std::strtof(element.c_str() + q + 2, nullptr);
+		}
+		if (name == coding)
+			return (quality);
+		if (name == "*")
+			wildcard = quality;
+	}
+	return (wildcard);
+}
+
+// Swaps path/target_stat for a precompressed sidecar when the client accepts
+// its coding and the sidecar is at least as new as the original. Returns the
+// chosen content-coding, or an empty string to serve the original.
+static std::string selectSidecar(const std::string &accept_encoding,
+								 std::string &path, struct stat &target_stat)
+{
+	static const std::pair<std::string, std::string> sidecars[] = {
+		{"br", ".br"}, {"gzip", ".gz"}};
+	const std::pair<std::string, std::string> *best = nullptr;
+	float best_quality = 0;
+	struct stat best_stat;
+
+	if (accept_encoding.empty())
+		return ("");
+	for (const auto &sidecar : sidecars)
+	{
+		struct stat sidecar_stat;
+		const float quality = acceptedQuality(accept_encoding, sidecar.first);
+
+		if (quality <= best_quality)
+			continue;
+		if (stat((path + sidecar.second).c_str(), &sidecar_stat) != 0 ||
+			!S_ISREG(sidecar_stat.st_mode) ||
+			sidecar_stat.st_mtime < target_stat.st_mtime)
+			continue;
+		best = &sidecar;
+		best_quality = quality;
+		best_stat = sidecar_stat;
+	}
+	if (best == nullptr)
+		return ("");
+	path += best->second;
+	target_stat = best_stat;
+	return (best->first);
+}
+
+static void addValidators(HeaderWriter &head, const std::string &etag,
+						  const std::string &last_modified, bool vary)
+{
+	head.add("ETag", etag);
+	head.add("Last-Modified", last_modified);
+	if (vary)
+		head.add("Vary", "Accept-Encoding");
+}
+
+// The blocking halves of the requests below. They run on the WorkerPool and
+// only touch the job they are given.
+
+struct FileLookup
+{
+	std::string path;
+	std::string accept_encoding;
+	bool gzip_static;
+	bool found;
+	struct stat target_stat;
+	std::string served_path;
+	std::string content_encoding;
+};
+
+struct FileTransfer
+{
+	std::string path;
+	std::string body;
+	bool created;
+	bool succeeded;
+};
+
+struct ListingBatch
+{
+	std::string chunk;
+	bool more;
+};
+
+static void lookupFile(FileLookup &lookup)
+{
+	lookup.found = stat(lookup.path.c_str(), &lookup.target_stat) == 0;
+	lookup.served_path = lookup.path;
+	if (lookup.found && lookup.gzip_static)
+		lookup.content_encoding = selectSidecar(
+			lookup.accept_encoding, lookup.served_path, lookup.target_stat);
+}
+
+static void readFile(FileTransfer &transfer)
+{
+	std::ifstream file(transfer.path, std::ios::in | std::ios::binary);
+	struct stat file_stat;
+
+	transfer.succeeded = false;
+	if (!file.is_open() || stat(transfer.path.c_str(), &file_stat) != 0)
+		return;
+	transfer.body.resize(file_stat.st_size);
+	file.read(transfer.body.data(), transfer.body.size());
+	transfer.body.resize(file.gcount());
+	transfer.succeeded = !file.bad();
+}
+
+static void writeFile(FileTransfer &transfer)
+{
+	struct stat file_stat;
+
+	transfer.created = stat(transfer.path.c_str(), &file_stat) != 0;
+	std::ofstream file(transfer.path,
+					   std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!file.is_open())
+	{
+		transfer.succeeded = false;
+		return;
+	}
+	file.write(transfer.body.data(), transfer.body.size());
+	file.close();
+	transfer.succeeded = !file.fail();
+}
+
+static void removeFile(FileTransfer &transfer)
+{
+	transfer.succeeded = std::remove(transfer.path.c_str()) == 0;
+}
+
+static bool writeAll(int fd, const char *data, size_t size)
+{
+	while (size > 0)
+	{
+		ssize_t written = write(fd, data, size);
+
+		if (written == SYSTEM_ERROR)
+			return (false);
+		data += written;
+		size -= written;
+	}
+	return (true);
+}
+
+static bool writeAt(int fd, const char *data, size_t size, off_t &offset)
+{
+	while (size > 0)
+	{
+		ssize_t written = pwrite(fd, data, size, offset);
+
+		if (written == SYSTEM_ERROR)
+			return (false);
+		data += written;
+		size -= written;
+		offset += written;
+	}
+	return (true);
+}
+
+// Routes the file parts of a multipart/form-data body to files of their own
+// in dir, named after their filename parameter. Fields without a filename
+// aren't files and are dropped.
+struct PartWriter
+{
+	std::string dir;
+	int fd;
+	bool created;
+	bool failed;
+	MultipartParser parser;
+
+	PartWriter(const std::string &boundary)
+		: dir(), fd(-1), created(false), failed(false),
+		  parser(boundary,
+				 [this](const MultipartParser::Part &part) { open(part); },
+				 [this](const char *data, size_t size) { write(data, size); })
+	{
+	}
+
+	~PartWriter()
+	{
+		if (fd != -1)
+			close(fd);
+	}
+
+	void open(const MultipartParser::Part &part);
+	void write(const char *data, size_t size);
+};
+
+// A request body received straight into its target file, see
+// FileManager::openUpload(). The descriptors close with the last owner, so a
+// client that disconnects mid-upload doesn't leak them.
+struct FileUpload
+{
+	std::string path;
+	std::string partial;
+	std::string received;
+	size_t remaining;
+	off_t offset;
+	size_t total;
+	size_t committed;
+	int fd;
+	int pipe[2];
+	bool query;
+	bool created;
+	bool succeeded;
+	bool malformed;
+	bool unsatisfiable;
+	std::unique_ptr<PartWriter> parts;
+
+	FileUpload()
+		: remaining(0), offset(0), total(0), committed(0), fd(-1),
+		  pipe{-1, -1}, query(false), created(false), succeeded(false),
+		  malformed(false), unsatisfiable(false), parts()
+	{
+	}
+
+	~FileUpload()
+	{
+		if (fd != -1)
+			close(fd);
+		if (pipe[READ_END] != -1)
+			close(pipe[READ_END]);
+		if (pipe[WRITE_END] != -1)
+			close(pipe[WRITE_END]);
+	}
+};
+
+// Client supplied filenames may carry a path; only the last component is
+// used so a part can't be written outside dir.
+void PartWriter::open(const MultipartParser::Part &part)
+{
+	const size_t slash = part.filename.find_last_of("/\\");
+	const std::string name = part.filename.substr(
+		slash == std::string::npos ? 0 : slash + 1);
+	const std::string path = dir + name;
+	struct stat file_stat;
+
+	if (fd != -1)
+		close(fd);
+	fd = -1;
+	if (failed || name.empty() || name == "." || name == "..")
+		return;
+	created = stat(path.c_str(), &file_stat) != 0 || created;
+	fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	failed = fd == SYSTEM_ERROR;
+}
+
+void PartWriter::write(const char *data, size_t size)
+{
+	if (fd != -1 && !failed)
+		failed = !writeAll(fd, data, size);
+}
+
+// Parts are stored in the directory the request target names, or next to the
+// file it names.
+static std::string partDirectory(const std::string &path)
+{
+	struct stat dir_stat;
+
+	if (stat(path.c_str(), &dir_stat) == 0 && S_ISDIR(dir_stat.st_mode))
+		return (path.back() == '/' ? path : path + '/');
+	return (path.substr(0, path.find_last_of('/') + 1));
+}
+
+// Reserves the length bytes from the current offset so the file is laid out
+// in one go and a full disk fails before any data is read, then writes the
+// bytes that arrived together with the headers.
+static bool startBody(FileUpload &upload, size_t length)
+{
+#ifdef __linux__
+	if (length > 0 &&
+		fallocate(upload.fd, FALLOC_FL_KEEP_SIZE, upload.offset, length) ==
+			SYSTEM_ERROR &&
+		errno == ENOSPC)
+		return (false);
+	if (pipe2(upload.pipe, O_NONBLOCK | O_CLOEXEC) == SYSTEM_ERROR)
+		return (false);
+#else
+	(void)length;
+#endif
+	const bool written = writeAt(upload.fd, upload.received.data(),
+								 upload.received.size(), upload.offset);
+
+	upload.received.clear();
+	return (written);
+}
+
+// A resumable upload is staged in a hidden file next to the target, named
+// after it and the total size. The size of that file is the committed
+// length, so the staging file is all the state there is and an upload
+// survives a restart of the server.
+static std::string partialPath(const std::string &path, size_t total)
+{
+	const size_t name = path.find_last_of('/') + 1;
+
+	return (path.substr(0, name) + "." + path.substr(name) + "." +
+			std::to_string(total) + ".part");
+}
+
+// Chunks may overlap what is already committed but not leave a hole. Only a
+// chunk starting at 0 may create the staging file, so a retry arriving after
+// the upload was finalized doesn't leave an empty one behind.
+static void openPartial(FileUpload &upload)
+{
+	struct stat file_stat;
+
+	if (upload.query)
+	{
+		if (stat(upload.partial.c_str(), &file_stat) == 0)
+			upload.committed = file_stat.st_size;
+		else if (stat(upload.path.c_str(), &file_stat) == 0 &&
+				 static_cast<size_t>(file_stat.st_size) == upload.total)
+			upload.committed = upload.total;
+		upload.succeeded = true;
+		return;
+	}
+	upload.fd = open(upload.partial.c_str(),
+					 O_WRONLY | O_CLOEXEC | (upload.offset == 0 ? O_CREAT : 0),
+					 0644);
+	if (upload.fd == SYSTEM_ERROR && upload.offset > 0)
+	{
+		upload.unsatisfiable = stat(upload.partial.c_str(), &file_stat) != 0;
+		return;
+	}
+	if (upload.fd == SYSTEM_ERROR || fstat(upload.fd, &file_stat) != 0)
+		return;
+	upload.committed = file_stat.st_size;
+	if (static_cast<size_t>(upload.offset) > upload.committed)
+	{
+		upload.unsatisfiable = true;
+		return;
+	}
+	upload.succeeded = startBody(upload, upload.total - upload.offset);
+}
+
+// The staging file only replaces the target once its data is on disk, so a
+// crash leaves either the old target or the complete new one.
+static void finalizeUpload(FileUpload &upload)
+{
+	struct stat file_stat;
+
+	upload.created = stat(upload.path.c_str(), &file_stat) != 0;
+	upload.succeeded =
+		fsync(upload.fd) == 0 &&
+		std::rename(upload.partial.c_str(), upload.path.c_str()) == 0;
+}
+
+// Creates the target of a plain upload. A multipart body only has the bytes
+// that arrived with the headers parsed; its files open per part.
+static void createUpload(FileUpload &upload)
+{
+	struct stat file_stat;
+
+	if (upload.parts)
+	{
+		upload.parts->dir = partDirectory(upload.path);
+		upload.malformed = !upload.parts->parser.feed(upload.received.data(),
+													  upload.received.size());
+		upload.succeeded = !upload.malformed && !upload.parts->failed;
+		upload.received.clear();
+		return;
+	}
+	if (!upload.partial.empty())
+	{
+		openPartial(upload);
+		return;
+	}
+	upload.created = stat(upload.path.c_str(), &file_stat) != 0;
+	upload.fd = open(upload.path.c_str(),
+					 O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (upload.fd == SYSTEM_ERROR)
+		return;
+	upload.succeeded =
+		startBody(upload, upload.received.size() + upload.remaining);
+}
+
+static bool parseSize(const std::string &str, size_t &value)
+{
+	const char *end = str.data() + str.size();
+	const std::from_chars_result result =
+		std::from_chars(str.data(), end, value);
+
+	return (!str.empty() && result.ec == std::errc() && result.ptr == end);
+}
+
+// Content-Range of a resumable chunk, "bytes <first>-<last>/<total>", or
+// "bytes */<total>" with an empty body to ask how much has been committed.
+// Yields the offset of the chunk.
+static Outcome<off_t> parseContentRange(const std::string &value,
+										size_t length, FileUpload &upload)
+{
+	const size_t slash = value.find('/');
+	const size_t dash = value.find('-');
+	size_t first;
+	size_t last;
+
+	if (value.compare(0, 6, "bytes ") != 0 || slash == std::string::npos ||
+		!parseSize(value.substr(slash + 1), upload.total) || upload.total == 0)
+		return (fail(StatusCode::BadRequest));
+	if (value.compare(6, slash - 6, "*") == 0)
+	{
+		if (length != 0)
+			return (fail(StatusCode::BadRequest));
+		upload.query = true;
+		return (0);
+	}
+	if (dash == std::string::npos || dash > slash ||
+		!parseSize(value.substr(6, dash - 6), first) ||
+		!parseSize(value.substr(dash + 1, slash - dash - 1), last))
+		return (fail(StatusCode::BadRequest));
+	if (last < first || last >= upload.total)
+		return (fail(StatusCode::RangeNotSatisfiable));
+	if (last - first + 1 != length)
+		return (fail(StatusCode::BadRequest));
+	return (static_cast<off_t>(first));
+}
+
 FileManager::FileManager()
-	: _response(), _request_target(), _serversetting(), _autoindex(false),
-	  _bytes_sent(0)
+	: _response(), _serversetting(), _autoindex(false), _client_fd(-1), _job(),
+	  _listing(), _upload(), _cgi_remaining(0), _cgi_deflate(),
+	  _cgi_cache_key(), _cgi_cache_ttl(0), _cgi_cache_stale(0),
+	  _cgi_cache_head(), _cgi_cache_body()
 {
 }
 
@@ -18,17 +494,20 @@ FileManager::~FileManager()
 {
 }
 
-std::string FileManager::resolveRequestTarget(const std::string &request_target)
+Outcome<std::string>
+FileManager::resolveRequestTarget(const std::string &request_target)
 {
 	Logger &logger = Logger::getInstance();
-
-	const LocationSettings &loc =
+	const Outcome<const LocationSettings *> resolved =
 		_serversetting.resolveLocation(request_target);
+
+	if (!resolved)
+		return (resolved.failure());
+
+	const LocationSettings &loc = **resolved;
 	const std::string root = _serversetting.getRoot().substr(1);
 
 	logger.log(DEBUG, "resolveRequestTarget:\t" + root + " " + request_target);
-	if (!loc.getRedirect().empty())
-		throw ReturnException(StatusCode::Found, loc);
 
 	if (request_target.back() != '/')
 		return (root + loc.resolveAlias(request_target));
@@ -39,191 +518,886 @@ std::string FileManager::resolveRequestTarget(const std::string &request_target)
 						  (loc.getAutoIndex() ? std::string(" ON")
 											  : std::string(" OFF")));
 	if (loc.getAutoIndex() == false)
-		throw ClientException(StatusCode::UnAuthorized);
-	const std::string AI_target = root + loc.resolveAlias(request_target);
-	_request_target =
-		AutoIndexGenerator::OpenAutoIndex(AI_target, request_target);
+		return (fail(StatusCode::UnAuthorized));
 	_autoindex = true;
-	return (AI_target);
+	return (root + loc.resolveAlias(request_target));
 }
 
-void FileManager::openGetFile(const std::string &request_target_path)
+// If-None-Match takes precedence over If-Modified-Since (RFC 9110 13.2.2).
+bool FileManager::isNotModified(const HTTPRequest &request,
+								const std::string &etag,
+								time_t last_modified) const
 {
-	Logger &logger = Logger::getInstance();
+	if (request.hasHeader("If-None-Match"))
+	{
+		std::stringstream ss(request.getHeader("If-None-Match"));
+		std::string candidate;
 
-	logger.log(DEBUG, "request_target:\t" + request_target_path);
-	const std::string resolved_target =
-		resolveRequestTarget(request_target_path);
-	logger.log(DEBUG, "resolved_target:\t" + resolved_target);
+		while (std::getline(ss, candidate, ','))
+		{
+			candidate = trim(candidate);
+			if (candidate.compare(0, 2, "W/") == 0)
+				candidate = candidate.substr(2);
+			if (candidate == "*" || candidate == etag)
+				return (true);
+		}
+		return (false);
+	}
+	if (request.hasHeader("If-Modified-Since"))
+	{
+		time_t since;
 
-	if (_autoindex == true)
+		if (HTTPDate::parse(request.getHeader("If-Modified-Since"), since))
+			return (last_modified <= since);
+	}
+	return (false);
+}
+
+// gzip wins ties with deflate, identity is used when the location doesn't
+// compress this type or the client accepts neither.
+Compressor::Coding
+FileManager::negotiateCompression(const HTTPRequest &request,
+								  const LocationSettings &loc,
+								  const std::string &mime_type) const
+{
+	if (!loc.getGzip() || !loc.resolveGzipType(mime_type) ||
+		!request.hasHeader("Accept-Encoding"))
+		return (Compressor::Coding::IDENTITY);
+
+	const std::string &accept_encoding = request.getHeader("Accept-Encoding");
+	const float gzip = acceptedQuality(accept_encoding, "gzip");
+	const float deflate = acceptedQuality(accept_encoding, "deflate");
+
+	if (gzip > 0 && gzip >= deflate)
+		return (Compressor::Coding::GZIP);
+	if (deflate > 0)
+		return (Compressor::Coding::DEFLATE);
+	return (Compressor::Coding::IDENTITY);
+}
+
+// Runs work on the WorkerPool and parks the client in ClientState::Waiting.
+// work may only touch data it owns, the client can be gone by the time it
+// finishes. then runs on the event loop once the client is woken and decides
+// how the request continues, possibly by submitting the next job.
+ClientState FileManager::submit(std::function<void()> work,
+								std::function<Outcome<ClientState>()> then)
+{
+	std::shared_ptr<PendingJob> job = std::make_shared<PendingJob>();
+
+	job->then = std::move(then);
+	job->done = false;
+	_job = job;
+	WorkerPool::getInstance().submit(_client_fd,
+									 [job, work]()
+									 {
+										 work();
+										 job->done = true;
+									 });
+	return (ClientState::Waiting);
+}
+
+Outcome<ClientState> FileManager::finishJob(void)
+{
+	if (!_job || !_job->done)
+		return (ClientState::Waiting);
+	std::shared_ptr<PendingJob> job = std::move(_job);
+	return (job->then());
+}
+
+// Hands body to the WorkerPool for compression. Bodies below the location's
+// gzip_min_length aren't worth the round trip and are sent as they are.
+ClientState FileManager::startCompression(const LocationSettings &loc,
+										  Compressor::Coding coding,
+										  const std::string &head,
+										  const std::string &body,
+										  const std::string &cache_key)
+{
+	if (body.size() < loc.getGzipMinLength())
 	{
-		HTTPStatus status(StatusCode::OK);
-		_response += status.getStatusLine("HTTP/1.1");
-		return;
+		HeaderWriter tail;
+
+		tail.add("Content-Length", body.size());
+		_response += head;
+		_response += tail.finish();
+		_response += body;
+		return (ClientState::Sending);
 	}
+	std::shared_ptr<CompressionJob> job = std::make_shared<CompressionJob>();
+	job->head = head;
+	job->input = body;
+	job->cache_key = cache_key;
+	job->coding = coding;
+	job->level = loc.getGzipCompLevel();
+	job->succeeded = false;
+	return (submit(
+		[job]()
+		{
+			job->succeeded = Compressor::compress(job->input, job->output,
+												  job->coding, job->level);
+		},
+		[this, job]() -> Outcome<ClientState>
+		{ return (finishCompression(*job)); }));
+}
+
+ClientState FileManager::finishCompression(const CompressionJob &job)
+{
+	Logger &logger = Logger::getInstance();
+	HeaderWriter tail;
 
-	if (!std::filesystem::exists(resolved_target))
-		throw ClientException(StatusCode::NotFound);
-	_request_target.open(resolved_target, std::ios::in | std::ios::binary);
-	if (!_request_target.is_open())
-		throw ClientException(StatusCode::NotFound);
-	HTTPStatus status(StatusCode::OK);
-	_response += status.getStatusLine("HTTP/1.1");
+	_response += job.head;
+	if (job.succeeded)
+	{
+		logger.log(DEBUG, "finishCompression: % -> % bytes", job.input.size(),
+				   job.output.size());
+		if (!job.cache_key.empty())
+			CompressionCache::getInstance().store(job.cache_key, job.output);
+		tail.add("Content-Encoding", Compressor::codingToString(job.coding));
+		tail.add("Content-Length", job.output.size());
+		_response += tail.finish();
+		_response += job.output;
+	}
+	else
+	{
+		tail.add("Content-Length", job.input.size());
+		_response += tail.finish();
+		_response += job.input;
+	}
+	return (ClientState::Sending);
 }
 
-void FileManager::openPostFile(const std::string &request_target_path)
+// The target is stat'ed (and a sidecar picked) on the WorkerPool, the
+// response is decided by respondGetFile() back on the event loop.
+Outcome<ClientState> FileManager::openGetFile(const HTTPRequest &request)
 {
 	Logger &logger = Logger::getInstance();
+	const std::string &request_target_path = request.getRequestTarget();
+	const std::string &query = request.getQuery();
+	std::shared_ptr<FileLookup> lookup = std::make_shared<FileLookup>();
 
 	logger.log(DEBUG, "request_target:\t" + request_target_path);
-	const std::string resolved_target =
-		resolveRequestTarget(request_target_path);
-	logger.log(DEBUG, "resolved_target:\t" + resolved_target);
+	const Outcome<std::string> path = resolveRequestTarget(request_target_path);
+	if (!path)
+		return (path.failure());
+	lookup->path = *path;
+	logger.log(DEBUG, "resolved_target:\t" + lookup->path);
+	if (MissCache::getInstance().contains(lookup->path))
+		return (fail(StatusCode::NotFound));
+	lookup->gzip_static =
+		!_autoindex &&
+		(*_serversetting.resolveLocation(request_target_path))->getGzipStatic();
+	if (request.hasHeader("Accept-Encoding"))
+		lookup->accept_encoding = request.getHeader("Accept-Encoding");
+	return (submit([lookup]() { lookupFile(*lookup); },
+				   [this, &request, lookup, request_target_path,
+					query]() -> Outcome<ClientState>
+				   {
+					   return (respondGetFile(request, *lookup,
+											  request_target_path, query));
+				   }));
+}
+
+Outcome<ClientState> FileManager::respondGetFile(const HTTPRequest &request,
+												 const FileLookup &lookup,
+												 const std::string &uri,
+												 const std::string &query)
+{
+	Logger &logger = Logger::getInstance();
+	const LocationSettings &loc = **_serversetting.resolveLocation(uri);
 
-	if (!std::filesystem::exists(resolved_target))
+	if (!lookup.found)
 	{
-		_request_target.open(resolved_target, std::ios::out);
-		if (!_request_target.is_open())
-			throw ClientException(StatusCode::InternalServerError);
-		HTTPStatus status(StatusCode::Created);
-		_response += status.getStatusLine("HTTP/1.1");
+		MissCache::getInstance().store(lookup.path);
+		return (fail(StatusCode::NotFound));
 	}
-	else
+	if (_autoindex == true)
+		return (openListing(request, loc, lookup.path, uri, query,
+							lookup.target_stat));
+	logger.log(DEBUG, "served_target:\t" + lookup.served_path);
+	const std::string etag = makeETag(lookup.target_stat);
+	const std::string last_modified =
+		HTTPDate::format(lookup.target_stat.st_mtime);
+
+	if (isNotModified(request, etag, lookup.target_stat.st_mtime))
 	{
-		_request_target.open(resolved_target, std::ios::out | std::ios::trunc);
-		if (!_request_target.is_open())
-			throw ClientException(StatusCode::InternalServerError);
-		HTTPStatus status(StatusCode::OK);
-		_response += status.getStatusLine("HTTP/1.1");
+		logger.log(DEBUG, "respondGetFile:\tNot Modified: " + etag);
+		HeaderWriter head(StatusCode::NotModified);
+		addValidators(head, etag, last_modified, lookup.gzip_static);
+		_response += head.finish();
+		return (ClientState::Sending);
 	}
+
+	HeaderWriter head(StatusCode::OK);
+	head.add("Content-Type", MimeTypes::fromPath(lookup.path));
+	addValidators(head, etag, last_modified, lookup.gzip_static);
+	if (!lookup.content_encoding.empty())
+		head.add("Content-Encoding", lookup.content_encoding);
+	std::shared_ptr<FileTransfer> transfer = std::make_shared<FileTransfer>();
+	transfer->path = lookup.served_path;
+	return (submit([transfer]() { readFile(*transfer); },
+				   [this, transfer,
+					head = std::string(head.view())]() -> Outcome<ClientState>
+				   {
+					   HeaderWriter tail;
+
+					   if (!transfer->succeeded)
+						   return (fail(StatusCode::NotFound));
+					   tail.add("Content-Length", transfer->body.size());
+					   _response += head;
+					   _response += tail.finish();
+					   _response += transfer->body;
+					   return (ClientState::Sending);
+				   }));
 }
 
-ClientState FileManager::openErrorPage(const std::string &error_pages_path,
-									   const StatusCode &status_code)
+// A cached listing is answered in one piece, with validators and optional
+// compression. Anything else is streamed chunked by manageListing(): a plain
+// listing fills the cache on its way out, so compression and conditional
+// requests apply from the next request on.
+Outcome<ClientState> FileManager::openListing(const HTTPRequest &request,
+											  const LocationSettings &loc,
+											  const std::string &dir,
+											  const std::string &uri,
+											  const std::string &query,
+											  const struct stat &dir_stat)
 {
 	Logger &logger = Logger::getInstance();
+	const AutoIndexGenerator::Options options =
+		AutoIndexGenerator::parseQuery(query);
+	std::shared_ptr<const std::string> listing;
+	Compressor::Coding coding = Compressor::Coding::IDENTITY;
+
+	if (AutoIndexGenerator::isDefault(options))
+		listing = ListingCache::getInstance().find(dir, uri, dir_stat);
+	if (!listing)
+	{
+		std::shared_ptr<AutoIndexStream> stream =
+			std::make_shared<AutoIndexStream>(dir, uri, dir_stat, options);
+		HeaderWriter head(StatusCode::OK);
 
-	logger.log(DEBUG, "openErrorPage method is called. (" + error_pages_path +
-						  std::to_string(static_cast<int>(status_code)) +
-						  ".html)");
-	_request_target.open(error_pages_path +
-							 std::to_string(static_cast<int>(status_code)) +
-							 ".html",
-						 std::ios::in);
-	if (!_request_target.is_open())
-	{
-		HTTPStatus status(status_code);
-		_response += status.getHTMLStatus();
+		head.add("Content-Type",
+				 MimeTypes::fromExtension(
+					 options.format == AutoIndexGenerator::Format::JSON
+						 ? "json"
+						 : "html"));
+		if (loc.getGzip())
+			head.add("Vary", "Accept-Encoding");
+		head.add("Transfer-Encoding", "chunked");
+		_listing = stream;
+		return (submit([stream]() { stream->open(); },
+					   [this, head = std::string(
+								  head.finish())]() -> Outcome<ClientState>
+					   {
+						   if (!_listing->isOpen())
+							   return (fail(StatusCode::Forbidden));
+						   _response += head;
+						   return (ClientState::Streaming);
+					   }));
+	}
+	logger.log(DEBUG, "openListing:\tcached %", dir);
+	if (loc.getGzip())
+		coding = negotiateCompression(request, loc, "text/html");
+	std::string etag = makeETag(dir_stat);
+	if (coding != Compressor::Coding::IDENTITY)
+		etag.insert(etag.size() - 1, "-" + Compressor::codingToString(coding));
+	const std::string last_modified = HTTPDate::format(dir_stat.st_mtime);
+
+	if (isNotModified(request, etag, dir_stat.st_mtime))
+	{
+		logger.log(DEBUG, "openListing:\tNot Modified: " + etag);
+		HeaderWriter head(StatusCode::NotModified);
+		addValidators(head, etag, last_modified, loc.getGzip());
+		_response += head.finish();
 		return (ClientState::Sending);
 	}
-	return (ClientState::Error);
+	HeaderWriter head(StatusCode::OK);
+	head.add("Content-Type", MimeTypes::fromExtension("html"));
+	addValidators(head, etag, last_modified, loc.getGzip());
+	return (sendListing(loc, coding, head, listing));
 }
 
-ClientState FileManager::loadErrorPage(void)
+// Frames chunk for a chunked body.
+static void appendChunk(std::string &response, std::string_view chunk)
 {
-	char buffer[BUFFER_SIZE];
-	_request_target.read(buffer, BUFFER_SIZE);
-	if (_request_target.bad())
+	char size[20];
+	const char *end =
+		std::to_chars(size, size + sizeof(size), chunk.size(), 16).ptr;
+
+	response.append(size, end - size);
+	response += "\r\n";
+	response += chunk;
+	response += "\r\n";
+}
+
+// Reads the next batch of a streamed listing on the WorkerPool and appends
+// it as a chunk, ending the chunked body once the listing is complete.
+Outcome<ClientState> FileManager::manageListing(void)
+{
+	std::shared_ptr<AutoIndexStream> stream = _listing;
+	std::shared_ptr<ListingBatch> batch = std::make_shared<ListingBatch>();
+
+	return (submit([stream, batch]()
+				   { batch->more = stream->next(batch->chunk); },
+				   [this, batch]() -> Outcome<ClientState>
+				   {
+					   if (!batch->chunk.empty())
+						   appendChunk(_response, batch->chunk);
+					   if (batch->more)
+						   return (ClientState::Streaming);
+					   _response += "0\r\n\r\n";
+					   _listing->storeCollected();
+					   _listing.reset();
+					   return (ClientState::Sending);
+				   }));
+}
+
+// Appends a rendered directory listing behind head. Compressed variants are
+// cached per listing, keyed by a hash of its content since entries can
+// change without the directory mtime (and so the ETag) changing.
+ClientState
+FileManager::sendListing(const LocationSettings &loc, Compressor::Coding coding,
+						 HeaderWriter &head,
+						 std::shared_ptr<const std::string> listing)
+{
+	Logger &logger = Logger::getInstance();
+
+	if (coding == Compressor::Coding::IDENTITY)
 	{
-		HTTPStatus status(StatusCode::InternalServerError);
-		_response = status.getStatusLine("HTTP/1.1") + status.getHTMLStatus();
+		head.add("Content-Length", listing->size());
+		_response += head.finish();
+		_response += *listing;
+		return (ClientState::Sending);
 	}
-	buffer[_request_target.gcount()] = '\0';
-	_response += std::string(buffer, _request_target.gcount());
-	if (_request_target.eof())
+	const std::string cache_key =
+		"autoindex " + std::to_string(std::hash<std::string>{}(*listing)) +
+		" " + Compressor::codingToString(coding) + " " +
+		std::to_string(loc.getGzipCompLevel());
+	std::shared_ptr<const std::string> cached =
+		CompressionCache::getInstance().find(cache_key);
+
+	if (cached)
 	{
+		logger.log(DEBUG, "sendListing:\tcompressed autoindex cached");
+		head.add("Content-Encoding", Compressor::codingToString(coding));
+		head.add("Content-Length", cached->size());
+		_response += head.finish();
+		_response += *cached;
 		return (ClientState::Sending);
 	}
-	return (ClientState::Error);
+	return (startCompression(loc, coding, std::string(head.view()), *listing,
+							 cache_key));
 }
 
-ClientState FileManager::manageGet(void)
+Outcome<ClientState> FileManager::managePost(const HTTPRequest &request)
 {
 	Logger &logger = Logger::getInstance();
-	char buffer[BUFFER_SIZE + 1];
-
-	logger.log(DEBUG, "manageGet method is called:");
-	_request_target.read(buffer, BUFFER_SIZE);
-	if (_request_target.bad())
-		throw ClientException(StatusCode::InternalServerError);
-	buffer[_request_target.gcount()] = '\0';
-	_response += std::string(buffer, _request_target.gcount());
-	if (_request_target.eof())
-		return (ClientState::Sending);
-	return (ClientState::Loading);
+	std::shared_ptr<FileTransfer> transfer = std::make_shared<FileTransfer>();
+
+	logger.log(DEBUG, "request_target:\t" + request.getRequestTarget());
+	const Outcome<std::string> path =
+		resolveRequestTarget(request.getRequestTarget());
+	if (!path)
+		return (path.failure());
+	transfer->path = *path;
+	logger.log(DEBUG, "resolved_target:\t" + transfer->path);
+	if (request.hasHeader("Content-Type") &&
+		!MultipartParser::boundaryOf(request.getHeader("Content-Type")).empty())
+		return (openUpload(request));
+	transfer->body = request.getBody();
+	return (submit([transfer]() { writeFile(*transfer); },
+				   [this, transfer]() -> Outcome<ClientState>
+				   {
+					   if (!transfer->succeeded)
+						   return (fail(StatusCode::InternalServerError));
+					   return (
+						   respondStored(transfer->path, transfer->created));
+				   }));
 }
 
-ClientState FileManager::managePost(const std::string &body)
+// Used for a POST whose body is still on its way once the headers are in,
+// for any multipart/form-data body and for PUT/PATCH. Rather than growing the
+// body in memory the target is opened up front and the rest of the body is
+// moved into it by receiveUpload(). PUT and PATCH with a Content-Range
+// resume an upload, see openPartial().
+Outcome<ClientState> FileManager::openUpload(const HTTPRequest &request)
 {
 	Logger &logger = Logger::getInstance();
+	const HTTPMethod method = request.getMethodType();
+	std::shared_ptr<FileUpload> upload = std::make_shared<FileUpload>();
 
-	ssize_t pos = _request_target.tellp();
-	size_t bytes_to_send = 0;
+	if (method != HTTPMethod::POST && request.getRequestTarget().back() == '/')
+		return (fail(StatusCode::MethodNotAllowed));
+	const Outcome<std::string> path =
+		resolveRequestTarget(request.getRequestTarget());
+	if (!path)
+		return (path.failure());
+	upload->path = *path;
+	logger.log(DEBUG, "openUpload: % (% bytes)", upload->path,
+			   request.getBodyLength());
+	if (request.hasHeader("Content-Range") && method != HTTPMethod::POST)
+	{
+		const Outcome<off_t> offset =
+			parseContentRange(request.getHeader("Content-Range"),
+							  request.getBodyLength(), *upload);
+		if (!offset)
+			return (offset.failure());
+		upload->offset = *offset;
+		upload->partial = partialPath(upload->path, upload->total);
+	}
+	else if (method == HTTPMethod::PATCH)
+		return (fail(StatusCode::BadRequest));
+	else if (request.hasHeader("Content-Type"))
+	{
+		const std::string boundary =
+			MultipartParser::boundaryOf(request.getHeader("Content-Type"));
 
-	logger.log(DEBUG, "managePost method is called");
-	logger.log(DEBUG, "pos: %", pos);
-	if (body.length() - _bytes_sent < BUFFER_SIZE)
-		bytes_to_send = body.length() - _bytes_sent;
-	else
-		bytes_to_send = BUFFER_SIZE;
+		if (!boundary.empty())
+			upload->parts = std::make_unique<PartWriter>(boundary);
+	}
+	upload->received = request.getBody().substr(0, request.getBodyLength());
+	upload->remaining = request.getBodyLength() - upload->received.size();
+	return (submit([upload]() { createUpload(*upload); },
+				   [this, upload]() -> Outcome<ClientState>
+				   {
+					   if (upload->malformed)
+						   return (fail(StatusCode::BadRequest));
+					   if (upload->unsatisfiable)
+						   return (fail(StatusCode::RangeNotSatisfiable));
+					   if (!upload->succeeded)
+						   return (fail(StatusCode::InternalServerError));
+					   _upload = upload;
+					   if (upload->remaining > 0)
+						   return (ClientState::Uploading);
+					   return (finishUpload());
+				   }));
+}
+
+// Whether a failed read of the client socket only found nothing buffered.
+static bool wouldBlock(void)
+{
+	return (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+// On Linux the body goes socket -> pipe -> file with splice() and never
+// enters userspace, elsewhere it takes a plain read()/pwrite() round trip.
+// SYSTEM_ERROR if the socket had nothing to give after all.
+static Outcome<ssize_t> receiveBody(int socket_fd, FileUpload &upload,
+									 size_t chunk)
+{
+#ifdef __linux__
+	ssize_t received = splice(socket_fd, NULL, upload.pipe[WRITE_END], NULL,
+							  chunk, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+	if (received == SYSTEM_ERROR)
+		return (wouldBlock() ? Outcome<ssize_t>(SYSTEM_ERROR)
+							 : fail(StatusCode::InternalServerError));
+	for (ssize_t pending = received; pending > 0;)
+	{
+		loff_t offset = upload.offset;
+		ssize_t moved = splice(upload.pipe[READ_END], NULL, upload.fd, &offset,
+							   pending, SPLICE_F_MOVE);
+
+		if (moved <= 0)
+			return (fail(StatusCode::InternalServerError));
+		pending -= moved;
+		upload.offset += moved;
+	}
+#else
+	char buffer[UPLOAD_SPLICE_SIZE];
+	ssize_t received = read(socket_fd, buffer, chunk);
+
+	if (received == SYSTEM_ERROR && wouldBlock())
+		return (SYSTEM_ERROR);
+	if (received == SYSTEM_ERROR ||
+		!writeAt(upload.fd, buffer, std::max<ssize_t>(received, 0),
+				 upload.offset))
+		return (fail(StatusCode::InternalServerError));
+#endif
+	return (received);
+}
+
+// A multipart body has to be looked at for its boundaries, so it is read and
+// handed to the parser chunk by chunk.
+static Outcome<ssize_t> receiveParts(int socket_fd, FileUpload &upload,
+									 size_t chunk)
+{
+	char buffer[UPLOAD_SPLICE_SIZE];
+	ssize_t received = read(socket_fd, buffer, chunk);
+
+	if (received == SYSTEM_ERROR && wouldBlock())
+		return (SYSTEM_ERROR);
+	if (received == SYSTEM_ERROR)
+		return (fail(StatusCode::InternalServerError));
+	if (!upload.parts->parser.feed(buffer, received))
+		return (fail(StatusCode::BadRequest));
+	if (upload.parts->failed)
+		return (fail(StatusCode::InternalServerError));
+	return (received);
+}
+
+// Moves what the socket has buffered into the upload target.
+Outcome<ClientState> FileManager::receiveUpload(void)
+{
+	FileUpload &upload = *_upload;
+	const size_t chunk =
+		std::min(upload.remaining, static_cast<size_t>(UPLOAD_SPLICE_SIZE));
+	const Outcome<ssize_t> received =
+		upload.parts ? receiveParts(_client_fd, upload, chunk)
+					 : receiveBody(_client_fd, upload, chunk);
+
+	if (!received)
+		return (received.failure());
+	if (*received == SYSTEM_ERROR)
+		return (ClientState::Uploading);
+	if (*received == 0)
+		return (fail(StatusCode::BadRequest));
+	upload.remaining -= *received;
+	if (upload.remaining > 0)
+		return (ClientState::Uploading);
+	return (finishUpload());
+}
 
-	_request_target.write(body.c_str() + pos, bytes_to_send);
-	_bytes_sent += bytes_to_send;
-	if (_request_target.fail())
-		throw ClientException(StatusCode::InternalServerError);
-	if (_bytes_sent == body.size())
+Outcome<ClientState> FileManager::finishUpload(void)
+{
+	std::shared_ptr<FileUpload> upload = std::move(_upload);
+
+	Logger::getInstance().log(DEBUG, "finishUpload: stored %", upload->path);
+	if (!upload->partial.empty())
+		return (finishPartial(upload));
+	if (!upload->parts)
+		return (respondStored(upload->path, upload->created));
+	if (!upload->parts->parser.isDone())
+		return (fail(StatusCode::BadRequest));
+	return (respondStored(upload->parts->dir, upload->parts->created));
+}
+
+// Until the last byte is committed every chunk is answered the way resumable
+// upload clients expect: 308 with the committed range, if any.
+Outcome<ClientState>
+FileManager::finishPartial(std::shared_ptr<FileUpload> upload)
+{
+	upload->committed =
+		std::max(upload->committed, static_cast<size_t>(upload->offset));
+	if (upload->committed < upload->total)
+	{
+		HeaderWriter head(StatusCode::PermanentRedirect);
+
+		if (upload->committed > 0)
+			head.add("Range",
+					 "bytes=0-" + std::to_string(upload->committed - 1));
+		head.add("Content-Length", static_cast<size_t>(0));
+		_response += head.finish();
 		return (ClientState::Sending);
-	return (ClientState::Loading);
+	}
+	if (upload->query)
+		return (respondStored(upload->path, false));
+	return (submit([upload]() { finalizeUpload(*upload); },
+				   [this, upload]() -> Outcome<ClientState>
+				   {
+					   if (!upload->succeeded)
+						   return (fail(StatusCode::InternalServerError));
+					   return (
+						   respondStored(upload->path, upload->created));
+				   }));
+}
+
+// The stored path may have been cached as missing, see MissCache::forget().
+ClientState FileManager::respondStored(const std::string &path, bool created)
+{
+	MissCache::getInstance().forget(path);
+
+	HeaderWriter head(created ? StatusCode::Created : StatusCode::OK);
+
+	head.add("Content-Length", static_cast<size_t>(0));
+	_response += head.finish();
+	return (ClientState::Sending);
 }
 
-ClientState FileManager::manageDelete(const std::string &request_target_path)
+Outcome<ClientState>
+FileManager::manageDelete(const std::string &request_target_path)
 {
 	Logger &logger = Logger::getInstance();
+	std::shared_ptr<FileTransfer> transfer = std::make_shared<FileTransfer>();
 
 	logger.log(DEBUG, "request_target:\t" + request_target_path);
-	const std::string resolved_target =
-		resolveRequestTarget(request_target_path);
-	logger.log(DEBUG, "resolved_target:\t" + resolved_target);
-
-	logger.log(DEBUG, "manageDelete method is called");
-	if (std::remove(resolved_target.c_str()) != 0)
-		throw ClientException(StatusCode::NotFound);
-	HTTPStatus status(StatusCode::NoContent);
-	_response += status.getStatusLine("HTTP/1.1");
-	return (ClientState::Sending);
+	const Outcome<std::string> path = resolveRequestTarget(request_target_path);
+	if (!path)
+		return (path.failure());
+	transfer->path = *path;
+	logger.log(DEBUG, "resolved_target:\t" + transfer->path);
+	return (submit([transfer]() { removeFile(*transfer); },
+				   [this, transfer]() -> Outcome<ClientState>
+				   {
+					   if (!transfer->succeeded)
+						   return (fail(StatusCode::NotFound));
+					   HeaderWriter head(StatusCode::NoContent);
+					   _response += head.finish();
+					   return (ClientState::Sending);
+				   }));
 }
 
-ClientState FileManager::manage(HTTPMethod method,
-								const std::string &request_target_path,
-								const std::string &body)
+Outcome<ClientState> FileManager::manage(const HTTPRequest &request)
 {
 	Logger &logger = Logger::getInstance();
+	const HTTPMethod method = request.getMethodType();
 
 	logger.log(DEBUG, "FileManager::manage:");
 
 	if (method == HTTPMethod::DELETE)
-		return (manageDelete(request_target_path));
+		return (manageDelete(request.getRequestTarget()));
 	if (method == HTTPMethod::GET)
+		return (openGetFile(request));
+	if (method == HTTPMethod::POST)
+		return (managePost(request));
+	if (method == HTTPMethod::PUT || method == HTTPMethod::PATCH)
+		return (openUpload(request));
+	return (ClientState::Unknown);
+}
+
+// Starts a response with the status and fields of a script's head. Its
+// Content-Type defaults to text/html; lengths are left to the caller.
+static bool writeCgiHead(HeaderWriter &writer, const CGIHead &head)
+{
+	writer.add("Content-Type", head.getContentType());
+	for (const auto &field : head.getFields())
+		writer.add(field.first, field.second);
+	return (!writer.overflowed());
+}
+
+// Answers with the complete output of a script, its body given a
+// Content-Length and compressed like a file would be. For a cgi_cache miss
+// it's stored first.
+Outcome<ClientState> FileManager::manageCgi(const HTTPRequest &request,
+											const CGIHead &head,
+											std::string_view body)
+{
+	const Outcome<const LocationSettings *> resolved =
+		_serversetting.resolveLocation(request.getRequestTarget());
+	std::shared_ptr<const CachedCgi> cached;
+
+	if (!resolved)
+		return (resolved.failure());
+	if (!_cgi_cache_key.empty())
+		cached = CGICache::getInstance().store(_cgi_cache_key, head, body,
+											   _cgi_cache_ttl,
+											   _cgi_cache_stale);
+	return (sendCgi(request, **resolved, head, body, cached.get()));
+}
+
+// A response that came from the CGICache has an Age and its compressed
+// body is kept in the CompressionCache, per stored response.
+Outcome<ClientState> FileManager::sendCgi(const HTTPRequest &request,
+										  const LocationSettings &loc,
+										  const CGIHead &head,
+										  std::string_view body,
+										  const CachedCgi *cached)
+{
+	const std::string &content_type = head.getContentType();
+	const Compressor::Coding coding = negotiateCompression(
+		request, loc, content_type.substr(0, content_type.find(';')));
+	const time_t now = time(nullptr);
+	HeaderWriter writer(head.getStatusCode());
+	std::string cache_key;
+
+	if (!writeCgiHead(writer, head))
+		return (fail(StatusCode::BadGateway));
+	if (cached != nullptr && now > cached->stored)
+		writer.add("Age", static_cast<size_t>(now - cached->stored));
+	_response.clear();
+	if (coding == Compressor::Coding::IDENTITY)
 	{
-		if (!_request_target.is_open())
-			openGetFile(request_target_path);
-		return (manageGet());
+		writer.add("Content-Length", body.size());
+		_response = writer.finish();
+		_response += body;
+		return (ClientState::Sending);
 	}
-	else if (method == HTTPMethod::POST)
+	writer.add("Vary", "Accept-Encoding");
+	if (cached != nullptr)
 	{
-		if (!_request_target.is_open())
-			openPostFile(request_target_path);
-		return (managePost(body));
+		cache_key = "cgi " + std::to_string(cached->serial) + " " +
+					Compressor::codingToString(coding) + " " +
+					std::to_string(loc.getGzipCompLevel());
+
+		const std::shared_ptr<const std::string> compressed =
+			CompressionCache::getInstance().find(cache_key);
+
+		if (compressed)
+		{
+			writer.add("Content-Encoding",
+					   Compressor::codingToString(coding));
+			writer.add("Content-Length", compressed->size());
+			_response = writer.finish();
+			_response += *compressed;
+			return (ClientState::Sending);
+		}
 	}
-	return (ClientState::Unknown);
+	return (startCompression(loc, coding, std::string(writer.view()),
+							 std::string(body), cache_key));
 }
 
-ClientState FileManager::manageCgi(std::string http_version,
-								   const std::string &body)
+// Looks up a GET to a cgi_cache location, keyed by method, virtual host,
+// target and query. On a miss the script's response is stored once it's
+// complete, by manageCgi() or streamCgi().
+std::shared_ptr<const CachedCgi>
+FileManager::findCachedCgi(const HTTPRequest &request,
+						   const LocationSettings &loc)
 {
-	_response = http_version + " 200 OK\t\n\t\n" + body;
-	return (ClientState::Sending);
+	_cgi_cache_key.clear();
+	if (loc.getCGICache() == 0 ||
+		request.getMethodType() != HTTPMethod::GET ||
+		request.getBodyLength() != 0)
+		return (nullptr);
+
+	const std::string key = MethodToString(request.getMethodType()) + " " +
+							_serversetting.getListen() + " " +
+							_serversetting.getServerName() + " " +
+							request.getRequestTarget() + "?" +
+							request.getQuery();
+	std::shared_ptr<const CachedCgi> cached =
+		CGICache::getInstance().find(key, loc.getCGILimits().timeout);
+
+	if (cached)
+		return (cached);
+	_cgi_cache_key = key;
+	_cgi_cache_ttl = loc.getCGICache();
+	_cgi_cache_stale = loc.getCGICacheStale();
+	return (nullptr);
+}
+
+Outcome<ClientState> FileManager::manageCachedCgi(const HTTPRequest &request,
+												  const LocationSettings &loc,
+												  const CachedCgi &cached)
+{
+	return (sendCgi(request, loc, cached.head, cached.body, &cached));
+}
+
+// The key findCachedCgi() missed on, empty if the response isn't stored.
+const std::string &FileManager::getCgiCacheKey(void) const
+{
+	return (_cgi_cache_key);
+}
+
+// Leaves storing the response to the request whose script produces it.
+void FileManager::skipCgiCache(void)
+{
+	_cgi_cache_key.clear();
+}
+
+// Answers with what a FastCGI backend produced, which must have a head.
+Outcome<ClientState> FileManager::manageFastCgi(const HTTPRequest &request,
+												const std::string &output)
+{
+	CGIHead head;
+	const Outcome<CGIHead::Parse> parsed = head.parse(output, true);
+
+	if (!parsed)
+		return (parsed.failure());
+	if (*parsed != CGIHead::Parse::Complete)
+		return (fail(StatusCode::BadGateway));
+	return (manageCgi(request, head,
+					  std::string_view(output).substr(head.getLength())));
+}
+
+// Sends the head of a response whose body the script is still writing: the
+// script's own Content-Length if it gave one, chunked otherwise. A body to
+// be compressed is deflated as it arrives and always sent chunked, unless
+// its Content-Length is below the location's gzip_min_length.
+Outcome<ClientState> FileManager::startCgiStream(const HTTPRequest &request,
+												 const CGIHead &head)
+{
+	const Outcome<const LocationSettings *> resolved =
+		_serversetting.resolveLocation(request.getRequestTarget());
+	const std::string &content_type = head.getContentType();
+
+	if (!resolved)
+		return (resolved.failure());
+
+	Compressor::Coding coding = negotiateCompression(
+		request, **resolved, content_type.substr(0, content_type.find(';')));
+	HeaderWriter writer(head.getStatusCode());
+
+	if (!writeCgiHead(writer, head))
+		return (fail(StatusCode::BadGateway));
+	if (head.hasContentLength() &&
+		head.getContentLength() < (*resolved)->getGzipMinLength())
+		coding = Compressor::Coding::IDENTITY;
+	_cgi_deflate.reset();
+	if (coding != Compressor::Coding::IDENTITY)
+	{
+		writer.add("Vary", "Accept-Encoding");
+		writer.add("Content-Encoding", Compressor::codingToString(coding));
+		_cgi_deflate = std::make_unique<Compressor::Stream>(
+			coding, (*resolved)->getGzipCompLevel());
+	}
+	_cgi_remaining = head.hasContentLength() ? head.getContentLength()
+											 : std::string::npos;
+	if (head.hasContentLength() && !_cgi_deflate)
+		writer.add("Content-Length", head.getContentLength());
+	else
+		writer.add("Transfer-Encoding", "chunked");
+	_response = writer.finish();
+	if (!_cgi_cache_key.empty())
+		_cgi_cache_head = head;
+	return (ClientState::CGI_Stream);
+}
+
+// Moves what the script wrote since the last call into the response, as a
+// chunk or up to the length it announced, and ends the body once the script
+// is complete. The connection is ended instead if deflating fails halfway or
+// the script wrote less than the Content-Length it announced, there is no
+// other way to tell the client.
+ClientState FileManager::streamCgi(std::string &output, bool complete)
+{
+	const size_t length = std::min(output.size(), _cgi_remaining);
+	const bool chunked = _cgi_deflate || _cgi_remaining == std::string::npos;
+
+	if (_cgi_deflate)
+	{
+		std::string deflated;
+
+		if (!_cgi_deflate->write(std::string_view(output).substr(0, length),
+								 deflated, complete))
+		{
+			Logger::getInstance().log(ERROR, "streamCgi: deflate failed");
+			return (ClientState::Done);
+		}
+		if (!deflated.empty())
+			appendChunk(_response, deflated);
+	}
+	else if (chunked && !output.empty())
+		appendChunk(_response, output);
+	else if (!chunked)
+		_response.append(output, 0, length);
+	if (_cgi_remaining != std::string::npos)
+		_cgi_remaining -= length;
+	if (!_cgi_cache_key.empty())
+		_cgi_cache_body.append(output, 0, length);
+	if (_cgi_cache_body.size() > CGI_CACHE_MAX_ENTRY)
+	{
+		_cgi_cache_key.clear();
+		_cgi_cache_body.clear();
+	}
+	output.clear();
+	if (complete && _cgi_remaining != 0 &&
+		_cgi_remaining != std::string::npos)
+	{
+		Logger::getInstance().log(ERROR, "streamCgi: % bytes short",
+								  _cgi_remaining);
+		return (ClientState::Done);
+	}
+	if (complete)
+	{
+		_cgi_deflate.reset();
+		if (chunked)
+			_response += "0\r\n\r\n";
+		if (!_cgi_cache_key.empty())
+			CGICache::getInstance().store(_cgi_cache_key, _cgi_cache_head,
+										  _cgi_cache_body, _cgi_cache_ttl,
+										  _cgi_cache_stale);
+		return (ClientState::Sending);
+	}
+	if (_response.empty())
+		return (ClientState::CGI_Read);
+	return (ClientState::CGI_Stream);
 }
 
 const std::string &FileManager::getResponse(void) const
@@ -241,7 +1415,25 @@ void FileManager::setResponse(const std::string str)
 	_response = str;
 }
 
+// Replaces the response with a generated HTML page for status_code.
+void FileManager::setStatusResponse(StatusCode status_code)
+{
+	HTTPStatus status(status_code);
+	const std::string body = status.getHTMLStatus();
+	HeaderWriter head(status_code);
+
+	head.add("Content-Type", MimeTypes::fromExtension("html"));
+	head.add("Content-Length", body.size());
+	_response = head.finish();
+	_response += body;
+}
+
 void FileManager::setServerSetting(const ServerSettings &serversetting)
 {
 	_serversetting = serversetting;
 }
+
+void FileManager::setClientFD(int fd)
+{
+	_client_fd = fd;
+}
@@ -0,0 +1,50 @@
+#include "HTTPDate.hpp"
+
+#include <ctime>
+#include <string>
+
+#define HTTP_DATE_FORMAT "%a, %d %b %Y %H:%M:%S GMT"
+
+static char cached_date[32];
+static size_t cached_length = 0;
+static time_t cached_second = -1;
+
+void HTTPDate::update(void)
+{
+	const time_t current = time(nullptr);
+	struct tm tm;
+
+	if (current == cached_second)
+		return;
+	gmtime_r(&current, &tm);
+	cached_length =
+		strftime(cached_date, sizeof(cached_date), HTTP_DATE_FORMAT, &tm);
+	cached_second = current;
+}
+
+std::string_view HTTPDate::now(void)
+{
+	if (cached_length == 0)
+		update();
+	return (std::string_view(cached_date, cached_length));
+}
+
+std::string HTTPDate::format(time_t time)
+{
+	char buf[32];
+	struct tm tm;
+
+	gmtime_r(&time, &tm);
+	const size_t length = strftime(buf, sizeof(buf), HTTP_DATE_FORMAT, &tm);
+	return (std::string(buf, length));
+}
+
+bool HTTPDate::parse(const std::string &date, time_t &time)
+{
+	struct tm tm = {};
+
+	if (strptime(date.c_str(), HTTP_DATE_FORMAT, &tm) == nullptr)
+		return (false);
+	time = timegm(&tm);
+	return (true);
+}
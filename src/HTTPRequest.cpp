@@ -1,11 +1,12 @@
 
 #include "ClientState.hpp"
-#include <ClientException.hpp>
 #include <HTTPRequest.hpp>
 #include <Logger.hpp>
+#include <RequestTarget.hpp>
 #include <StatusCode.hpp>
 #include <SystemException.hpp>
 
+#include <charconv>
 #include <string>
 
 #include <unistd.h>
@@ -13,7 +14,7 @@
 HTTPRequest::HTTPRequest()
 	: _header_end(false), _bytes_read(0), _content_length(0), _max_body_size(),
 	  _methodType(HTTPMethod::UNKNOWN), _http_request(), _request_target(),
-	  _http_version(), _body(), _headers(), _cgi(false)
+	  _query(), _http_version(), _body(), _headers(), _cgi(false)
 {
 }
 
@@ -29,8 +30,12 @@ void HTTPRequest::setMethodType(const std::string &method_type)
 		_methodType = HTTPMethod::POST;
 	else if (method_type == "DELETE")
 		_methodType = HTTPMethod::DELETE;
+	else if (method_type == "PUT")
+		_methodType = HTTPMethod::PUT;
+	else if (method_type == "PATCH")
+		_methodType = HTTPMethod::PATCH;
 	else
-		throw ClientException(StatusCode::NotImplemented);
+		_methodType = HTTPMethod::UNKNOWN;
 }
 
 HTTPMethod HTTPRequest::getMethodType(void) const
@@ -70,16 +75,34 @@ const std::string &HTTPRequest::getHeader(const std::string &key) const
 	return (_headers.at(key));
 }
 
+bool HTTPRequest::hasHeader(const std::string &key) const
+{
+	return (_headers.find(key) != _headers.end());
+}
+
+const std::unordered_map<std::string, std::string> &HTTPRequest::getHeaders(
+	void) const
+{
+	return (_headers);
+}
+
 void HTTPRequest::setRequestTarget(const std::string &request_target)
 {
 	_request_target = request_target;
 }
 
+// The canonical path of the target once the headers are in, see
+// RequestTarget::canonicalize().
 const std::string &HTTPRequest::getRequestTarget(void) const
 {
 	return (_request_target);
 }
 
+const std::string &HTTPRequest::getQuery(void) const
+{
+	return (_query);
+}
+
 void HTTPRequest::setHTTPVersion(const std::string &http_version)
 {
 	_http_version = http_version;
@@ -162,11 +185,25 @@ size_t HTTPRequest::parseHeaders(size_t &i)
 	return (i);
 }
 
-ClientState HTTPRequest::setRequestVariables(size_t pos)
+Outcome<ClientState> HTTPRequest::setRequestVariables(size_t pos)
 {
 	setHeaderEnd(true);
+	if (_methodType == HTTPMethod::UNKNOWN)
+		return (fail(StatusCode::NotImplemented));
+	if (!RequestTarget::canonicalize(_request_target, _query))
+		return (fail(StatusCode::BadRequest));
+	Logger::getInstance().log(DEBUG, "canonical target: % query: %",
+							  _request_target, _query);
 	if (_headers.find("Content-Length") != _headers.end())
-		_content_length = std::stoi(getHeader("Content-Length"));
+	{
+		const std::string &length = getHeader("Content-Length");
+		const char *end = length.data() + length.size();
+		const std::from_chars_result result =
+			std::from_chars(length.data(), end, _content_length);
+
+		if (length.empty() || result.ec != std::errc() || result.ptr != end)
+			return (fail(StatusCode::BadRequest));
+	}
 
 	if (_content_length == 0)
 		return (ClientState::Loading);
@@ -176,7 +213,7 @@ ClientState HTTPRequest::setRequestVariables(size_t pos)
 	return (ClientState::Receiving);
 }
 
-ClientState HTTPRequest::receive(int client_fd)
+Outcome<ClientState> HTTPRequest::receive(int client_fd)
 {
 	Logger &logger = Logger::getInstance();
 	char buffer[BUFFER_SIZE];
@@ -185,10 +222,8 @@ ClientState HTTPRequest::receive(int client_fd)
 	size_t pos;
 
 	_bytes_read = read(client_fd, buffer, BUFFER_SIZE);
-	logger.log(WARNING, "receive:" + std::to_string(__LINE__) + " Body: " +
-							std::string(buffer, _bytes_read)); // TODO: remove
 	if (_bytes_read == SYSTEM_ERROR)
-		throw ClientException(StatusCode::InternalServerError);
+		return (fail(StatusCode::InternalServerError));
 	logger.log(DEBUG, "in receive _bytes_read is: %", _bytes_read);
 	if (_bytes_read == 0)
 		return (ClientState::Receiving);
@@ -197,7 +232,7 @@ ClientState HTTPRequest::receive(int client_fd)
 	{
 		_body += std::string(buffer, _bytes_read);
 		if (_body.size() > _max_body_size)
-			throw ClientException(StatusCode::RequestBodyTooLarge);
+			return (fail(StatusCode::RequestBodyTooLarge));
 		if (_body.size() >= _content_length)
 			return (ClientState::Loading);
 		return (ClientState::Receiving);
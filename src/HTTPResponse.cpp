@@ -1,12 +1,17 @@
+#include <HTTPDate.hpp>
 #include <HTTPRequest.hpp>
 #include <HTTPResponse.hpp>
 #include <Logger.hpp>
 #include <SystemException.hpp>
 
+#include <cstring>
 #include <string>
+#include <string_view>
+#include <sys/uio.h>
 #include <unistd.h>
 
-HTTPResponse::HTTPResponse() : _bytes_sent(0), _response("")
+HTTPResponse::HTTPResponse()
+	: _bytes_sent(0), _response(""), _canned(), _date(), _date_length(0)
 {
 }
 
@@ -23,6 +28,79 @@ void HTTPResponse::clear(void)
 {
 	_bytes_sent = 0;
 	_response.clear();
+	_canned.reset();
+}
+
+// Writes what is buffered of a response that is still being produced. Once
+// it's drained the buffer is reset and the producer appends the next piece.
+ClientState HTTPResponse::stream(int client_fd)
+{
+	const ssize_t w_size = write(client_fd, _response.data() + _bytes_sent,
+								 _response.length() - _bytes_sent);
+
+	if (w_size == -1)
+		throw SystemException("Error: write failed on: " +
+							  std::to_string(client_fd));
+	_bytes_sent += w_size;
+	if (_bytes_sent == _response.length())
+		clear();
+	return (ClientState::Streaming);
+}
+
+bool HTTPResponse::pending(void) const
+{
+	return (_bytes_sent < _response.length());
+}
+
+// Hands a shared response to the send path. Only the Date line is written
+// per client; the status line and tail stay in the shared buffer.
+void HTTPResponse::setCanned(std::shared_ptr<const CannedResponse> canned)
+{
+	const std::string_view date = HTTPDate::now();
+
+	clear();
+	_canned = canned;
+	std::memcpy(_date, "Date: ", 6);
+	std::memcpy(_date + 6, date.data(), date.size());
+	std::memcpy(_date + 6 + date.size(), "\r\n", 2);
+	_date_length = 6 + date.size() + 2;
+}
+
+ClientState HTTPResponse::sendCanned(int client_fd)
+{
+	const std::string_view parts[3] = {_canned->status_line,
+									   std::string_view(_date, _date_length),
+									   _canned->tail};
+	struct iovec iov[3];
+	int count = 0;
+	size_t skip = _bytes_sent;
+	size_t total = 0;
+	ssize_t w_size;
+
+	for (const std::string_view &part : parts)
+	{
+		total += part.size();
+		if (skip >= part.size())
+		{
+			skip -= part.size();
+			continue;
+		}
+		iov[count].iov_base = const_cast<char *>(part.data() + skip);
+		iov[count].iov_len = part.size() - skip;
+		skip = 0;
+		++count;
+	}
+	w_size = writev(client_fd, iov, count);
+	if (w_size == -1)
+		throw SystemException("Error: writev failed on: " +
+							  std::to_string(client_fd));
+	_bytes_sent += w_size;
+	if (_bytes_sent == total)
+	{
+		clear();
+		return (ClientState::Done);
+	}
+	return (ClientState::Sending);
 }
 
 ClientState HTTPResponse::send(int client_fd, const std::string &response)
@@ -31,6 +109,8 @@ ClientState HTTPResponse::send(int client_fd, const std::string &response)
 	ssize_t bytes_to_send;
 	ssize_t w_size;
 
+	if (_canned)
+		return (sendCanned(client_fd));
 	if (_response.empty())
 	{
 		_response = response;
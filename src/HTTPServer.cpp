@@ -1,11 +1,23 @@
-#include "ClientException.hpp"
 #include "ClientState.hpp"
 #include "HTTPRequest.hpp"
 #include "HTTPStatus.hpp"
 #include "StatusCode.hpp"
+#include <CGICache.hpp>
+#include <CGIPool.hpp>
+#include <ChildReaper.hpp>
+#include <ErrorPages.hpp>
+#include <FastCGI.hpp>
+#include <HTTPDate.hpp>
 #include <HTTPServer.hpp>
+#include <Handlers.hpp>
+#include <ListingCache.hpp>
 #include <Logger.hpp>
+#include <MissCache.hpp>
+#include <Precompressor.hpp>
 #include <ServerSettings.hpp>
+#include <WorkerPool.hpp>
+
+#include <signal.h>
 
 HTTPServer::HTTPServer(const std::string &config_file_path)
 try : _parser(config_file_path), _poll(), _active_servers(), _active_clients(),
@@ -32,7 +44,7 @@ Client &HTTPServer::findClientByFd(int targetFd)
 	throw std::runtime_error("Error: findClientByFd");
 }
 
-Client &HTTPServer::getClientByPipeFd(int pipe_fd)
+Client *HTTPServer::getClientByPipeFd(int pipe_fd)
 {
 	for (const auto &entry : _active_clients)
 	{
@@ -40,10 +52,10 @@ Client &HTTPServer::getClientByPipeFd(int pipe_fd)
 		if (client->getCgiToServerFd()[READ_END] == pipe_fd ||
 			client->getServerToCgiFd()[WRITE_END] == pipe_fd)
 		{
-			return *client;
+			return (client.get());
 		}
 	}
-	throw std::runtime_error("Error: getClientByPipeFd");
+	return (nullptr);
 }
 
 int HTTPServer::run()
@@ -54,6 +66,9 @@ int HTTPServer::run()
 	{
 		_parser.ParseConfig();
 		setupServers();
+		// a client or script that went away makes writes fail with EPIPE
+		// instead of ending the server
+		signal(SIGPIPE, SIG_IGN);
 		logger.log(INFO, "Server started");
 		while (true)
 			handleActivePollFDs();
@@ -74,12 +89,32 @@ void HTTPServer::setupServers(void)
 	std::vector<std::vector<ServerSettings>> server_list =
 		_parser.sortServerSettings();
 
+	for (const ServerSettings &block : _parser.getServerSettings())
+	{
+		if (block.getPrecompress())
+			Precompressor::precompressTree(block.getRoot().substr(1));
+		ErrorPages::getInstance().preload(block.getErrorDir());
+		for (const LocationSettings &loc : block.getLocationSettings())
+		{
+			if (loc.getCGIPool() != 0)
+				FastCGI::getInstance().addPool(
+					_poll, CGIPool::name(block, loc), loc.getCGIPool(),
+					loc.getCGIPoolMaxRequests(), loc.getCGIPoolMaxAge());
+			if (!loc.getHandler().empty())
+				Handlers::getInstance().load(loc.getHandler());
+		}
+	}
 	for (const std::vector<ServerSettings> &list : server_list)
 	{
 		std::shared_ptr<Server> server = std::make_shared<Server>(list);
 		_active_servers.emplace(server->getFD(), server);
 		_poll.addPollFD(server->getFD(), POLLIN);
 	}
+	_poll.addPollFD(WorkerPool::getInstance().getNotifyFD(), POLLIN);
+	if (ListingCache::getInstance().getNotifyFD() != -1)
+		_poll.addPollFD(ListingCache::getInstance().getNotifyFD(), POLLIN);
+	if (MissCache::getInstance().getNotifyFD() != -1)
+		_poll.addPollFD(MissCache::getInstance().getNotifyFD(), POLLIN);
 }
 
 void HTTPServer::handleActivePollFDs()
@@ -87,17 +122,18 @@ void HTTPServer::handleActivePollFDs()
 	Logger &logger = Logger::getInstance();
 	logger.log(DEBUG, "HTTPServer::handleActivePollFDs");
 
-	if (!_poll.pollFDs())
+	const int timeout = pollTimeout();
+	const bool active = _poll.pollFDs(timeout);
+	HTTPDate::update();
+	if (!active && timeout == IDLE_TIMEOUT)
 	{
 		logger.log(DEBUG, "HTTPServer::Clearup ClientFD's");
 		for (auto &pair : _active_clients)
 		{
+			if (pair.second->waitsOnCgi())
+				continue;
 			_poll.setEvents(pair.second->getFD(), POLLOUT);
-			pair.second->getResponse().clear();
-			HTTPStatus status(StatusCode::RequestTimeout);
-			pair.second->getFileManager().setResponse(
-				status.getStatusLine("HTTP/1.1") + status.getHTMLStatus());
-			pair.second->setState(ClientState::Sending);
+			pair.second->setErrorResponse(StatusCode::RequestTimeout);
 		}
 	}
 
@@ -109,50 +145,111 @@ void HTTPServer::handleActivePollFDs()
 		logger.log(DEBUG, "poll fd: " + std::to_string(poll_fd.fd) +
 							  " revents: " +
 							  _poll.pollEventsToString(poll_fd.revents));
-		try
+		if (FastCGI::getInstance().owns(poll_fd.fd))
 		{
-			if (poll_fd.revents & POLLHUP)
+			FastCGI::getInstance().handleEvents(_poll, poll_fd.fd,
+												poll_fd.revents);
+			continue;
+		}
+		if (ChildReaper::getInstance().owns(poll_fd.fd))
+		{
+			ChildReaper::getInstance().handleEvents(_poll, poll_fd.fd);
+			continue;
+		}
+		if (Handlers::getInstance().owns(poll_fd.fd))
+		{
+			Handlers::getInstance().handleEvents(_poll, poll_fd.fd);
+			continue;
+		}
+		// a hung up pipe still has to be read to EOF or stop being written,
+		// one whose client is gone or gave up on the script is closed
+		if (_active_pipes.find(poll_fd.fd) != _active_pipes.end())
+		{
+			Client *client = getClientByPipeFd(poll_fd.fd);
+
+			if (client != nullptr && client->waitsOnCgi())
+				handlePipeConnection(poll_fd, _poll, *client, _active_pipes);
+			else
 			{
-				Client &client = getClientByPipeFd(poll_fd.fd);
-				if (client.getRequest().getCGI() &&
-					client.getRequest().getMethodType() != HTTPMethod::DELETE)
-				{
-					_poll.removeFD(poll_fd.fd);
-					_active_pipes.erase(poll_fd.fd);
-					_poll.setEvents(client.getFD(), POLLOUT);
-					client.setState(ClientState::Sending);
-					client.KO = true;
-					handleExistingConnection(poll_fd, _poll, client,
-											 _active_pipes);
-					continue;
-				}
+				_poll.removeFD(poll_fd.fd);
+				_active_pipes.erase(poll_fd.fd);
+				close(poll_fd.fd);
 			}
+			continue;
+		}
+		try
+		{
 			_poll.checkREvents(poll_fd.revents);
 		}
 		catch (const Poll::PollException &e)
 		{
 			logger.log(ERROR, e.what());
-			_poll.removeFD(poll_fd.fd);
-			_active_clients.erase(poll_fd.fd);
+			removeClient(poll_fd.fd);
 			continue;
 		}
 		if (_active_servers.find(poll_fd.fd) != _active_servers.end())
 			handleNewConnection(
 				poll_fd.fd,
 				_active_servers.find(poll_fd.fd)->second->getServerSettings());
+		else if (poll_fd.fd == WorkerPool::getInstance().getNotifyFD())
+			handleCompletedJobs();
+		else if (poll_fd.fd == ListingCache::getInstance().getNotifyFD())
+			ListingCache::getInstance().handleEvents();
+		else if (poll_fd.fd == MissCache::getInstance().getNotifyFD())
+			MissCache::getInstance().handleEvents();
 		else if (_active_clients.find(poll_fd.fd) != _active_clients.end())
 		{
 			Client &client = findClientByFd(poll_fd.fd);
 			handleExistingConnection(poll_fd, _poll, client, _active_pipes);
 		}
-		else if (_active_pipes.find(poll_fd.fd) != _active_pipes.end())
-		{
-			Client &client = getClientByPipeFd(poll_fd.fd);
-			handlePipeConnection(poll_fd, _poll, client, _active_pipes);
-		}
 		else
 			throw std::runtime_error("Unknown file descriptor");
 	}
+	handleCompletedCGI();
+	handleExpiredCGI();
+	FastCGI::getInstance().checkWorkers(_poll);
+	handleResumedHandlers();
+}
+
+// Waits for events up to IDLE_TIMEOUT, or until the next CGI deadline.
+int HTTPServer::pollTimeout(void) const
+{
+	if (_cgi_deadlines.empty())
+		return (IDLE_TIMEOUT);
+
+	const auto left = std::chrono::ceil<std::chrono::milliseconds>(
+		_cgi_deadlines.begin()->first - std::chrono::steady_clock::now());
+
+	return (std::clamp<long>(left.count(), 0, IDLE_TIMEOUT));
+}
+
+// Drops a client. The output pipe of a CGI script it was still reading may be
+// out of the poll set while streamed output was being sent; it's polled
+// again so it is closed like any pipe whose client is gone.
+void HTTPServer::removeClient(int fd)
+{
+	auto it = _active_clients.find(fd);
+
+	_poll.removeFD(fd);
+	Handlers::getInstance().forget(_poll, fd);
+	if (it == _active_clients.end())
+		return;
+
+	const int pipe_fd = it->second->getCgiToServerFd()[READ_END];
+
+	if (!it->second->cgiHasBeenRead &&
+		_active_pipes.find(pipe_fd) != _active_pipes.end())
+	{
+		_poll.removeFD(pipe_fd);
+		_poll.addPollFD(pipe_fd, POLLIN);
+	}
+
+	const int body_fd = it->second->getServerToCgiFd()[WRITE_END];
+
+	if (!it->second->cgiBodyIsSent &&
+		_active_pipes.find(body_fd) != _active_pipes.end())
+		_poll.setEvents(body_fd, POLLOUT);
+	_active_clients.erase(it);
 }
 
 void HTTPServer::handlePipeConnection(
@@ -160,23 +257,113 @@ void HTTPServer::handlePipeConnection(
 	std::unordered_map<int, std::shared_ptr<int>> &active_pipes)
 {
 	Logger &logger = Logger::getInstance();
+	const bool writing = poll_fd.fd == client.getServerToCgiFd()[WRITE_END];
+	ClientState state = ClientState::CGI_Read;
+
 	logger.log(DEBUG, "Client % found on poll_fd.fd (pipe): %", &client,
 			   poll_fd.fd);
-
-	(&client)->handleConnection(poll_fd.events, poll, client, active_pipes);
-	if (client.cgiBodyIsSent)
+	if (writing && (poll_fd.revents & (POLLERR | POLLHUP)))
 	{
-		logger.log(DEBUG, "remove pipe fd: %", poll_fd.fd);
-		_poll.removeFD(poll_fd.fd);
-		active_pipes.erase(poll_fd.fd);
-		_poll.setEvents(client.getFD(), POLLIN);
+		// the script closed its stdin, the rest of the body is dropped
+		close(poll_fd.fd);
+		client.cgiBodyIsSent = true;
+		client.setState(state);
+		_poll.setEvents(client.getFD(), 0);
 	}
-	if (client.cgiHasBeenRead)
+	else if (!writing && client.getState() == ClientState::CGI_Write)
+		state = client.bufferCgi();
+	else
+		state = (&client)->handleConnection(poll_fd.events, poll, client,
+											active_pipes);
+	if ((writing && client.cgiBodyIsSent) ||
+		(!writing && client.cgiHasBeenRead))
 	{
 		logger.log(DEBUG, "remove pipe fd: %", poll_fd.fd);
 		_poll.removeFD(poll_fd.fd);
 		active_pipes.erase(poll_fd.fd);
+	}
+	if (state == ClientState::Done)
+		removeClient(client.getFD());
+	else if (state != ClientState::CGI_Write &&
+			 (client.cgiHasBeenRead || state != ClientState::CGI_Read))
 		_poll.setEvents(client.getFD(), POLLOUT);
+}
+
+// Ends the CGIs that ran past their cgi_timeout. A deadline is only taken
+// for the client's own: by now it may have finished, or its fd may belong
+// to a new client.
+void HTTPServer::handleExpiredCGI(void)
+{
+	Logger &logger = Logger::getInstance();
+	const std::chrono::steady_clock::time_point now =
+		std::chrono::steady_clock::now();
+
+	while (!_cgi_deadlines.empty() && _cgi_deadlines.begin()->first <= now)
+	{
+		const std::chrono::steady_clock::time_point deadline =
+			_cgi_deadlines.begin()->first;
+		const int fd = _cgi_deadlines.begin()->second;
+		auto it = _active_clients.find(fd);
+
+		_cgi_deadlines.erase(_cgi_deadlines.begin());
+		if (it == _active_clients.end() || !it->second->waitsOnCgi() ||
+			it->second->getCgiDeadline() != deadline)
+			continue;
+		logger.log(WARNING, "HTTPServer: CGI of client % timed out", fd);
+		if (it->second->expireCgi(_poll) == ClientState::Done)
+			removeClient(fd);
+		else
+			_poll.setEvents(fd, POLLOUT);
+	}
+}
+
+// Wakes the clients whose WorkerPool job finished. The fd may have been
+// reused by a client that isn't waiting on a job, which is left alone.
+void HTTPServer::handleCompletedJobs(void)
+{
+	Logger &logger = Logger::getInstance();
+
+	for (int fd : WorkerPool::getInstance().collectCompleted())
+	{
+		auto it = _active_clients.find(fd);
+
+		logger.log(DEBUG, "HTTPServer::handleCompletedJobs: fd %", fd);
+		if (it != _active_clients.end() &&
+			it->second->getState() == ClientState::Waiting)
+			_poll.setEvents(fd, POLLOUT);
+	}
+}
+
+// Wakes the clients whose CGI script was reaped or whose FastCGI request
+// finished, under the same caveat as handleCompletedJobs().
+void HTTPServer::handleCompletedCGI(void)
+{
+	std::vector<int> completed = FastCGI::getInstance().collectCompleted();
+	const std::vector<int> exited = ChildReaper::getInstance().collectExited();
+	const std::vector<int> woken = CGICache::getInstance().collectWoken();
+
+	completed.insert(completed.end(), exited.begin(), exited.end());
+	completed.insert(completed.end(), woken.begin(), woken.end());
+	for (int fd : completed)
+	{
+		auto it = _active_clients.find(fd);
+
+		if (it != _active_clients.end() &&
+			it->second->getState() == ClientState::CGI_Read)
+			_poll.setEvents(fd, POLLOUT);
+	}
+}
+
+// Wakes the clients whose handler module waited on an fd that is ready.
+void HTTPServer::handleResumedHandlers(void)
+{
+	for (int fd : Handlers::getInstance().collectResumed())
+	{
+		auto it = _active_clients.find(fd);
+
+		if (it != _active_clients.end() &&
+			it->second->getState() == ClientState::Handling)
+			_poll.setEvents(fd, POLLOUT);
 	}
 }
 
@@ -199,24 +386,38 @@ void HTTPServer::handleExistingConnection(
 	Logger &logger = Logger::getInstance();
 	logger.log(DEBUG, "HTTPServer::handleExistingConnection");
 
-	switch (
-		(&client)->handleConnection(poll_fd.events, poll, client, active_pipes))
+	const bool starting = client.getState() == ClientState::CGI_Start;
+	const ClientState state =
+		client.handleConnection(poll_fd.events, poll, client, active_pipes);
+
+	if (starting && client.waitsOnCgi())
+		_cgi_deadlines.emplace(client.getCgiDeadline(), poll_fd.fd);
+	switch (state)
 	{
 	case ClientState::Receiving:
-	case ClientState::CGI_Read:
+	case ClientState::Uploading:
 		_poll.setEvents(poll_fd.fd, POLLIN);
 		break;
 	case ClientState::Loading:
+	case ClientState::Streaming:
 	case ClientState::Sending:
 	case ClientState::Error:
 	case ClientState::CGI_Start:
-	case ClientState::CGI_Write:
+	case ClientState::CGI_Stream:
 		_poll.setEvents(poll_fd.fd, POLLOUT);
 		break;
+	case ClientState::CGI_Write:
+	case ClientState::Handling:
+		// CGI::send() polls either the socket or the script's stdin, and
+		// HandlerCall::run() the socket or the fd the module waits on
+		break;
+	case ClientState::CGI_Read:
+	case ClientState::Waiting:
+		_poll.setEvents(poll_fd.fd, 0);
+		break;
 	case ClientState::Unknown:
 	case ClientState::Done:
-		_poll.removeFD(poll_fd.fd);
-		_active_clients.erase(poll_fd.fd);
+		removeClient(poll_fd.fd);
 		break;
 	default:
 		throw std::runtime_error(
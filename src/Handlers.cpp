@@ -0,0 +1,251 @@
+#include <Client.hpp>
+#include <HTTPRequest.hpp>
+#include <HTTPStatus.hpp>
+#include <Handlers.hpp>
+#include <Logger.hpp>
+
+#include <algorithm>
+#include <dlfcn.h>
+#include <stdexcept>
+#include <string_view>
+#include <strings.h>
+
+static std::string_view view(ws_str str)
+{
+	return (std::string_view(str.data, str.length));
+}
+
+static ws_str toStr(std::string_view str)
+{
+	return (ws_str{str.data(), str.size()});
+}
+
+static void setStatus(ws_response *response, int status)
+{
+	const StatusCode status_code = static_cast<StatusCode>(status);
+
+	if (!HTTPStatus::isKnown(status_code))
+	{
+		Logger::getInstance().log(ERROR, "Handlers: unknown status %",
+								  status);
+		response->failed = true;
+		return;
+	}
+	response->head.setStatusCode(status_code);
+}
+
+// A field that would split the response fails it instead.
+static void addHeader(ws_response *response, ws_str name, ws_str value)
+{
+	const std::string_view field = view(name);
+
+	if (field.empty() || field.find_first_of(":\r\n \t") != field.npos ||
+		view(value).find_first_of("\r\n") != std::string_view::npos)
+	{
+		Logger::getInstance().log(ERROR, "Handlers: invalid header %",
+								  std::string(field));
+		response->failed = true;
+		return;
+	}
+	if (field.size() == 12 &&
+		strncasecmp(field.data(), "Content-Type", field.size()) == 0)
+		response->head.setContentType(view(value));
+	else if ((field.size() != 14 ||
+			  strncasecmp(field.data(), "Content-Length", field.size()) != 0) &&
+			 (field.size() != 17 || strncasecmp(field.data(),
+												"Transfer-Encoding",
+												field.size()) != 0))
+		response->head.addField(field, view(value));
+}
+
+static void writeSegment(ws_response *response, ws_str segment)
+{
+	response->body.append(segment.data, segment.length);
+}
+
+static void waitFor(ws_response *response, int fd, short events)
+{
+	response->wait_fd = fd;
+	response->wait_events = events;
+}
+
+static const ws_api g_api = {WS_HANDLER_ABI, setStatus, addHeader,
+							 writeSegment, waitFor};
+
+HandlerCall::HandlerCall(const HandlerModule &module,
+						 const HTTPRequest &request)
+	: _module(module), _method(MethodToString(request.getMethodType())),
+	  _headers(), _request(), _response{CGIHead(), "", false, -1, 0},
+	  _state(nullptr), _pending(false)
+{
+	const std::string &body = request.getBody();
+
+	for (const auto &header : request.getHeaders())
+		_headers.push_back(ws_header{toStr(header.first),
+									 toStr(header.second)});
+	_request = ws_request{toStr(_method),
+						  toStr(request.getRequestTarget()),
+						  toStr(request.getQuery()),
+						  toStr(request.getHTTPVersion()),
+						  _headers.data(),
+						  _headers.size(),
+						  toStr(std::string_view(body).substr(
+							  0, std::min(body.size(),
+										  request.getBodyLength())))};
+}
+
+HandlerCall::~HandlerCall()
+{
+	if (_pending && _module.abort != nullptr)
+		_module.abort(_module.module, _state);
+}
+
+// Calls the module. Sending once its response is complete; Handling while
+// it isn't, with the client polled to call it again on the next round or
+// left out while the fd it waits on is polled instead.
+Outcome<ClientState> HandlerCall::run(Poll &poll, int client_fd)
+{
+	Logger &logger = Logger::getInstance();
+
+	_response.wait_fd = -1;
+
+	const ws_result result =
+		_module.handle(_module.module, &_request, &_response, &_state);
+
+	_pending = result == WS_AGAIN;
+	if (result == WS_DONE && !_response.failed)
+		return (ClientState::Sending);
+	if (result != WS_AGAIN || _response.failed)
+	{
+		logger.log(ERROR, "Handlers: % failed", _module.path);
+		return (fail(StatusCode::InternalServerError));
+	}
+	if (_response.wait_fd == -1)
+	{
+		poll.setEvents(client_fd, POLLOUT);
+		return (ClientState::Handling);
+	}
+	if (!Handlers::getInstance().watch(poll, _response.wait_fd,
+									   _response.wait_events, client_fd))
+		return (fail(StatusCode::InternalServerError));
+	poll.setEvents(client_fd, 0);
+	return (ClientState::Handling);
+}
+
+const ws_response &HandlerCall::getResponse(void) const
+{
+	return (_response);
+}
+
+Handlers::Handlers() : _modules(), _waits(), _resumed()
+{
+}
+
+// The modules aren't unloaded, requests may still hold on to their state.
+Handlers::~Handlers()
+{
+}
+
+Handlers &Handlers::getInstance()
+{
+	static Handlers instance;
+	return (instance);
+}
+
+// Loads the module at path unless it already is, and lets it set itself
+// up. One that can't be loaded stops the server.
+void Handlers::load(const std::string &path)
+{
+	Logger &logger = Logger::getInstance();
+
+	if (_modules.find(path) != _modules.end())
+		return;
+
+	void *library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+	if (library == nullptr)
+		throw std::runtime_error("Handlers: " + std::string(dlerror()));
+
+	HandlerModule module = {
+		path, library, nullptr,
+		reinterpret_cast<ws_handler_handle_fn>(
+			dlsym(library, "ws_handler_handle")),
+		reinterpret_cast<ws_handler_abort_fn>(
+			dlsym(library, "ws_handler_abort"))};
+	const ws_handler_init_fn init =
+		reinterpret_cast<ws_handler_init_fn>(dlsym(library, "ws_handler_init"));
+
+	if (module.handle == nullptr)
+		throw std::runtime_error("Handlers: " + path +
+								 " has no ws_handler_handle");
+	if (init != nullptr && init(&g_api, &module.module) != 0)
+		throw std::runtime_error("Handlers: " + path + " failed to start");
+	logger.log(INFO, "Handlers: loaded %", path);
+	_modules.emplace(path, module);
+}
+
+const HandlerModule *Handlers::find(const std::string &path) const
+{
+	auto it = _modules.find(path);
+
+	if (it == _modules.end())
+		return (nullptr);
+	return (&it->second);
+}
+
+// Polls fd for events until it's ready, then resumes client_fd. false if
+// another request already waits on it.
+bool Handlers::watch(Poll &poll, int fd, short events, int client_fd)
+{
+	Logger &logger = Logger::getInstance();
+	auto it = _waits.find(fd);
+
+	if (it != _waits.end() && it->second != -1)
+	{
+		logger.log(ERROR, "Handlers: fd % is waited on already", fd);
+		return (false);
+	}
+	_waits[fd] = client_fd;
+	poll.addPollFD(fd, events);
+	return (true);
+}
+
+// Stops waiting for client_fd, which is being removed.
+void Handlers::forget(Poll &poll, int client_fd)
+{
+	for (auto &wait : _waits)
+	{
+		if (wait.second != client_fd)
+			continue;
+		poll.removeFD(wait.first);
+		wait.second = -1;
+	}
+}
+
+bool Handlers::owns(int fd) const
+{
+	return (_waits.find(fd) != _waits.end());
+}
+
+void Handlers::handleEvents(Poll &poll, int fd)
+{
+	auto it = _waits.find(fd);
+
+	if (it->second != -1)
+	{
+		poll.removeFD(fd);
+		_resumed.push_back(it->second);
+	}
+	_waits.erase(it);
+}
+
+// The clients whose fd is ready, for HTTPServer to poll.
+std::vector<int> Handlers::collectResumed(void)
+{
+	std::vector<int> resumed;
+
+	for (auto it = _waits.begin(); it != _waits.end();)
+		it = it->second == -1 ? _waits.erase(it) : std::next(it);
+	resumed.swap(_resumed);
+	return (resumed);
+}
@@ -0,0 +1,76 @@
+#include <HTTPDate.hpp>
+#include <HTTPStatus.hpp>
+#include <HeaderWriter.hpp>
+
+#include <charconv>
+#include <cstring>
+
+// two bytes are kept back for the blank line finish() appends
+#define HEADER_USABLE (HEADER_CAPACITY - 2)
+
+HeaderWriter::HeaderWriter() : _length(0), _overflow(false)
+{
+}
+
+HeaderWriter::HeaderWriter(StatusCode status_code)
+	: _length(0), _overflow(false)
+{
+	append(HTTPStatus::statusLine(status_code));
+	add("Date", HTTPDate::now());
+	add("Server", SERVER_SOFTWARE);
+}
+
+HeaderWriter::~HeaderWriter()
+{
+}
+
+void HeaderWriter::append(std::string_view str)
+{
+	if (_overflow || str.size() > HEADER_USABLE - _length)
+	{
+		_overflow = true;
+		return;
+	}
+	std::memcpy(_buffer + _length, str.data(), str.size());
+	_length += str.size();
+}
+
+void HeaderWriter::add(std::string_view name, std::string_view value)
+{
+	// all or nothing, a half written header line would corrupt the head
+	if (name.size() + value.size() + 4 > HEADER_USABLE - _length)
+	{
+		_overflow = true;
+		return;
+	}
+	append(name);
+	append(": ");
+	append(value);
+	append("\r\n");
+}
+
+void HeaderWriter::add(std::string_view name, size_t value)
+{
+	char digits[24];
+	const std::to_chars_result result =
+		std::to_chars(digits, digits + sizeof(digits), value);
+
+	add(name, std::string_view(digits, result.ptr - digits));
+}
+
+std::string_view HeaderWriter::view(void) const
+{
+	return (std::string_view(_buffer, _length));
+}
+
+std::string_view HeaderWriter::finish(void)
+{
+	_buffer[_length++] = '\r';
+	_buffer[_length++] = '\n';
+	return (view());
+}
+
+bool HeaderWriter::overflowed(void) const
+{
+	return (_overflow);
+}
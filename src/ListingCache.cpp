@@ -0,0 +1,187 @@
+#include <ListingCache.hpp>
+#include <Logger.hpp>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include <unistd.h>
+
+#include <cstring>
+
+#ifdef __linux__
+#define LISTING_WATCH_MASK                                                     \
+	(IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM |           \
+	 IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
+
+ListingCache::ListingCache()
+	: _entries(), _index(), _size(0), _notify_fd(-1), _watches(),
+	  _watched_dirs()
+{
+#ifdef __linux__
+	_notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (_notify_fd == -1)
+		Logger::getInstance().log(WARNING, "ListingCache: inotify: %",
+								  std::strerror(errno));
+#endif
+}
+
+ListingCache::~ListingCache()
+{
+	if (_notify_fd != -1)
+		close(_notify_fd);
+}
+
+ListingCache &ListingCache::getInstance()
+{
+	static ListingCache instance;
+	return (instance);
+}
+
+std::shared_ptr<const std::string>
+ListingCache::find(const std::string &dir, const std::string &uri,
+				   const struct stat &dir_stat)
+{
+	auto it = _index.find(dir + '\n' + uri);
+
+	if (it == _index.end())
+		return (nullptr);
+	if (it->second->mtime != dir_stat.st_mtime ||
+		(_notify_fd == -1 && it->second->created != time(nullptr)))
+	{
+		erase(it->second);
+		return (nullptr);
+	}
+	_entries.splice(_entries.begin(), _entries, it->second);
+	return (it->second->body);
+}
+
+void ListingCache::store(const std::string &dir, const std::string &uri,
+						 const struct stat &dir_stat,
+						 std::shared_ptr<const std::string> listing)
+{
+	const std::string key = dir + '\n' + uri;
+	auto it = _index.find(key);
+
+	if (listing->size() > LISTING_CACHE_SIZE)
+		return;
+	if (it != _index.end())
+		erase(it->second);
+	if (!watch(dir))
+		return;
+	_entries.push_front(
+		Listing{key, dir, dir_stat.st_mtime, time(nullptr), listing});
+	_index.emplace(key, _entries.begin());
+	_size += listing->size();
+	while (_size > LISTING_CACHE_SIZE)
+		erase(std::prev(_entries.end()));
+}
+
+int ListingCache::getNotifyFD(void) const
+{
+	return (_notify_fd);
+}
+
+// Drains the inotify queue and drops every listing of a directory that
+// changed, or all of them if the queue overflowed and events were lost.
+void ListingCache::handleEvents(void)
+{
+#ifdef __linux__
+	alignas(struct inotify_event) char buffer[4096];
+	ssize_t length;
+
+	while ((length = read(_notify_fd, buffer, sizeof(buffer))) > 0)
+	{
+		for (char *ptr = buffer; ptr < buffer + length;)
+		{
+			const struct inotify_event *event =
+				reinterpret_cast<struct inotify_event *>(ptr);
+			auto watch = _watches.find(event->wd);
+
+			ptr += sizeof(struct inotify_event) + event->len;
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				clear();
+				continue;
+			}
+			if (watch == _watches.end())
+				continue;
+			const std::string dir = watch->second;
+			Logger::getInstance().log(DEBUG, "ListingCache: % changed", dir);
+			if (event->mask & IN_IGNORED)
+			{
+				_watches.erase(watch);
+				_watched_dirs.erase(dir);
+			}
+			invalidate(dir);
+		}
+	}
+#endif
+}
+
+void ListingCache::erase(std::list<Listing>::iterator it)
+{
+	const std::string dir = it->dir;
+
+	_size -= it->body->size();
+	_index.erase(it->key);
+	_entries.erase(it);
+	for (const Listing &listing : _entries)
+	{
+		if (listing.dir == dir)
+			return;
+	}
+	unwatch(dir);
+}
+
+void ListingCache::invalidate(const std::string &dir)
+{
+	for (auto it = _entries.begin(); it != _entries.end();)
+	{
+		auto next = std::next(it);
+
+		if (it->dir == dir)
+			erase(it);
+		it = next;
+	}
+}
+
+void ListingCache::clear(void)
+{
+	while (!_entries.empty())
+		erase(_entries.begin());
+}
+
+// False when the directory can't be watched, its listings then can't be
+// cached either.
+bool ListingCache::watch(const std::string &dir)
+{
+#ifdef __linux__
+	if (_notify_fd == -1 || _watched_dirs.count(dir) != 0)
+		return (true);
+	const int wd = inotify_add_watch(_notify_fd, dir.c_str(),
+									 LISTING_WATCH_MASK | IN_ONLYDIR);
+	if (wd == -1)
+		return (false);
+	_watches[wd] = dir;
+	_watched_dirs[dir] = wd;
+#else
+	(void)dir;
+#endif
+	return (true);
+}
+
+void ListingCache::unwatch(const std::string &dir)
+{
+#ifdef __linux__
+	auto it = _watched_dirs.find(dir);
+
+	if (it == _watched_dirs.end())
+		return;
+	inotify_rm_watch(_notify_fd, it->second);
+	_watches.erase(it->second);
+	_watched_dirs.erase(it);
+#else
+	(void)dir;
+#endif
+}
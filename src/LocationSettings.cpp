@@ -1,22 +1,41 @@
 
 #include <HTTPRequest.hpp>
+#include <HTTPResponse.hpp>
+#include <HTTPStatus.hpp>
+#include <HeaderWriter.hpp>
 #include <LocationSettings.hpp>
 #include <Logger.hpp>
+#include <MimeTypes.hpp>
 #include <Token.hpp>
 
 #include <stdexcept>
 #include <string>
 
 LocationSettings::LocationSettings()
-	: _path(), _alias(), _index(), _allowed_methods(), _cgi(false), _redirect(),
-	  _auto_index(false)
+	: _path(), _alias(), _index(), _allowed_methods(), _cgi(false),
+	  _fastcgi_pass(), _cgi_pool(0),
+	  _cgi_pool_max_requests(CGI_POOL_DEFAULT_MAX_REQUESTS),
+	  _cgi_pool_max_age(CGI_POOL_DEFAULT_MAX_AGE),
+	  _cgi_limits{CGI_DEFAULT_TIMEOUT, 0, 0, 0, 0}, _cgi_cache(0),
+	  _cgi_cache_stale(0), _handler(), _return_code(0), _redirect(), _return(),
+	  _auto_index(false), _gzip_static(false), _gzip(false),
+	  _gzip_comp_level(GZIP_DEFAULT_COMP_LEVEL),
+	  _gzip_min_length(GZIP_DEFAULT_MIN_LENGTH), _gzip_types()
 {
 }
 
 LocationSettings::LocationSettings(const LocationSettings &rhs)
 	: _path(rhs._path), _alias(rhs._alias), _index(rhs._index),
 	  _allowed_methods(rhs._allowed_methods), _cgi(rhs._cgi),
-	  _redirect(rhs._redirect), _auto_index(rhs._auto_index)
+	  _fastcgi_pass(rhs._fastcgi_pass), _cgi_pool(rhs._cgi_pool),
+	  _cgi_pool_max_requests(rhs._cgi_pool_max_requests),
+	  _cgi_pool_max_age(rhs._cgi_pool_max_age), _cgi_limits(rhs._cgi_limits),
+	  _cgi_cache(rhs._cgi_cache), _cgi_cache_stale(rhs._cgi_cache_stale),
+	  _handler(rhs._handler), _return_code(rhs._return_code),
+	  _redirect(rhs._redirect), _return(rhs._return),
+	  _auto_index(rhs._auto_index), _gzip_static(rhs._gzip_static),
+	  _gzip(rhs._gzip), _gzip_comp_level(rhs._gzip_comp_level),
+	  _gzip_min_length(rhs._gzip_min_length), _gzip_types(rhs._gzip_types)
 {
 }
 
@@ -31,8 +50,23 @@ LocationSettings &LocationSettings::operator=(const LocationSettings &rhs)
 	_index = rhs._index;
 	_allowed_methods = rhs._allowed_methods;
 	_cgi = rhs._cgi;
+	_fastcgi_pass = rhs._fastcgi_pass;
+	_cgi_pool = rhs._cgi_pool;
+	_cgi_pool_max_requests = rhs._cgi_pool_max_requests;
+	_cgi_pool_max_age = rhs._cgi_pool_max_age;
+	_cgi_limits = rhs._cgi_limits;
+	_cgi_cache = rhs._cgi_cache;
+	_cgi_cache_stale = rhs._cgi_cache_stale;
+	_handler = rhs._handler;
+	_return_code = rhs._return_code;
 	_redirect = rhs._redirect;
+	_return = rhs._return;
 	_auto_index = rhs._auto_index;
+	_gzip_static = rhs._gzip_static;
+	_gzip = rhs._gzip;
+	_gzip_comp_level = rhs._gzip_comp_level;
+	_gzip_min_length = rhs._gzip_min_length;
+	_gzip_types = rhs._gzip_types;
 
 	return (*this);
 }
@@ -42,7 +76,14 @@ LocationSettings::~LocationSettings()
 }
 
 LocationSettings::LocationSettings(std::vector<Token>::iterator &token)
-	: _cgi(false), _auto_index(false)
+	: _cgi(false), _cgi_pool(0),
+	  _cgi_pool_max_requests(CGI_POOL_DEFAULT_MAX_REQUESTS),
+	  _cgi_pool_max_age(CGI_POOL_DEFAULT_MAX_AGE),
+	  _cgi_limits{CGI_DEFAULT_TIMEOUT, 0, 0, 0, 0}, _cgi_cache(0),
+	  _cgi_cache_stale(0), _handler(), _return_code(0), _auto_index(false),
+	  _gzip_static(false), _gzip(false),
+	  _gzip_comp_level(GZIP_DEFAULT_COMP_LEVEL),
+	  _gzip_min_length(GZIP_DEFAULT_MIN_LENGTH), _gzip_types()
 {
 	_path = token->getString();
 	token += 2;
@@ -66,8 +107,34 @@ LocationSettings::LocationSettings(std::vector<Token>::iterator &token)
 				parseAllowedMethods(*token);
 			else if (key.getString() == "cgi")
 				parseCgiPath(*token);
+			else if (key.getString() == "fastcgi_pass")
+				parseFastCGIPass(*token);
+			else if (key.getString() == "cgi_pool")
+				parseCGIPool(*token);
+			else if (key.getString() == "cgi_pool_max_requests" ||
+					 key.getString() == "cgi_pool_max_age")
+				parseCGIPoolRecycle(key.getString(), *token);
+			else if (key.getString() == "cgi_timeout" ||
+					 key.getString() == "cgi_max_output" ||
+					 key.getString().compare(0, 11, "cgi_rlimit_") == 0)
+				parseCGILimit(key.getString(), *token);
+			else if (key.getString() == "cgi_cache" ||
+					 key.getString() == "cgi_cache_stale")
+				parseCGICache(key.getString(), *token);
+			else if (key.getString() == "handler")
+				parseHandler(*token);
 			else if (key.getString() == "return")
 				parseReturn(*token);
+			else if (key.getString() == "gzip_static")
+				parseGzipStatic(*token);
+			else if (key.getString() == "gzip")
+				parseGzip(*token);
+			else if (key.getString() == "gzip_comp_level")
+				parseGzipCompLevel(*token);
+			else if (key.getString() == "gzip_min_length")
+				parseGzipMinLength(*token);
+			else if (key.getString() == "gzip_types")
+				parseGzipTypes(*token);
 			else
 			{
 				logger.log(WARNING, "LocationSettings: unknown KEY token: " +
@@ -78,6 +145,8 @@ LocationSettings::LocationSettings(std::vector<Token>::iterator &token)
 		}
 		token++;
 	}
+	if (_return_code != 0 || !_redirect.empty())
+		compileReturn();
 }
 
 void LocationSettings::parseAlias(const Token token)
@@ -119,7 +188,8 @@ void LocationSettings::parseAutoIndex(const Token token)
 void LocationSettings::parseAllowedMethods(const Token token)
 {
 	if (token.getString() != "GET" && token.getString() != "POST" &&
-		token.getString() != "DELETE")
+		token.getString() != "DELETE" && token.getString() != "PUT" &&
+		token.getString() != "PATCH")
 		throw std::runtime_error(
 			"ConfigParser: Unknown VALUE for allowed_methods: " +
 			token.getString());
@@ -143,15 +213,236 @@ void LocationSettings::parseCgiPath(const Token token)
 								 token.getString());
 }
 
+// fastcgi_pass unix:/path/to/socket; or fastcgi_pass host:port; hands the
+// location's requests to a FastCGI application server instead of forking.
+void LocationSettings::parseFastCGIPass(const Token token)
+{
+	const std::string &value = token.getString();
+	const size_t colon = value.find_last_of(':');
+
+	if (value.compare(0, 5, "unix:") == 0)
+	{
+		if (value.size() == 5)
+			throw std::runtime_error(
+				"ConfigParser: invalid fastcgi_pass socket: " + value);
+	}
+	else if (colon == std::string::npos || colon == 0 ||
+			 value.find_first_not_of("0123456789", colon + 1) !=
+				 std::string::npos ||
+			 colon + 1 == value.size() || colon + 6 < value.size() ||
+			 std::stoul(value.substr(colon + 1)) - 1 > 65534)
+		throw std::runtime_error(
+			"ConfigParser: invalid fastcgi_pass [unix:path | host:port]: " +
+			value);
+	_fastcgi_pass = value;
+	_cgi = true;
+}
+
+// cgi_pool <workers>; serves the location's scripts from that many
+// persistent interpreters instead of forking one per request.
+void LocationSettings::parseCGIPool(const Token token)
+{
+	const std::string &value = token.getString();
+
+	if (value.empty() || value.size() > 2 ||
+		value.find_first_not_of("0123456789") != std::string::npos ||
+		std::stoul(value) == 0 || std::stoul(value) > CGI_POOL_MAX_WORKERS)
+		throw std::runtime_error("ConfigParser: invalid cgi_pool [1 - " +
+								 std::to_string(CGI_POOL_MAX_WORKERS) +
+								 "]: " + value);
+	_cgi_pool = std::stoul(value);
+	_cgi = true;
+}
+
+// cgi_pool_max_requests <count>; cgi_pool_max_age <seconds>; a worker is
+// replaced once it served that many requests or ran that long.
+void LocationSettings::parseCGIPoolRecycle(const std::string &key,
+										   const Token token)
+{
+	const std::string &value = token.getString();
+
+	if (value.empty() || value.size() > 9 ||
+		value.find_first_not_of("0123456789") != std::string::npos ||
+		std::stoul(value) == 0)
+		throw std::runtime_error("ConfigParser: invalid " + key + ": " +
+								 value);
+	if (key == "cgi_pool_max_requests")
+		_cgi_pool_max_requests = std::stoul(value);
+	else
+		_cgi_pool_max_age = std::stoul(value);
+}
+
+// cgi_timeout <seconds>; cgi_max_output <size>; cgi_rlimit_cpu <seconds>;
+// cgi_rlimit_as <size>; cgi_rlimit_nofile <count>; a size is in bytes or
+// has a K, M or G suffix. 0 lifts a limit, except for cgi_timeout.
+void LocationSettings::parseCGILimit(const std::string &key, const Token token)
+{
+	const std::string &value = token.getString();
+	const size_t digits = value.find_first_not_of("0123456789");
+	const bool sized = key == "cgi_max_output" || key == "cgi_rlimit_as";
+	size_t shift = 0;
+	size_t *limit = nullptr;
+
+	if (key == "cgi_timeout")
+		limit = &_cgi_limits.timeout;
+	else if (key == "cgi_max_output")
+		limit = &_cgi_limits.max_output;
+	else if (key == "cgi_rlimit_cpu")
+		limit = &_cgi_limits.cpu;
+	else if (key == "cgi_rlimit_as")
+		limit = &_cgi_limits.address_space;
+	else if (key == "cgi_rlimit_nofile")
+		limit = &_cgi_limits.open_files;
+	if (sized && digits != std::string::npos && digits + 1 == value.size())
+		shift = 10 * (std::string("KMG").find(value[digits]) + 1);
+	if (limit == nullptr || digits == 0 || value.size() > 9 ||
+		(digits != std::string::npos && shift == 0) ||
+		(key == "cgi_timeout" && std::stoul(value) == 0))
+		throw std::runtime_error("ConfigParser: invalid " + key + ": " +
+								 value);
+	*limit = std::stoul(value) << shift;
+}
+
+// cgi_cache <seconds>; keeps complete CGI responses of GET requests that
+// long, unless the script's Cache-Control says otherwise. cgi_cache_stale
+// <seconds>; serves them stale for a while longer as they're regenerated.
+void LocationSettings::parseCGICache(const std::string &key, const Token token)
+{
+	const std::string &value = token.getString();
+
+	if (value.empty() || value.size() > 9 ||
+		value.find_first_not_of("0123456789") != std::string::npos)
+		throw std::runtime_error("ConfigParser: invalid " + key + ": " +
+								 value);
+	if (key == "cgi_cache")
+		_cgi_cache = std::stoul(value);
+	else
+		_cgi_cache_stale = std::stoul(value);
+}
+
+// handler <path.so>; a module the Handlers load at startup, see
+// webserv_handler.h.
+void LocationSettings::parseHandler(const Token token)
+{
+	const std::string &value = token.getString();
+
+	if (value.size() < 4 || value.compare(value.size() - 3, 3, ".so") != 0)
+		throw std::runtime_error("ConfigParser: invalid handler: " + value);
+	_handler = value;
+}
+
+// return <url>; return <code> <url>; for a redirect, return <code>; or
+// return <code> "<text>"; for a fixed response.
 void LocationSettings::parseReturn(const Token token)
 {
 	Logger &logger = Logger::getInstance();
+	const std::string &value = token.getString();
 
+	if (_return_code == 0 && _redirect.empty() && value.size() == 3 &&
+		value.find_first_not_of("0123456789") == std::string::npos)
+	{
+		_return_code = std::stoi(value);
+		return;
+	}
 	if (!_redirect.empty())
 		logger.log(WARNING,
 				   "ConfigParser: redefining return in locationblock: " +
 					   _path);
-	_redirect = token.getString();
+	_redirect = value;
+}
+
+static bool isRedirect(int code)
+{
+	return (code == 301 || code == 302 || code == 303 || code == 307 ||
+			code == 308);
+}
+
+// Serializes the response of a return directive once, requests for the
+// location are then answered with it as they are with an error page.
+void LocationSettings::compileReturn(void)
+{
+	std::shared_ptr<CannedResponse> canned = std::make_shared<CannedResponse>();
+	HeaderWriter head;
+
+	if (_return_code == 0)
+		_return_code = static_cast<int>(StatusCode::Found);
+	if (!HTTPStatus::isKnown(static_cast<StatusCode>(_return_code)))
+		throw std::runtime_error("ConfigParser: unknown return code: " +
+								 std::to_string(_return_code) +
+								 " in block: " + _path);
+	if (isRedirect(_return_code) && _redirect.empty())
+		throw std::runtime_error(
+			"ConfigParser: return without a URL in block: " + _path);
+	head.add("Server", SERVER_SOFTWARE);
+	if (isRedirect(_return_code))
+	{
+		head.add("Location", _redirect);
+		head.add("Content-Length", static_cast<size_t>(0));
+	}
+	else
+	{
+		head.add("Content-Type", MimeTypes::fromExtension("txt"));
+		head.add("Content-Length", _redirect.size());
+	}
+	canned->status_line =
+		HTTPStatus::statusLine(static_cast<StatusCode>(_return_code));
+	canned->tail = head.finish();
+	if (!isRedirect(_return_code))
+		canned->tail += _redirect;
+	_return = canned;
+}
+
+void LocationSettings::parseGzipStatic(const Token token)
+{
+	if (token.getString() == "on" || token.getString() == "ON")
+		_gzip_static = true;
+	else if (token.getString() == "off" || token.getString() == "OFF")
+		_gzip_static = false;
+	else
+		throw std::runtime_error(
+			"ConfigParser: Unknown VALUE for gzip_static: " +
+			token.getString());
+}
+
+void LocationSettings::parseGzip(const Token token)
+{
+	if (token.getString() == "on" || token.getString() == "ON")
+		_gzip = true;
+	else if (token.getString() == "off" || token.getString() == "OFF")
+		_gzip = false;
+	else
+		throw std::runtime_error("ConfigParser: Unknown VALUE for gzip: " +
+								 token.getString());
+}
+
+void LocationSettings::parseGzipCompLevel(const Token token)
+{
+	const std::string &value = token.getString();
+
+	if (value.size() != 1 || value[0] < '1' || value[0] > '9')
+		throw std::runtime_error(
+			"ConfigParser: invalid gzip_comp_level [1 - 9]: " + value);
+	_gzip_comp_level = value[0] - '0';
+}
+
+void LocationSettings::parseGzipMinLength(const Token token)
+{
+	const std::string &value = token.getString();
+
+	if (value.empty() ||
+		value.find_first_not_of("0123456789") != std::string::npos)
+		throw std::runtime_error(
+			"ConfigParser: invalid gzip_min_length (bytes): " + value);
+	_gzip_min_length = std::stoul(value);
+}
+
+void LocationSettings::parseGzipTypes(const Token token)
+{
+	if (token.getString().find('/') == std::string::npos)
+		throw std::runtime_error(
+			"ConfigParser: invalid MIME type for gzip_types: " +
+			token.getString());
+	_gzip_types.append(" " + token.getString());
 }
 
 // Functionality:
@@ -181,16 +472,86 @@ const bool &LocationSettings::getAutoIndex() const
 	return (_auto_index);
 }
 
+const bool &LocationSettings::getGzipStatic() const
+{
+	return (_gzip_static);
+}
+
+const bool &LocationSettings::getGzip() const
+{
+	return (_gzip);
+}
+
+int LocationSettings::getGzipCompLevel() const
+{
+	return (_gzip_comp_level);
+}
+
+size_t LocationSettings::getGzipMinLength() const
+{
+	return (_gzip_min_length);
+}
+
+const std::string &LocationSettings::getGzipTypes() const
+{
+	return (_gzip_types);
+}
+
 const std::string &LocationSettings::getRedirect() const
 {
 	return (_redirect);
 }
 
+const std::shared_ptr<const CannedResponse> &LocationSettings::getReturn() const
+{
+	return (_return);
+}
+
 const bool &LocationSettings::getCGI() const
 {
 	return (_cgi);
 }
 
+const std::string &LocationSettings::getFastCGIPass() const
+{
+	return (_fastcgi_pass);
+}
+
+size_t LocationSettings::getCGIPool() const
+{
+	return (_cgi_pool);
+}
+
+size_t LocationSettings::getCGIPoolMaxRequests() const
+{
+	return (_cgi_pool_max_requests);
+}
+
+size_t LocationSettings::getCGIPoolMaxAge() const
+{
+	return (_cgi_pool_max_age);
+}
+
+const CGILimits &LocationSettings::getCGILimits() const
+{
+	return (_cgi_limits);
+}
+
+size_t LocationSettings::getCGICache() const
+{
+	return (_cgi_cache);
+}
+
+size_t LocationSettings::getCGICacheStale() const
+{
+	return (_cgi_cache_stale);
+}
+
+const std::string &LocationSettings::getHandler() const
+{
+	return (_handler);
+}
+
 const std::string MethodToString(HTTPMethod num)
 {
 	switch (num)
@@ -201,6 +562,10 @@ const std::string MethodToString(HTTPMethod num)
 		return ("POST");
 	case (HTTPMethod::DELETE):
 		return ("DELETE");
+	case (HTTPMethod::PUT):
+		return ("PUT");
+	case (HTTPMethod::PATCH):
+		return ("PATCH");
 	default:
 	{
 		Logger &logger = Logger::getInstance();
@@ -235,6 +600,23 @@ bool LocationSettings::resolveMethod(const HTTPMethod method) const
 	return (false);
 }
 
+// resolveGzipType: text/html is always compressed when gzip is on, other
+// types have to be listed with gzip_types.
+bool LocationSettings::resolveGzipType(const std::string &mime_type) const
+{
+	if (mime_type == "text/html")
+		return (true);
+
+	std::stringstream ss(getGzipTypes());
+	std::string option;
+	for (; std::getline(ss, option, ' ');)
+	{
+		if (option == mime_type || option == "*")
+			return (true);
+	}
+	return (false);
+}
+
 // resolveAlias
 const std::string LocationSettings::resolveAlias(const std::string inp) const
 {
@@ -265,8 +647,30 @@ void LocationSettings::printLocationSettings() const
 	logger.log(DEBUG, "\t\tAllowed_methods:\t" + _allowed_methods);
 	logger.log(DEBUG, "\t\tCGI:\t\t\t" +
 						  (_cgi ? std::string(" ON") : std::string(" OFF")));
+	logger.log(DEBUG, "\t\tFastCGI:\t\t" + _fastcgi_pass);
+	logger.log(DEBUG, "\t\tCGI pool:\t\t" + std::to_string(_cgi_pool) +
+						  " max_requests " +
+						  std::to_string(_cgi_pool_max_requests) +
+						  " max_age " + std::to_string(_cgi_pool_max_age));
+	logger.log(DEBUG, "\t\tCGI limits:\t\ttimeout " +
+						  std::to_string(_cgi_limits.timeout) + " output " +
+						  std::to_string(_cgi_limits.max_output) + " cpu " +
+						  std::to_string(_cgi_limits.cpu) + " as " +
+						  std::to_string(_cgi_limits.address_space) +
+						  " nofile " + std::to_string(_cgi_limits.open_files));
+	logger.log(DEBUG, "\t\tCGI cache:\t\t" + std::to_string(_cgi_cache) +
+						  " stale " + std::to_string(_cgi_cache_stale));
+	logger.log(DEBUG, "\t\tHandler:\t\t" + _handler);
 	logger.log(DEBUG, "\t\tRedirect:\t\t" + _redirect);
 	logger.log(DEBUG,
 			   "\t\tAutoIndex:\t\t" +
 				   (_auto_index ? std::string(" ON") : std::string(" OFF")));
+	logger.log(DEBUG, "\t\tGzip:\t\t\t" +
+						  (_gzip ? std::string(" ON") : std::string(" OFF")) +
+						  " level " + std::to_string(_gzip_comp_level) +
+						  " min_length " + std::to_string(_gzip_min_length) +
+						  " types" + _gzip_types);
+	logger.log(DEBUG,
+			   "\t\tGzipStatic:\t\t" +
+				   (_gzip_static ? std::string(" ON") : std::string(" OFF")));
 }
@@ -0,0 +1,209 @@
+#include <Logger.hpp>
+#include <MissCache.hpp>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#define MISS_WATCH_MASK                                                        \
+	(IN_CREATE | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
+
+MissCache::MissCache()
+	: _entries(), _index(), _notify_fd(-1), _watches(), _watched_dirs()
+{
+#ifdef __linux__
+	_notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (_notify_fd == -1)
+		Logger::getInstance().log(WARNING, "MissCache: inotify: %",
+								  std::strerror(errno));
+#endif
+}
+
+MissCache::~MissCache()
+{
+	if (_notify_fd != -1)
+		close(_notify_fd);
+}
+
+MissCache &MissCache::getInstance()
+{
+	static MissCache instance;
+	return (instance);
+}
+
+bool MissCache::contains(const std::string &path)
+{
+	auto it = _index.find(path);
+
+	if (it == _index.end())
+		return (false);
+	if (it->second->expires <= time(nullptr))
+	{
+		erase(it->second);
+		return (false);
+	}
+	return (true);
+}
+
+void MissCache::store(const std::string &path)
+{
+	std::string dir;
+	auto it = _index.find(path);
+
+	if (it != _index.end())
+		erase(it->second);
+	if (!watch(path, dir))
+		return;
+	_entries.push_front(Miss{path, dir, time(nullptr) + MISS_CACHE_TTL});
+	_index.emplace(path, _entries.begin());
+	if (!dir.empty())
+		_watched_dirs[dir].entries++;
+	while (_entries.size() > MISS_CACHE_ENTRIES)
+		erase(std::prev(_entries.end()));
+}
+
+// For files the server creates itself, which must not wait for the inotify
+// event to be read. A directory drops every miss below it.
+void MissCache::forget(const std::string &path)
+{
+	if (path.empty() || path.back() != '/')
+	{
+		auto it = _index.find(path);
+
+		if (it != _index.end())
+			erase(it->second);
+		return;
+	}
+	for (auto it = _entries.begin(); it != _entries.end();)
+	{
+		auto next = std::next(it);
+
+		if (it->path.compare(0, path.size(), path) == 0)
+			erase(it);
+		it = next;
+	}
+}
+
+int MissCache::getNotifyFD(void) const
+{
+	return (_notify_fd);
+}
+
+// Drains the inotify queue. Something appearing in a watched directory may
+// be any of the missing paths below it, so all of them are dropped.
+void MissCache::handleEvents(void)
+{
+#ifdef __linux__
+	alignas(struct inotify_event) char buffer[4096];
+	ssize_t length;
+
+	while ((length = read(_notify_fd, buffer, sizeof(buffer))) > 0)
+	{
+		for (char *ptr = buffer; ptr < buffer + length;)
+		{
+			const struct inotify_event *event =
+				reinterpret_cast<struct inotify_event *>(ptr);
+			auto watch = _watches.find(event->wd);
+
+			ptr += sizeof(struct inotify_event) + event->len;
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				clear();
+				continue;
+			}
+			if (watch == _watches.end())
+				continue;
+			const std::string dir = watch->second;
+			Logger::getInstance().log(DEBUG, "MissCache: % changed", dir);
+			invalidate(dir);
+		}
+	}
+#endif
+}
+
+void MissCache::erase(std::list<Miss>::iterator it)
+{
+	const std::string dir = it->dir;
+
+	_index.erase(it->path);
+	_entries.erase(it);
+	if (!dir.empty() && --_watched_dirs[dir].entries == 0)
+		unwatch(dir);
+}
+
+void MissCache::invalidate(const std::string &dir)
+{
+	for (auto it = _entries.begin(); it != _entries.end();)
+	{
+		auto next = std::next(it);
+
+		if (it->dir == dir)
+			erase(it);
+		it = next;
+	}
+}
+
+void MissCache::clear(void)
+{
+	while (!_entries.empty())
+		erase(_entries.begin());
+}
+
+// Watches the closest ancestor of path that exists, a scanner's paths rarely
+// have an existing parent. False when there is nothing that can be watched,
+// the miss then can't be cached either.
+bool MissCache::watch(const std::string &path, std::string &dir)
+{
+#ifdef __linux__
+	if (_notify_fd == -1)
+		return (true);
+	dir = path;
+	for (;;)
+	{
+		const size_t slash = dir.find_last_of('/');
+
+		if (slash == std::string::npos)
+			dir = ".";
+		else
+			dir.erase(slash == 0 ? 1 : slash);
+		if (_watched_dirs.count(dir) != 0)
+			return (true);
+
+		const int wd = inotify_add_watch(_notify_fd, dir.c_str(),
+										 MISS_WATCH_MASK | IN_ONLYDIR);
+		if (wd != -1)
+		{
+			_watches[wd] = dir;
+			_watched_dirs[dir] = Watch{wd, 0};
+			return (true);
+		}
+		if ((errno != ENOENT && errno != ENOTDIR) || dir == "." || dir == "/")
+			return (false);
+	}
+#else
+	(void)path;
+	(void)dir;
+	return (true);
+#endif
+}
+
+void MissCache::unwatch(const std::string &dir)
+{
+#ifdef __linux__
+	auto it = _watched_dirs.find(dir);
+
+	if (it == _watched_dirs.end())
+		return;
+	inotify_rm_watch(_notify_fd, it->second.wd);
+	_watches.erase(it->second.wd);
+	_watched_dirs.erase(it);
+#else
+	(void)dir;
+#endif
+}
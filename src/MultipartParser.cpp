@@ -0,0 +1,208 @@
+#include "MultipartParser.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <sstream>
+
+static std::string toLower(std::string str)
+{
+	for (char &c : str)
+		c = std::tolower(static_cast<unsigned char>(c));
+	return (str);
+}
+
+static std::string trim(const std::string &str)
+{
+	const size_t first = str.find_first_not_of(" \t");
+
+	if (first == std::string::npos)
+		return ("");
+	return (str.substr(first, str.find_last_not_of(" \t") - first + 1));
+}
+
+static std::string unquote(const std::string &str)
+{
+	if (str.size() >= 2 && str.front() == '"' && str.back() == '"')
+		return (str.substr(1, str.size() - 2));
+	return (str);
+}
+
+// Value of the parameter key in a "value; key=value; ..." header, or "" when
+// it isn't there.
+static std::string headerParam(const std::string &value,
+							   const std::string &key)
+{
+	std::stringstream ss(value);
+	std::string param;
+
+	std::getline(ss, param, ';');
+	while (std::getline(ss, param, ';'))
+	{
+		const size_t equals = param.find('=');
+
+		if (equals == std::string::npos)
+			continue;
+		if (toLower(trim(param.substr(0, equals))) == key)
+			return (unquote(trim(param.substr(equals + 1))));
+	}
+	return ("");
+}
+
+// The delimiter is "\r\n--boundary". The body opens with "--boundary" without
+// the line break, so the buffer starts out holding one.
+MultipartParser::MultipartParser(const std::string &boundary,
+								 PartHandler on_part, DataHandler on_data)
+	: _delimiter("\r\n--" + boundary), _skip(), _buffer("\r\n"),
+	  _state(State::Preamble), _on_part(std::move(on_part)),
+	  _on_data(std::move(on_data))
+{
+	const size_t last = _delimiter.size() - 1;
+
+	_skip.fill(_delimiter.size());
+	for (size_t i = 0; i < last; i++)
+		_skip[static_cast<unsigned char>(_delimiter[i])] = last - i;
+}
+
+MultipartParser::~MultipartParser()
+{
+}
+
+// Boyer-Moore-Horspool: compare the last byte of the window first and on a
+// mismatch shift by how far that byte is from the end of the delimiter.
+size_t MultipartParser::search(const char *data, size_t size) const
+{
+	const size_t last = _delimiter.size() - 1;
+	const char tail = _delimiter[last];
+
+	for (size_t i = 0; i + last < size;
+		 i += _skip[static_cast<unsigned char>(data[i + last])])
+	{
+		if (data[i + last] == tail &&
+			std::memcmp(data + i, _delimiter.data(), last) == 0)
+			return (i);
+	}
+	return (std::string::npos);
+}
+
+bool MultipartParser::parseHeaders(const std::string &block, Part &part) const
+{
+	std::stringstream ss(block);
+	std::string line;
+
+	while (std::getline(ss, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		const size_t colon = line.find(':');
+		if (colon == std::string::npos)
+			return (false);
+
+		const std::string key = toLower(trim(line.substr(0, colon)));
+		const std::string value = trim(line.substr(colon + 1));
+		if (key == "content-disposition")
+		{
+			part.name = headerParam(value, "name");
+			part.filename = headerParam(value, "filename");
+		}
+		else if (key == "content-type")
+			part.content_type = value;
+	}
+	return (true);
+}
+
+bool MultipartParser::feed(const char *data, size_t size)
+{
+	size_t pos = 0;
+
+	_buffer.append(data, size);
+	while (pos < _buffer.size() && _state != State::Epilogue)
+	{
+		const char *begin = _buffer.data() + pos;
+		const size_t available = _buffer.size() - pos;
+
+		if (_state == State::Preamble || _state == State::Body)
+		{
+			const size_t found = search(begin, available);
+
+			if (found == std::string::npos)
+			{
+				// The last bytes may be the start of a delimiter split
+				// across chunks; everything before them is part data.
+				const size_t safe =
+					available - std::min(available, _delimiter.size() - 1);
+
+				if (_state == State::Body && safe > 0)
+					_on_data(begin, safe);
+				pos += safe;
+				break;
+			}
+			if (_state == State::Body && found > 0)
+				_on_data(begin, found);
+			pos += found + _delimiter.size();
+			_state = State::Delimiter;
+		}
+		else if (_state == State::Delimiter)
+		{
+			if (available < 2)
+				break;
+			if (begin[0] == '-' && begin[1] == '-')
+				_state = State::Epilogue;
+			else if (begin[0] == '\r' && begin[1] == '\n')
+				_state = State::Headers;
+			else
+				return (false);
+			pos += 2;
+		}
+		else if (_state == State::Headers)
+		{
+			size_t end;
+
+			if (available >= 2 && begin[0] == '\r' && begin[1] == '\n')
+				end = pos;
+			else
+			{
+				end = _buffer.find("\r\n\r\n", pos);
+				if (end == std::string::npos)
+				{
+					if (available > MULTIPART_HEADER_MAX)
+						return (false);
+					break;
+				}
+				end += 2;
+			}
+			Part part;
+
+			if (!parseHeaders(_buffer.substr(pos, end - pos), part))
+				return (false);
+			_on_part(part);
+			pos = end + 2;
+			_state = State::Body;
+		}
+	}
+	if (_state == State::Epilogue)
+		_buffer.clear();
+	else
+		_buffer.erase(0, pos);
+	return (true);
+}
+
+bool MultipartParser::isDone(void) const
+{
+	return (_state == State::Epilogue);
+}
+
+// The boundary parameter of a multipart/form-data Content-Type, or "" for any
+// other type or a boundary RFC 2046 doesn't allow.
+std::string MultipartParser::boundaryOf(const std::string &content_type)
+{
+	const std::string type =
+		toLower(trim(content_type.substr(0, content_type.find(';'))));
+	const std::string boundary = headerParam(content_type, "boundary");
+
+	if (type != "multipart/form-data" || boundary.empty() ||
+		boundary.size() > 70)
+		return ("");
+	return (boundary);
+}
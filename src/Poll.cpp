@@ -1,5 +1,6 @@
 #include <Logger.hpp>
 #include <Poll.hpp>
+#include <cerrno>
 #include <stdexcept>
 
 Poll::Poll() : _poll_fds()
@@ -37,13 +38,20 @@ std::vector<pollfd> Poll::getPollFDs(void) const
 	return (_poll_fds);
 }
 
-bool Poll::pollFDs(void)
+bool Poll::pollFDs(int timeout)
 {
 	Logger &logger = Logger::getInstance();
 	logger.log(INFO, "Polling " + std::to_string(_poll_fds.size()) +
 						 " file descriptors");
 
-	int poll_count = poll(_poll_fds.data(), _poll_fds.size(), 2500);
+	int poll_count = poll(_poll_fds.data(), _poll_fds.size(), timeout);
+	// a SIGCHLD for the ChildReaper, its pipe is readable on the next round
+	if (poll_count == SYSTEM_ERROR && errno == EINTR)
+	{
+		for (pollfd &poll_fd : _poll_fds)
+			poll_fd.revents = 0;
+		return (true);
+	}
 	if (poll_count == SYSTEM_ERROR)
 		throw SystemException("poll");
 	if (poll_count == 0)
@@ -0,0 +1,107 @@
+#include "Precompressor.hpp"
+#include "Compressor.hpp"
+#include "Logger.hpp"
+
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <array>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// Static assets that are worth a sidecar. Images, archives and anything
+// already compressed gain nothing from another gzip pass.
+static const std::array<std::string, 12> compressible_extensions = {
+	".html", ".htm", ".css", ".js",	 ".mjs", ".json",
+	".xml",	 ".svg", ".txt", ".csv", ".md",	 ".ico"};
+
+bool Precompressor::isCompressible(const std::string &path)
+{
+	const std::string extension = std::filesystem::path(path).extension();
+
+	for (const std::string &candidate : compressible_extensions)
+	{
+		if (extension == candidate)
+			return (true);
+	}
+	return (false);
+}
+
+// Writes a gzip member next to the original, going through a temporary file
+// so a request can never observe a half written sidecar. A sidecar that
+// wouldn't be smaller than the original isn't kept.
+bool Precompressor::compressFile(const std::string &path,
+								 const std::string &sidecar)
+{
+	Logger &logger = Logger::getInstance();
+	std::ifstream original(path, std::ios::in | std::ios::binary);
+	std::stringstream content;
+	std::string output;
+
+	if (!original.is_open())
+		return (false);
+	content << original.rdbuf();
+	const std::string input = content.str();
+
+	if (!Compressor::compress(input, output, Compressor::Coding::GZIP,
+							  Z_BEST_COMPRESSION) ||
+		output.size() >= input.size())
+		return (false);
+
+	const std::string tmp = sidecar + ".tmp";
+	std::ofstream out(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+	out.write(output.data(), output.size());
+	out.close();
+	if (out.fail() || std::rename(tmp.c_str(), sidecar.c_str()) != 0)
+	{
+		std::remove(tmp.c_str());
+		return (false);
+	}
+	logger.log(DEBUG, "Precompressor: " + sidecar + " (" +
+						  std::to_string(input.size()) + " -> " +
+						  std::to_string(output.size()) + ")");
+	return (true);
+}
+
+// Fills in missing or outdated .gz sidecars for every compressible file under
+// root. Brotli sidecars aren't generated here (no encoder is linked in) but
+// are served when they were produced offline, e.g. with `brotli -k`.
+void Precompressor::precompressTree(const std::string &root)
+{
+	Logger &logger = Logger::getInstance();
+	std::error_code ec;
+	size_t written = 0;
+
+	logger.log(INFO, "Precompressor: scanning " + root);
+	const std::filesystem::directory_options options =
+		std::filesystem::directory_options::skip_permission_denied;
+
+	for (std::filesystem::recursive_directory_iterator it(root, options, ec),
+		 end;
+		 it != end; it.increment(ec))
+	{
+		if (ec)
+			break;
+		if (!it->is_regular_file(ec) || !isCompressible(it->path()))
+			continue;
+		const std::string path = it->path();
+		const std::string sidecar = path + ".gz";
+		struct stat original_stat;
+		struct stat sidecar_stat;
+
+		if (stat(path.c_str(), &original_stat) != 0)
+			continue;
+		if (stat(sidecar.c_str(), &sidecar_stat) == 0 &&
+			sidecar_stat.st_mtime >= original_stat.st_mtime)
+			continue;
+		if (compressFile(path, sidecar))
+			written++;
+	}
+	if (ec)
+		logger.log(WARNING, "Precompressor: " + root + ": " + ec.message());
+	logger.log(INFO, "Precompressor: wrote " + std::to_string(written) +
+						 " sidecar(s) under " + root);
+}
@@ -0,0 +1,138 @@
+#include <RequestTarget.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Whether path is free of '%' and of "//" and "/." pairs, the only things
+// canonicalization could change.
+static bool isCanonical(const char *path, size_t size)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i percent = _mm_set1_epi8('%');
+	const __m128i slash = _mm_set1_epi8('/');
+	const __m128i dot = _mm_set1_epi8('.');
+
+	// A second load one byte further lines every byte up with its successor,
+	// so a pair is found as a '/' above a '/' or '.'.
+	for (; i + 17 <= size; i += 16)
+	{
+		const __m128i here =
+			_mm_loadu_si128(reinterpret_cast<const __m128i *>(path + i));
+		const __m128i next =
+			_mm_loadu_si128(reinterpret_cast<const __m128i *>(path + i + 1));
+		const __m128i pair = _mm_and_si128(
+			_mm_cmpeq_epi8(here, slash),
+			_mm_or_si128(_mm_cmpeq_epi8(next, slash),
+						 _mm_cmpeq_epi8(next, dot)));
+
+		if (_mm_movemask_epi8(
+				_mm_or_si128(_mm_cmpeq_epi8(here, percent), pair)) != 0)
+			return (false);
+	}
+#endif
+	for (; i < size; i++)
+	{
+		if (path[i] == '%')
+			return (false);
+		if (path[i] == '/' && i + 1 < size &&
+			(path[i + 1] == '/' || path[i + 1] == '.'))
+			return (false);
+	}
+	return (true);
+}
+
+static int hexValue(char c)
+{
+	if (c >= '0' && c <= '9')
+		return (c - '0');
+	if (c >= 'a' && c <= 'f')
+		return (c - 'a' + 10);
+	if (c >= 'A' && c <= 'F')
+		return (c - 'A' + 10);
+	return (-1);
+}
+
+// Decodes every %XX. A truncated or non-hex escape, or an encoded NUL that
+// would cut the path short for the filesystem, makes the target invalid.
+static bool decode(const std::string &path, std::string &decoded)
+{
+	decoded.reserve(path.size());
+	for (size_t i = 0; i < path.size(); i++)
+	{
+		if (path[i] != '%')
+		{
+			decoded += path[i];
+			continue;
+		}
+		if (i + 2 >= path.size())
+			return (false);
+
+		const int high = hexValue(path[i + 1]);
+		const int low = hexValue(path[i + 2]);
+
+		if (high == -1 || low == -1 || (high == 0 && low == 0))
+			return (false);
+		decoded += static_cast<char>(high * 16 + low);
+		i += 2;
+	}
+	return (true);
+}
+
+// Rebuilds path from the segments of decoded, skipping empty and "." ones
+// and letting ".." drop the one before it. ".." above the root is refused
+// rather than clamped. A trailing slash is kept when the last segment named
+// a directory.
+static bool normalize(const std::string &decoded, std::string &path)
+{
+	const std::string last = decoded.substr(decoded.find_last_of('/') + 1);
+	size_t i = 1;
+
+	path = "/";
+	while (i <= decoded.size())
+	{
+		size_t end = decoded.find('/', i);
+
+		if (end == std::string::npos)
+			end = decoded.size();
+		if (decoded.compare(i, end - i, "..") == 0)
+		{
+			if (path.size() == 1)
+				return (false);
+			path.erase(path.find_last_of('/', path.size() - 2) + 1);
+		}
+		else if (end != i && decoded.compare(i, end - i, ".") != 0)
+		{
+			path.append(decoded, i, end - i);
+			path += '/';
+		}
+		i = end + 1;
+	}
+	if (path.size() > 1 && !last.empty() && last != "." && last != "..")
+		path.pop_back();
+	return (true);
+}
+
+// Splits the query off target and canonicalizes what is left in place. False
+// for a target the server can't serve, which is answered with a 400.
+bool RequestTarget::canonicalize(std::string &target, std::string &query)
+{
+	const size_t mark = target.find('?');
+	std::string decoded;
+
+	query.clear();
+	if (mark != std::string::npos)
+	{
+		query = target.substr(mark + 1);
+		target.erase(mark);
+	}
+	if (target.empty() || target.front() != '/')
+		return (false);
+	if (isCanonical(target.data(), target.size()))
+		return (true);
+	if (!decode(target, decoded))
+		return (false);
+	return (normalize(decoded, target));
+}
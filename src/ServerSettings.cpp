@@ -14,7 +14,7 @@
 
 ServerSettings::ServerSettings()
 	: _listen(), _server_name(), _root(), _error_dir(), _client_max_body_size(),
-	  _location_settings()
+	  _precompress(false), _location_settings()
 {
 }
 
@@ -22,7 +22,7 @@ ServerSettings::ServerSettings(const ServerSettings &rhs)
 	: _listen(rhs._listen), _server_name(rhs._server_name), _root(rhs._root),
 	  _error_dir(rhs._error_dir),
 	  _client_max_body_size(rhs._client_max_body_size),
-	  _location_settings(rhs._location_settings)
+	  _precompress(rhs._precompress), _location_settings(rhs._location_settings)
 {
 }
 
@@ -35,6 +35,7 @@ ServerSettings &ServerSettings::operator=(const ServerSettings &rhs)
 	_error_dir = rhs._error_dir;
 	_root = rhs._root;
 	_client_max_body_size = rhs._client_max_body_size;
+	_precompress = rhs._precompress;
 	_location_settings = rhs._location_settings;
 	return (*this);
 }
@@ -59,7 +60,7 @@ void ServerSettings::validateBlock(void)
 
 ServerSettings::ServerSettings(std::vector<Token>::iterator &token)
 	: _listen(), _server_name(), _root(), _error_dir(), _client_max_body_size(),
-	  _location_settings()
+	  _precompress(false), _location_settings()
 {
 	token += 2;
 
@@ -182,6 +183,18 @@ void ServerSettings::parseClientMaxBodySize(const Token value)
 	_client_max_body_size = it->str();
 }
 
+void ServerSettings::parsePrecompress(const Token value)
+{
+	if (value.getString() == "on" || value.getString() == "ON")
+		_precompress = true;
+	else if (value.getString() == "off" || value.getString() == "OFF")
+		_precompress = false;
+	else
+		throw std::runtime_error(
+			"ConfigParser: Unknown VALUE for precompress: " +
+			value.getString());
+}
+
 void ServerSettings::addValueToServerSettings(
 	const Token &key, std::vector<Token>::iterator &value)
 {
@@ -199,6 +212,8 @@ void ServerSettings::addValueToServerSettings(
 			parseErrorDir(*value);
 		else if (key.getString() == "client_max_body_size")
 			parseClientMaxBodySize(*value);
+		else if (key.getString() == "precompress")
+			parsePrecompress(*value);
 		else
 			logger.log(WARNING,
 					   "ServerSettings: unknown KEY token: " + key.getString());
@@ -233,10 +248,19 @@ const std::string &ServerSettings::getClientMaxBodySize() const
 	return (_client_max_body_size);
 }
 
+bool ServerSettings::getPrecompress() const
+{
+	return (_precompress);
+}
+
+const std::vector<LocationSettings> &ServerSettings::getLocationSettings() const
+{
+	return (_location_settings);
+}
+
 // Funcion: find the longest possible locationblock that fits the
-// request_target. request_target will be stripped from it's trailing input.
-// (line 3) and expects LocationBlock requesttarget to always start and end with
-// a '/'
+// request_target, the canonical path of the request without its query.
+// Expects LocationBlock requesttarget to always start and end with a '/'
 //
 // EXAMPLES:
 //
@@ -255,15 +279,13 @@ const std::string &ServerSettings::getClientMaxBodySize() const
 // /png/images/			=> /
 //
 
-const LocationSettings &
+Outcome<const LocationSettings *>
 ServerSettings::resolveLocation(const std::string &request_target) const
 {
 	Logger &logger = Logger::getInstance();
 	const LocationSettings *ret = nullptr;
-	std::string searched = request_target.substr(0, request_target.find("?"));
 
 	logger.log(DEBUG, "resolveLocation: request:\t\t" + request_target);
-	logger.log(DEBUG, "resolveLocation: searched:\t\t" + searched);
 	for (const auto &instance : _location_settings)
 	{
 		const size_t pos = request_target.find(instance.getPath());
@@ -276,11 +298,14 @@ ServerSettings::resolveLocation(const std::string &request_target) const
 			ret = &instance;
 	}
 	if (ret == nullptr)
-		throw std::logic_error("Couldn't resolve Location in server: " +
-							   _server_name);
+	{
+		logger.log(WARNING, "resolveLocation: no location in server: " +
+								_server_name);
+		return (fail(StatusCode::NotFound));
+	}
 
 	logger.log(DEBUG, "resolveLocation: Found:\t\t" + ret->getPath());
-	return (*ret);
+	return (ret);
 }
 
 // Printing:
@@ -298,6 +323,9 @@ void ServerSettings::printServerSettings() const
 	logger.log(DEBUG, "\t_Root:\t\t\t" + _root);
 	logger.log(DEBUG, "\t_ErrorDir:\t\t" + _error_dir);
 	logger.log(DEBUG, "\t_ClientMaxBodySize:\t" + _client_max_body_size);
+	logger.log(DEBUG, "\t_Precompress:\t\t" +
+						  (_precompress ? std::string(" ON")
+										: std::string(" OFF")));
 
 	for (auto &location_instance : _location_settings)
 	{
@@ -2,6 +2,7 @@
 #include <Token.hpp>
 
 #include <sstream>
+#include <stdexcept>
 #include <vector>
 
 Token::Token(TokenType type, const std::string &string)
@@ -78,6 +79,30 @@ void splitString(std::string &input, std::vector<Token> &list)
 		list.emplace_back(Token(identifyToken(input), input));
 }
 
+// A value in double quotes runs up to the closing quote, whitespace, '#'
+// and "{};" included, and becomes a single WORD without the quotes. What
+// follows the closing quote is tokenized as usual.
+void splitQuoted(std::stringstream &sstream, std::string &input,
+				 std::vector<Token> &list)
+{
+	size_t close = input.find('"', 1);
+
+	while (close == std::string::npos)
+	{
+		std::string rest;
+
+		if (!std::getline(sstream, rest, '"') || sstream.eof())
+			throw std::runtime_error("Syntax Error: unterminated quote: " +
+									 input);
+		input += rest + '"';
+		close = input.find('"', 1);
+	}
+	list.emplace_back(Token(TokenType::WORD, input.substr(1, close - 1)));
+	input.erase(0, close + 1);
+	if (!input.empty())
+		splitString(input, list);
+}
+
 void tokenizeStream(std::stringstream sstream, std::vector<Token> &list)
 {
 	Logger &logger = Logger::getInstance();
@@ -87,6 +112,11 @@ void tokenizeStream(std::stringstream sstream, std::vector<Token> &list)
 
 	while (sstream >> tmp)
 	{
+		if (tmp.front() == '"')
+		{
+			splitQuoted(sstream, tmp, list);
+			continue;
+		}
 		if (stripComments(sstream, tmp))
 			continue;
 		//		stringToLower(tmp); // Might be usefull to have. BUT we a PATH
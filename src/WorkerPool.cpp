@@ -0,0 +1,104 @@
+#include <CGI.hpp>
+#include <Logger.hpp>
+#include <SystemException.hpp>
+#include <WorkerPool.hpp>
+
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#include <unistd.h>
+
+#include <cstdint>
+
+// Completions are signalled through an eventfd where there is one; both ends
+// of _notify_pipe are then the same descriptor. Elsewhere a pipe does.
+WorkerPool::WorkerPool() : _threads(), _jobs(), _completed(), _stopping(false)
+{
+#ifdef __linux__
+	_notify_pipe[READ_END] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (_notify_pipe[READ_END] == SYSTEM_ERROR)
+		throw SystemException("WorkerPool eventfd");
+	_notify_pipe[WRITE_END] = _notify_pipe[READ_END];
+#else
+	if (pipe(_notify_pipe) == SYSTEM_ERROR)
+		throw SystemException("WorkerPool pipe");
+	if (fcntl(_notify_pipe[READ_END], F_SETFL, O_NONBLOCK) == SYSTEM_ERROR ||
+		fcntl(_notify_pipe[WRITE_END], F_SETFL, O_NONBLOCK) == SYSTEM_ERROR)
+		throw SystemException("WorkerPool fcntl");
+#endif
+	for (size_t i = 0; i < WORKER_THREADS; i++)
+		_threads.emplace_back(&WorkerPool::work, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_condition.notify_all();
+	for (std::thread &thread : _threads)
+		thread.join();
+	close(_notify_pipe[READ_END]);
+	if (_notify_pipe[WRITE_END] != _notify_pipe[READ_END])
+		close(_notify_pipe[WRITE_END]);
+}
+
+WorkerPool &WorkerPool::getInstance()
+{
+	static WorkerPool instance;
+	return (instance);
+}
+
+void WorkerPool::submit(int owner_fd, std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_jobs.emplace(owner_fd, std::move(job));
+	}
+	_condition.notify_one();
+}
+
+int WorkerPool::getNotifyFD(void) const
+{
+	return (_notify_pipe[READ_END]);
+}
+
+std::vector<int> WorkerPool::collectCompleted(void)
+{
+	char buffer[BUFFER_SIZE];
+	std::vector<int> completed;
+
+	while (read(_notify_pipe[READ_END], buffer, sizeof(buffer)) > 0)
+		;
+	std::lock_guard<std::mutex> lock(_mutex);
+	completed.swap(_completed);
+	return (completed);
+}
+
+void WorkerPool::work(void)
+{
+	while (true)
+	{
+		std::pair<int, std::function<void()>> job;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condition.wait(lock,
+							[this] { return (_stopping || !_jobs.empty()); });
+			if (_stopping)
+				return;
+			job = std::move(_jobs.front());
+			_jobs.pop();
+		}
+		job.second();
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_completed.push_back(job.first);
+		}
+		// A full pipe (or saturated eventfd counter) already guarantees a
+		// pending wakeup.
+		const uint64_t wakeup = 1;
+		(void)!write(_notify_pipe[WRITE_END], &wakeup, sizeof(wakeup));
+	}
+}
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+# Error-path throughput: fires requests that end in a 404, 405, 413 or a
+# redirect from several processes and reports requests per second per kind.
+#
+# usage: tests/bench_errors.py [host] [port] [seconds] [processes]
+# Expects a server block with a GET-only "/", an "/upload/" location taking
+# POST and a "/removed_folder/" location with a return directive, like
+# config/2_serv.conf.
+
+import socket
+import sys
+import multiprocessing
+import time
+
+HOST = sys.argv[1] if len(sys.argv) > 1 else "localhost"
+PORT = int(sys.argv[2]) if len(sys.argv) > 2 else 8080
+SECONDS = float(sys.argv[3]) if len(sys.argv) > 3 else 5
+PROCESSES = int(sys.argv[4]) if len(sys.argv) > 4 else 8
+
+REQUESTS = {
+    "404": b"GET /does/not/exist HTTP/1.1\r\nHost: localhost\r\n\r\n",
+    "405": b"DELETE / HTTP/1.1\r\nHost: localhost\r\n\r\n",
+    "413": b"POST /upload/x HTTP/1.1\r\nHost: localhost\r\n"
+           b"Content-Length: 999999999\r\n\r\n",
+    "302": b"GET /removed_folder/ HTTP/1.1\r\nHost: localhost\r\n\r\n",
+}
+
+
+def fire(request, expected, deadline, counts):
+    done = 0
+    wrong = 0
+    while time.monotonic() < deadline:
+        with socket.create_connection((HOST, PORT)) as sock:
+            sock.sendall(request)
+            response = b""
+            while b"\r\n" not in response:
+                chunk = sock.recv(4096)
+                if not chunk:
+                    break
+                response += chunk
+        if response.split(b" ", 2)[1:2] == [expected]:
+            done += 1
+        else:
+            wrong += 1
+    counts.put((done, wrong))
+
+
+def run(kind, request):
+    counts = multiprocessing.Queue()
+    deadline = time.monotonic() + SECONDS
+    workers = [
+        multiprocessing.Process(target=fire, args=(request, kind.encode(),
+                                                   deadline, counts))
+        for _ in range(PROCESSES)
+    ]
+    for worker in workers:
+        worker.start()
+    counts = [counts.get() for _ in workers]
+    for worker in workers:
+        worker.join()
+    done = sum(c[0] for c in counts)
+    wrong = sum(c[1] for c in counts)
+    print(f"{kind}: {done / SECONDS:8.0f} req/s"
+          + (f" ({wrong} unexpected)" if wrong else ""))
+
+
+if __name__ == "__main__":
+    for kind, request in REQUESTS.items():
+        run(kind, request)
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+# CGI launch cost against the size of the server: starts each given server
+# binary in a scratch directory, grows its resident set with a preloaded
+# ballast standing in for caches that filled up, and times sequential GETs of
+# a trivial CGI script. With fork() every request copies the server's page
+# tables, so latency grows with its RSS; with posix_spawn() it shouldn't.
+#
+# usage: tests/bench_spawn.py [requests] [max MB] server...
+# e.g. build WebServ.out before and after a change, copy both and compare.
+
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+REQUESTS = int(sys.argv[1]) if len(sys.argv) > 1 else 200
+MAX_MB = int(sys.argv[2]) if len(sys.argv) > 2 else 1024
+SERVERS = [os.path.abspath(server) for server in sys.argv[3:]]
+PORT = 8089
+
+CONFIG = f"""server {{
+	listen localhost:{PORT};
+	server_name localhost;
+	root /data/server1;
+	client_max_body_size 1M;
+
+	location /python/ {{
+		alias /data/server1/python/;
+		allowed_methods GET;
+		cgi on;
+	}}
+}}
+"""
+
+SCRIPT = 'print("Content-Type: text/plain\\r\\n\\r\\nok", end="")\n'
+
+# Touches BALLAST_MB of anonymous memory when the server loads, then drops
+# itself from the environment so CGI children don't grow one too.
+BALLAST = r"""
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+__attribute__((constructor)) static void ballast(void)
+{
+	const char *mb = getenv("BALLAST_MB");
+	size_t size = mb ? (size_t)atol(mb) << 20 : 0;
+
+	unsetenv("LD_PRELOAD");
+	unsetenv("BALLAST_MB");
+	if (size == 0)
+		return;
+	void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+						MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory != MAP_FAILED)
+		memset(memory, 1, size);
+}
+"""
+
+
+def scratch():
+    root = tempfile.mkdtemp(prefix="bench_spawn.")
+    os.makedirs(f"{root}/data/server1/python")
+    with open(f"{root}/bench.conf", "w") as config:
+        config.write(CONFIG)
+    with open(f"{root}/data/server1/python/ok.py", "w") as script:
+        script.write(SCRIPT)
+    os.chmod(f"{root}/data/server1/python/ok.py", 0o755)
+    with open(f"{root}/ballast.c", "w") as source:
+        source.write(BALLAST)
+    subprocess.run(["cc", "-O2", "-shared", "-fPIC", "-o",
+                    f"{root}/ballast.so", f"{root}/ballast.c"], check=True)
+    return root
+
+
+def get():
+    with socket.create_connection(("localhost", PORT)) as sock:
+        sock.sendall(b"GET /python/ok.py HTTP/1.1\r\nHost: localhost\r\n"
+                     b"Connection: close\r\n\r\n")
+        response = b""
+        while True:
+            chunk = sock.recv(4096)
+            if not chunk:
+                break
+            response += chunk
+    if not response.startswith(b"HTTP/1.1 200"):
+        raise RuntimeError(response[:80])
+
+
+def wait_ready():
+    deadline = time.monotonic() + 10
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection(("localhost", PORT)).close()
+            return
+        except OSError:
+            time.sleep(0.05)
+    raise RuntimeError("server didn't start listening")
+
+
+def rss_mb(pid):
+    with open(f"/proc/{pid}/status") as status:
+        for line in status:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1]) // 1024
+    return 0
+
+
+def measure(root, server, mb):
+    env = dict(os.environ, LD_PRELOAD=f"{root}/ballast.so",
+               BALLAST_MB=str(mb))
+    process = subprocess.Popen([server, "bench.conf"], cwd=root, env=env,
+                               stdout=subprocess.DEVNULL,
+                               stderr=subprocess.DEVNULL)
+    try:
+        wait_ready()
+        get()
+        start = time.perf_counter()
+        for _ in range(REQUESTS):
+            get()
+        elapsed = (time.perf_counter() - start) / REQUESTS * 1e6
+        return rss_mb(process.pid), elapsed
+    finally:
+        process.terminate()
+        process.wait()
+
+
+if __name__ == "__main__":
+    if not SERVERS:
+        sys.exit(f"usage: {sys.argv[0]} [requests] [max MB] server...")
+    root = scratch()
+    sizes = [0] + [mb for mb in (64, 256, 1024, 4096) if mb <= MAX_MB]
+    print(f"{'server':>20} {'RSS MB':>8} {'CGI GET us':>12}")
+    for server in SERVERS:
+        for mb in sizes:
+            rss, latency = measure(root, server, mb)
+            print(f"{os.path.basename(server):>20} {rss:>8} {latency:>12.0f}")
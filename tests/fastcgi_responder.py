@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+# Minimal multiplexing FastCGI responder for trying out fastcgi_pass.
+# Answers every request with its CGI variables and echoes the body; a
+# "sleep" query parameter delays the answer by that many seconds so that
+# requests overlap on one connection.
+#
+# usage: tests/fastcgi_responder.py unix:/tmp/fcgi.sock | host:port
+
+import asyncio
+import struct
+import sys
+import urllib.parse
+
+BEGIN, ABORT, END, PARAMS, STDIN, STDOUT, STDERR = 1, 2, 3, 4, 5, 6, 7
+GET_VALUES, GET_VALUES_RESULT = 9, 10
+MAX_REQS = 16
+
+
+def record(kind, request_id, content=b""):
+    padding = -len(content) % 8
+    return (struct.pack(">BBHHBx", 1, kind, request_id, len(content),
+                        padding) + content + b"\0" * padding)
+
+
+def decode_length(data, pos):
+    if data[pos] < 128:
+        return data[pos], pos + 1
+    return struct.unpack(">I", data[pos:pos + 4])[0] & 0x7fffffff, pos + 4
+
+
+def decode_pairs(data):
+    pairs, pos = {}, 0
+    while pos < len(data):
+        name_length, pos = decode_length(data, pos)
+        value_length, pos = decode_length(data, pos)
+        name = data[pos:pos + name_length].decode()
+        pos += name_length
+        pairs[name] = data[pos:pos + value_length].decode("latin-1")
+        pos += value_length
+    return pairs
+
+
+def encode_pairs(pairs):
+    out = b""
+    for name, value in pairs.items():
+        for item in (name, value):
+            length = len(item)
+            out += (bytes([length]) if length < 128
+                    else struct.pack(">I", length | 0x80000000))
+        out += name.encode() + value.encode()
+    return out
+
+
+async def respond(writer, request_id, params, body):
+    query = urllib.parse.parse_qs(params.get("QUERY_STRING", ""))
+    await asyncio.sleep(float(query.get("sleep", ["0"])[0]))
+    lines = [f"{name}={value}" for name, value in sorted(params.items())]
+    content = ("\n".join(lines) + "\n\n").encode() + body
+    out = b"Content-Type: text/plain\r\nX-Request-Id: %d\r\n\r\n" % request_id
+    out += content
+    for i in range(0, len(out), 65535):
+        writer.write(record(STDOUT, request_id, out[i:i + 65535]))
+    writer.write(record(STDOUT, request_id))
+    writer.write(record(END, request_id, struct.pack(">IB3x", 0, 0)))
+    await writer.drain()
+
+
+async def serve(reader, writer):
+    requests = {}
+    try:
+        while True:
+            header = await reader.readexactly(8)
+            _, kind, request_id, length, padding = struct.unpack(">BBHHBx",
+                                                                 header)
+            content = await reader.readexactly(length + padding)
+            content = content[:length]
+            if kind == GET_VALUES:
+                wanted = decode_pairs(content)
+                known = {"FCGI_MPXS_CONNS": "1",
+                         "FCGI_MAX_REQS": str(MAX_REQS),
+                         "FCGI_MAX_CONNS": "8"}
+                writer.write(record(GET_VALUES_RESULT, 0, encode_pairs(
+                    {k: known[k] for k in wanted if k in known})))
+            elif kind == BEGIN:
+                requests[request_id] = [b"", b""]
+            elif kind == PARAMS and request_id in requests:
+                requests[request_id][0] += content
+            elif kind == STDIN and request_id in requests:
+                if content:
+                    requests[request_id][1] += content
+                else:
+                    params, body = requests.pop(request_id)
+                    asyncio.ensure_future(respond(writer, request_id,
+                                                  decode_pairs(params), body))
+            elif kind == ABORT:
+                requests.pop(request_id, None)
+    except (asyncio.IncompleteReadError, ConnectionError):
+        writer.close()
+
+
+async def main(address):
+    if address.startswith("unix:"):
+        server = await asyncio.start_unix_server(serve, address[5:])
+    else:
+        host, port = address.rsplit(":", 1)
+        server = await asyncio.start_server(serve, host, int(port))
+    async with server:
+        await server.serve_forever()
+
+
+if __name__ == "__main__":
+    asyncio.run(main(sys.argv[1] if len(sys.argv) > 1
+                     else "unix:/tmp/fcgi.sock"))
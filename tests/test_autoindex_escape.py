@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+# Autoindex escaping: uploads files whose names carry markup through a
+# multipart POST, then checks that the HTML listing shows them escaped and
+# the JSON listing returns them unchanged. Removes the files afterwards.
+#
+# usage: tests/test_autoindex_escape.py [host] [port] [location]
+# Expects a location taking GET, POST and DELETE with autoindex on, like
+# "/upload/" in config/default.conf plus GET and DELETE.
+
+import json
+import socket
+import sys
+import urllib.parse
+
+HOST = sys.argv[1] if len(sys.argv) > 1 else "localhost"
+PORT = int(sys.argv[2]) if len(sys.argv) > 2 else 8080
+LOCATION = sys.argv[3] if len(sys.argv) > 3 else "/upload/"
+
+NAMES = {
+    "<script>alert(1)<": "&lt;script&gt;alert(1)&lt;",
+    "fish & chips": "fish &amp; chips",
+    'say "hi"': "say &quot;hi&quot;",
+}
+BOUNDARY = "escape-test-boundary"
+
+
+def request(method, target, headers="", body=b""):
+    head = (f"{method} {target} HTTP/1.1\r\nHost: {HOST}\r\n"
+            f"Content-Length: {len(body)}\r\nConnection: close\r\n{headers}"
+            "\r\n")
+    with socket.create_connection((HOST, PORT)) as sock:
+        sock.sendall(head.encode() + body)
+        response = b""
+        while True:
+            chunk = sock.recv(65536)
+            if not chunk:
+                break
+            response += chunk
+    head, _, body = response.partition(b"\r\n\r\n")
+    status = int(head.split(b" ", 2)[1])
+    if b"transfer-encoding: chunked" in head.lower():
+        body = unchunk(body)
+    return status, body
+
+
+def unchunk(body):
+    out = b""
+    while True:
+        size, _, body = body.partition(b"\r\n")
+        size = int(size, 16)
+        if size == 0:
+            return out
+        out += body[:size]
+        body = body[size + 2:]
+
+
+def upload():
+    body = b""
+    for name in NAMES:
+        body += (f"--{BOUNDARY}\r\nContent-Disposition: form-data; "
+                 f'name="file"; filename="{name}"\r\n\r\n').encode()
+        body += b"escape test\r\n"
+    body += f"--{BOUNDARY}--\r\n".encode()
+    return request("POST", LOCATION, "Content-Type: multipart/form-data; "
+                   f"boundary={BOUNDARY}\r\n", body)[0]
+
+
+def check(what, ok):
+    print(f"{'ok  ' if ok else 'FAIL'} {what}")
+    return ok
+
+
+if __name__ == "__main__":
+    passed = check(f"upload to {LOCATION}", upload() in (200, 201))
+    status, html = request("GET", LOCATION)
+    passed &= check("HTML listing", status == 200)
+    html = html.decode("utf-8", "replace")
+    for name, escaped in NAMES.items():
+        passed &= check(f"HTML shows {escaped}",
+                        escaped in html and name not in html)
+    status, listing = request("GET", LOCATION + "?format=json")
+    listed = [entry["name"] for entry in json.loads(listing)["entries"]]
+    passed &= check("JSON listing", status == 200)
+    for name in NAMES:
+        passed &= check(f"JSON lists {name}", name in listed)
+    for name in NAMES:
+        request("DELETE", LOCATION + urllib.parse.quote(name))
+    sys.exit(0 if passed else 1)